@@ -0,0 +1,210 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <ros_babel_fish/generation/internal/message_spec_parser.h>
+#include <ros_babel_fish/generation/providers/integrated_description_provider.h>
+#include <ros/package.h>
+
+#include <chrono>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+
+namespace fs = std::experimental::filesystem;
+using namespace ros_babel_fish;
+
+/*
+ * Compares the single pass message specification parser with the regular expressions that were used before on all
+ * message specifications installed in the current workspace and measures the time it takes to resolve all packages
+ * and to create the message descriptions for all of them.
+ */
+
+namespace
+{
+struct MessageFile
+{
+  std::string type;
+  std::string specification;
+};
+
+struct ParsedLine
+{
+  int kind = 0; // 0: Neither, 1: Constant, 2: Field
+  std::string type;
+  std::string base_type;
+  std::string name;
+  std::string value;
+
+  bool operator==( const ParsedLine &other ) const
+  {
+    return kind == other.kind && type == other.type && base_type == other.base_type && name == other.name &&
+           value == other.value;
+  }
+};
+
+std::vector<MessageFile> collectMessages()
+{
+  std::vector<MessageFile> result;
+  ros::V_string packages;
+  if ( !ros::package::getAll( packages )) return result;
+  for ( auto &pkg : packages )
+  {
+    fs::path msg_path = fs::path( ros::package::getPath( pkg )) / "msg";
+    if ( !fs::is_directory( msg_path )) continue;
+    for ( auto &entry : fs::directory_iterator( msg_path ))
+    {
+      if ( entry.path().extension() != ".msg" ) continue;
+      std::ifstream file( entry.path().string());
+      std::stringstream buffer;
+      buffer << file.rdbuf();
+      result.push_back( { pkg + "/" + entry.path().stem().string(), buffer.str() } );
+    }
+  }
+  return result;
+}
+
+template<typename ParseLine>
+void parseSpecification( const std::string &specification, std::vector<ParsedLine> &result, ParseLine parse_line )
+{
+  std::string::size_type start = 0;
+  while ( true )
+  {
+    std::string::size_type end = specification.find( '\n', start );
+    result.emplace_back();
+    parse_line( specification.data() + start,
+                specification.data() + (end == std::string::npos ? specification.length() : end ), result.back());
+    if ( end == std::string::npos ) break;
+    start = end + 1;
+  }
+}
+
+void parseLineRegex( const char *first, const char *last, ParsedLine &line )
+{
+  static std::regex constant_regex( R"(^\s*(\w+)\s+([a-zA-Z]\w*)\s*=\s*(.*\S)\s*$)" );
+  static std::regex strip_comment_regex( R"(([^#]*[^#\s])\s*(?:#.*)?)" );
+  static std::regex field_regex( R"(^\s*((\w+\/?\w+)(?:\s*\[\d*\])?)\s*(\w+)\s*)" );
+  std::cmatch match;
+  if ( std::regex_search( first, last, match, constant_regex ) && match.size() == 4 )
+  {
+    line.kind = 1;
+    line.type = match.str( 1 );
+    line.name = match.str( 2 );
+    line.value = match.str( 3 );
+    if ( line.type != "string" )
+    {
+      std::smatch value_match;
+      std::string value = line.value;
+      std::regex_search( value.cbegin(), value.cend(), value_match, strip_comment_regex );
+      line.value = value_match.str( 1 );
+    }
+  }
+  else if ( std::regex_search( first, last, match, field_regex ) && match.size() == 4 )
+  {
+    line.kind = 2;
+    line.type = match.str( 1 );
+    line.base_type = match.str( 2 );
+    line.name = match.str( 3 );
+  }
+}
+
+void parseLine( const char *first, const char *last, ParsedLine &line )
+{
+  if ( internal::parseConstantLine( first, last, line.type, line.name, line.value ))
+  {
+    line.kind = 1;
+    if ( line.type != "string" ) line.value = internal::stripComment( line.value );
+  }
+  else if ( internal::parseFieldLine( first, last, line.type, line.base_type, line.name ))
+  {
+    line.kind = 2;
+  }
+}
+
+template<typename ParseLine>
+double measure( const std::vector<MessageFile> &messages, int iterations, ParseLine parse_line )
+{
+  std::vector<ParsedLine> lines;
+  auto start = std::chrono::steady_clock::now();
+  for ( int i = 0; i < iterations; ++i )
+  {
+    for ( auto &message : messages )
+    {
+      lines.clear();
+      parseSpecification( message.specification, lines, parse_line );
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>( end - start ).count() / iterations;
+}
+}
+
+int main( int argc, char **argv )
+{
+  int iterations = argc > 1 ? std::stoi( argv[1] ) : 10;
+  std::vector<MessageFile> messages = collectMessages();
+  if ( messages.empty())
+  {
+    std::cerr << "No message specifications found! Make sure your workspace is sourced." << std::endl;
+    return 1;
+  }
+  size_t line_count = 0;
+  size_t mismatches = 0;
+  for ( auto &message : messages )
+  {
+    std::vector<ParsedLine> expected, actual;
+    parseSpecification( message.specification, expected, parseLineRegex );
+    parseSpecification( message.specification, actual, parseLine );
+    line_count += expected.size();
+    for ( size_t i = 0; i < expected.size(); ++i )
+    {
+      if ( expected[i] == actual[i] ) continue;
+      ++mismatches;
+      std::cerr << "Result differed for line " << (i + 1) << " of " << message.type << std::endl;
+    }
+  }
+  std::cout << "Parsed " << messages.size() << " message specifications with " << line_count << " lines." << std::endl;
+  if ( mismatches != 0 )
+  {
+    std::cerr << mismatches << " lines were parsed differently!" << std::endl;
+    return 1;
+  }
+
+  double regex_time = measure( messages, iterations, parseLineRegex );
+  double parser_time = measure( messages, iterations, parseLine );
+  std::cout << "Regex:  " << regex_time << " ms" << std::endl;
+  std::cout << "Parser: " << parser_time << " ms (" << regex_time / parser_time << "x)" << std::endl;
+
+  for ( unsigned int thread_count : { 1U, 0U } )
+  {
+    IntegratedDescriptionProvider package_provider;
+    auto start = std::chrono::steady_clock::now();
+    package_provider.resolveAllPackages( thread_count );
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "Resolving all packages (" << (thread_count == 0 ? "all" : std::to_string( thread_count ))
+              << " threads): " << std::chrono::duration<double, std::milli>( end - start ).count() << " ms" << std::endl;
+  }
+
+  // Cold start lookup of all messages including the file system look up, MD5 computation and template creation
+  auto start = std::chrono::steady_clock::now();
+  IntegratedDescriptionProvider provider;
+  size_t failed = 0;
+  for ( auto &message : messages )
+  {
+    try
+    {
+      if ( provider.getMessageDescription( message.type ) == nullptr ) ++failed;
+    }
+    catch ( BabelFishException & )
+    {
+      ++failed;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  std::cout << "Creating all message descriptions: " << std::chrono::duration<double, std::milli>( end - start ).count()
+            << " ms";
+  if ( failed != 0 ) std::cout << " (" << failed << " failed)";
+  std::cout << std::endl;
+  return 0;
+}
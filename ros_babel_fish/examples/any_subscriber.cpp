@@ -87,7 +87,7 @@ void dumpMessageContent( const Message &message, const std::string &prefix = ""
     for ( size_t i = 0; i < compound.keys().size(); ++i )
     {
       std::cout << prefix << compound.keys()[i] << ": ";
-      dumpMessageContent( *compound.values()[i], prefix + "  " );
+      dumpMessageContent( *compound.childAt( i ), prefix + "  " );
       if ( i != compound.keys().size() - 1 ) std::cout << std::endl;
     }
   }
@@ -80,15 +80,23 @@ int main( int argc, char **argv )
   rosbag::Bag bag( argv[1] );
   rosbag::View view( bag );
 
+  // Populate the MessageOnlyDescriptionProvider object with all message definitions in the given bag at once.
+  // Registering all connections in one batch parses the specifications of common dependencies only once.
+  std::vector<const rosbag::ConnectionInfo *> connections = view.getConnections();
+  std::vector<DescriptionProvider::MessageDefinition> definitions;
+  definitions.reserve( connections.size());
+  for ( const auto &c : connections ) definitions.push_back( { c->datatype, c->md5sum, c->msg_def } );
+  std::vector<MessageDescription::ConstPtr> descriptions = description_provider->registerMessagesByDefinition(
+    definitions );
+
   // Get the set of relevant topics.
-  // Also populates the MessageOnlyDescriptionProvider object with all message definitions in the given bag.
   std::unordered_set<std::string> topics;
-  for ( const auto &c : view.getConnections())
+  for ( size_t i = 0; i < connections.size(); ++i )
   {
-    auto desc = description_provider->getMessageDescription( c->datatype, c->md5sum, c->msg_def );
-    const auto &field_names = desc->message_template->compound.names;
+    if ( descriptions[i] == nullptr ) continue;
+    const auto &field_names = descriptions[i]->message_template->compound.names;
     if ( std::find( field_names.begin(), field_names.end(), "header" ) != field_names.end())
-      topics.insert( c->topic );
+      topics.insert( connections[i]->topic );
   }
 
   for ( const rosbag::MessageInstance &mi: view )
@@ -16,6 +16,28 @@
 namespace ros_babel_fish
 {
 
+namespace TranslationFlags
+{
+enum TranslationFlag : uint32_t
+{
+  None = 0x0000,
+  /*!
+   * Allocates the translated message tree in a single MessageArena that is released at once when the translated
+   * message is destroyed instead of allocating each node separately on the heap. Only the message nodes are allocated
+   * in the arena, the elements of arrays and the content of strings are still allocated on the heap.
+   * Parts of the tree must not outlive the root message, use Message::clone to obtain an independent copy.
+   */
+  Arena = 0x0001,
+  /*!
+   * Only computes the offsets of the fields of compound messages and creates the child messages when they are
+   * accessed for the first time. Reduces the translation cost if only a few fields of a message are accessed.
+   * The translated message must not be accessed concurrently, not even using const methods.
+   */
+  Lazy = 0x0002
+};
+}
+typedef TranslationFlags::TranslationFlag TranslationFlag;
+
 /*!
  * The Message internally points to the buffer of the BabelFishMessage, hence, this ensures that this buffer is not
  * destroyed as long as the message exists or it is detached from the buffer using Message::detachFromStream.
@@ -59,9 +81,11 @@ public:
    * translated message. The reference to the input message is needed to ensure the data is not destroyed because
    * the translated message may depend on it.
    * @param msg The received BabelFishMessage
+   * @param flags A combination of TranslationFlags that control how the message is translated.
    * @return A struct containing the input and the translated message.
    */
-  TranslatedMessage::Ptr translateMessage( const IBabelFishMessage::ConstPtr &msg );
+  TranslatedMessage::Ptr translateMessage( const IBabelFishMessage::ConstPtr &msg,
+                                           uint32_t flags = TranslationFlags::None );
 
   /*!
    * Translates the given BabelFishMessage into a translated message.
@@ -69,13 +93,17 @@ public:
    * not destroyed during the lifetime of Message (or until Message is detached using Message::detachFromStream).
    * Hence, the user has to ensure the BabelFishMessage is not destroyed or detach the Message before it is destroyed.
    * @param msg The received BabelFishMessage
+   * @param flags A combination of TranslationFlags that control how the message is translated.
    * @return The translated message.
    */
-  Message::Ptr translateMessage( const IBabelFishMessage &msg );
+  Message::Ptr translateMessage( const IBabelFishMessage &msg, uint32_t flags = TranslationFlags::None );
 
   /*!
    * Translates a message created by BabelFish into a BabelFishMessage that can be sent using the implementations
    * provided by ROS.
+   * If the message was translated from a BabelFishMessage and its size did not change, e.g., because only fixed size
+   * fields were modified, the serialized message is obtained by copying the original buffer and overwriting only the
+   * parts that were accessed for writing.
    * @param msg The input message
    * @return The serialized ROS compatible message
    */
@@ -153,8 +181,21 @@ public:
 
   DescriptionProvider::Ptr &descriptionProvider();
 
+  /*!
+   * @return The pool the buffers of translated BabelFishMessages are allocated from.
+   *   If nullptr, the BufferPool::defaultPool() is used.
+   */
+  const BufferPool::Ptr &bufferPool() const;
+
+  /*!
+   * Sets the pool the buffers of translated BabelFishMessages are allocated from.
+   * @param pool The pool or nullptr to use the BufferPool::defaultPool().
+   */
+  void setBufferPool( BufferPool::Ptr pool );
+
 private:
   DescriptionProvider::Ptr description_provider_;
+  BufferPool::Ptr buffer_pool_;
 };
 
 } // ros_babel_fish
@@ -4,12 +4,16 @@
 #ifndef ROS_BABEL_FISH_BABEL_FISH_MESSAGE_H
 #define ROS_BABEL_FISH_BABEL_FISH_MESSAGE_H
 
+#include "ros_babel_fish/buffer_pool.h"
 #include "ros_babel_fish/message_description.h"
 
 #include <ros/serialization.h>
+#include <ros/serialized_message.h>
 #include <ros/service_callback_helper.h>
 #include <ros/service_traits.h>
 
+#include <atomic>
+
 namespace ros_babel_fish
 {
 
@@ -49,9 +53,56 @@ public:
   virtual const uint8_t *buffer() const = 0;
 };
 
+/*!
+ * The type information of a BabelFishMessage.
+ * Instances are immutable and shared by all messages received on the same connection or created from the same
+ * MessageDescription, hence, the type of a message costs a reference count increment instead of string copies.
+ */
+struct BabelFishMessageType
+{
+  typedef std::shared_ptr<const BabelFishMessageType> ConstPtr;
+
+  BabelFishMessageType( std::string md5sum, std::string datatype, std::string definition, bool latched = false,
+                        std::string server_md5sum = "*" );
+
+  std::string md5;
+  std::string server_md5;
+  std::string datatype;
+  //! Empty if the message is not a service request or response.
+  std::string service_datatype;
+  std::string definition;
+  bool latched;
+
+  /*!
+   * @return The type of a message with an unknown type.
+   */
+  static const ConstPtr &unknown();
+
+  /*!
+   * Obtains the type described by the given connection header.
+   * The type is created once per connection and thread and reused for subsequent messages with the same connection
+   * header without locking. Each thread caches the types of the last few connections it received messages on.
+   */
+  static ConstPtr fromConnectionHeader( const boost::shared_ptr<std::map<std::string, std::string>> &header );
+
+  /*!
+   * Obtains the type for the given description.
+   * The type is created once per datatype, MD5 sum and server md5sum and reused for subsequent calls. Each thread
+   * caches the types of the last few descriptions it used, which are looked up without locking.
+   */
+  static ConstPtr fromDescription( const MessageDescription::ConstPtr &description,
+                                   const std::string &server_md5sum = "*" );
+};
+
 /*!
  * A message that can store any type of message.
  * The message contents can be retrieved by translating it with a BabelFish.
+ *
+ * The buffer may be shared with other BabelFishMessages, e.g., copies of this message, or with the buffer it was
+ * received in (see share). Shared buffers are copied when they are accessed using the non-const buffer() method.
+ * Service responses share the buffer they were received in. Messages received by a subscriber are copied once into a
+ * buffer from the default BufferPool because roscpp only lends the transport buffer to the subscription while the
+ * message is deserialized.
  */
 class BabelFishMessage : public IBabelFishMessage
 {
@@ -84,6 +135,16 @@ public:
 
   void morph( const MessageDescription::ConstPtr &description, const std::string &server_md5sum = "*" );
 
+  /*!
+   * Changes the type of this message to the given type without copying it.
+   */
+  void morph( BabelFishMessageType::ConstPtr type );
+
+  /*!
+   * @return The type information of this message which is shared with other messages of the same type.
+   */
+  const BabelFishMessageType::ConstPtr &messageType() const { return type_; }
+
   /*!
    * Writes the serialized message to the given stream.
    * @tparam Stream A stream class providing an advance method that takes a uint32_t with the size and returns the
@@ -106,33 +167,67 @@ public:
   template<typename Stream>
   void read( Stream &stream )
   {
-    // Allocate buffer and copy data
+    // The stream does not own its data, hence, it has to be copied. This is the path of messages received by a
+    // subscriber since roscpp frees the transport buffer after the message was deserialized.
     allocate( stream.getLength());
     std::memcpy( buffer_, stream.getData(), stream.getLength());
   }
 
+  /*!
+   * Uses the given buffer without copying it. The buffer is kept alive by this message and its copies.
+   * @param owner The owner of the memory that contains the serialized message.
+   * @param data Pointer to the serialized message inside the memory owned by owner.
+   * @param size The size of the serialized message in bytes.
+   */
+  void share( const boost::shared_array<uint8_t> &owner, const uint8_t *data, uint32_t size );
+
+  /*!
+   * Uses the buffer of the given serialized message, e.g., as received by the transport layer, without copying it.
+   * The length prefix of the serialized message is skipped if message_start points after it.
+   */
+  void share( const ros::SerializedMessage &serialized_message );
+
+  /*!
+   * @return Whether the buffer may be shared with another owner, i.e., it was obtained using share() or this message
+   *   was copied or is a copy. The buffer is considered shared until a new buffer is allocated, even if the other
+   *   owners were released in the meantime.
+   */
+  bool isBufferShared() const;
+
   /*!
    * @return The size of the message which is the number of used bytes.
    */
   uint32_t size() const final;
 
-  uint8_t *buffer() { return buffer_; }
+  /*!
+   * Provides write access to the buffer. If the buffer is shared, it is copied first.
+   */
+  uint8_t *buffer();
 
   const uint8_t *buffer() const final { return buffer_; }
 
+  /*!
+   * Allocates a buffer with at least the given size from the default BufferPool.
+   * The content of the buffer is undefined afterwards.
+   */
   void allocate( size_t size );
 
+  /*!
+   * Allocates a buffer with at least the given size from the given pool or on the heap if pool is nullptr.
+   * The current buffer is reused if it is large enough and not shared.
+   * The content of the buffer is undefined afterwards.
+   */
+  void allocate( size_t size, const BufferPool::Ptr &pool );
+
 private:
-  std::string md5_;
-  std::string server_md5_;
-  std::string datatype_;
-  mutable std::string service_datatype_; // Generated on-demand
-  std::string definition_;
-  bool latched_;
+  BabelFishMessageType::ConstPtr type_;
 
+  boost::shared_array<uint8_t> buffer_owner_;
   uint8_t *buffer_;
   uint32_t buffer_size_;
   uint32_t buffer_used_;
+  //! Set when the buffer is shared. Copying a message marks the buffer of the source as shared, too.
+  mutable std::atomic<bool> buffer_shared_;
 };
 
 class BabelFishMessageException : public BabelFishException
@@ -232,14 +327,20 @@ struct PreDeserialize<::ros_babel_fish::BabelFishMessage>
 {
   static void notify( const PreDeserializeParams<::ros_babel_fish::BabelFishMessage> &params )
   {
-    std::string md5 = (*params.connection_header)["md5sum"];
-    std::string datatype = (*params.connection_header)["type"];
-    std::string msg_def = (*params.connection_header)["message_definition"];
-    std::string latching = (*params.connection_header)["latching"];
-
-    params.message->morph( md5, datatype, msg_def, latching == "1" );
+    params.message->morph( ::ros_babel_fish::BabelFishMessageType::fromConnectionHeader( params.connection_header ));
   }
 };
+
+/*!
+ * Messages deserialized from a SerializedMessage, e.g., service responses, share its buffer instead of copying it.
+ * Subscriptions do not use this function, they read the message from a stream which copies it (see
+ * BabelFishMessage::read).
+ */
+template<>
+inline void deserializeMessage( const SerializedMessage &m, ::ros_babel_fish::BabelFishMessage &message )
+{
+  message.share( m );
+}
 } // serialization
 
 } // ros
@@ -0,0 +1,117 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_BUFFER_POOL_H
+#define ROS_BABEL_FISH_BUFFER_POOL_H
+
+#include <boost/shared_array.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ros_babel_fish
+{
+
+/*!
+ * Provides the buffers of BabelFishMessages.
+ * Buffers are released using the deleter of the returned shared_array, hence, an implementation can recycle them.
+ * Messages received by a subscriber are copied into a buffer from the default pool.
+ * Service responses share the buffer they were received in and do not use a pool.
+ */
+class BufferPool
+{
+public:
+  typedef std::shared_ptr<BufferPool> Ptr;
+
+  virtual ~BufferPool() = default;
+
+  /*!
+   * Acquires a buffer that can hold at least the given number of bytes.
+   * @param size The minimum size of the buffer in bytes.
+   * @param capacity Set to the actual size of the buffer in bytes.
+   * @return The buffer which is returned to the pool once the last reference to it is released.
+   */
+  virtual boost::shared_array<uint8_t> acquire( size_t size, size_t &capacity ) = 0;
+
+  /*!
+   * @return The pool used by BabelFishMessages and BabelFish instances if no other pool is set.
+   *   May be nullptr in which case buffers are allocated on the heap.
+   */
+  static Ptr defaultPool();
+
+  /*!
+   * Sets the pool used by BabelFishMessages and BabelFish instances if no other pool is set.
+   * Buffers that were acquired from the previous pool stay valid.
+   * @param pool The new default pool or nullptr to allocate buffers on the heap.
+   */
+  static void setDefaultPool( Ptr pool );
+};
+
+/*!
+ * Thread-safe BufferPool that recycles released buffers in buckets with power of two sizes.
+ * The retained memory is bounded, buffers that are released when the pool is full are deleted.
+ * Buffers larger than the largest bucket are allocated on the heap and not recycled.
+ * Buffers acquired from the pool may outlive it, they are deleted when released after the pool was destroyed.
+ */
+class BucketBufferPool : public BufferPool
+{
+public:
+  /*!
+   * @param min_buffer_size The size of the smallest bucket in bytes. Rounded up to the next power of two.
+   * @param max_buffer_size The size of the largest bucket in bytes.
+   * @param max_retained_bytes The maximum number of bytes that are kept for reuse over all buckets.
+   * @param max_buffers_per_bucket The maximum number of buffers that are kept for reuse in each bucket.
+   */
+  explicit BucketBufferPool( size_t min_buffer_size = 256, size_t max_buffer_size = 64 * 1024 * 1024,
+                             size_t max_retained_bytes = 128 * 1024 * 1024, size_t max_buffers_per_bucket = 16 );
+
+  BucketBufferPool( const BucketBufferPool & ) = delete;
+
+  BucketBufferPool &operator=( const BucketBufferPool & ) = delete;
+
+  ~BucketBufferPool() override;
+
+  boost::shared_array<uint8_t> acquire( size_t size, size_t &capacity ) override;
+
+  /*!
+   * @return The number of bytes currently kept for reuse.
+   */
+  size_t retainedBytes() const;
+
+  /*!
+   * Deletes all buffers that are currently kept for reuse.
+   */
+  void clear();
+
+private:
+  struct Storage
+  {
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t *>> buckets;
+    size_t retained_bytes = 0;
+    size_t max_retained_bytes = 0;
+    size_t max_buffers_per_bucket = 0;
+
+    ~Storage();
+
+    void release( uint8_t *buffer, size_t bucket, size_t capacity );
+  };
+
+  struct Deleter
+  {
+    std::weak_ptr<Storage> storage;
+    size_t bucket;
+    size_t capacity;
+
+    void operator()( uint8_t *buffer ) const;
+  };
+
+  std::shared_ptr<Storage> storage_;
+  size_t min_buffer_size_;
+};
+} // ros_babel_fish
+
+#endif //ROS_BABEL_FISH_BUFFER_POOL_H
@@ -0,0 +1,139 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_DECODE_PROGRAM_H
+#define ROS_BABEL_FISH_DECODE_PROGRAM_H
+
+#include "ros_babel_fish/generation/message_template.h"
+#include "ros_babel_fish/message.h"
+
+#include <vector>
+
+namespace ros_babel_fish
+{
+class MessageArena;
+
+namespace DecodeOperationTypes
+{
+enum DecodeOperationType : uint8_t
+{
+  /*!
+   * Checks once that the next size bytes are in the stream and marks them as the current fixed block.
+   */
+  FixedBlock,
+  /*!
+   * Creates a fixed size field from the current fixed block at a precomputed offset without any further checks.
+   */
+  FixedField,
+  /*!
+   * Creates a field of variable size, e.g., a string or a dynamic array, from the stream.
+   */
+  VariableField,
+  /*!
+   * Creates a nested compound message that receives all fields up to the matching EndCompound.
+   */
+  BeginCompound,
+  EndCompound
+};
+}
+using DecodeOperationType = DecodeOperationTypes::DecodeOperationType;
+
+typedef Message *(*DecodeFixedFunction)( const MessageTemplate &msg_template, const uint8_t *data,
+                                         MessageArena *arena );
+
+typedef Message *(*DecodeVariableFunction)( const MessageTemplate::ConstPtr &msg_template, const uint8_t *stream,
+                                            size_t stream_length, size_t &bytes_read, MessageArena *arena );
+
+struct DecodeOperation
+{
+  DecodeOperationType type;
+  /*!
+   * Size of the block for FixedBlock, offset inside the current block for FixedField.
+   */
+  size_t value;
+  /*!
+   * Size of the field in bytes for FixedField.
+   */
+  size_t size;
+  /*!
+   * Template of the field for FixedField, VariableField and BeginCompound.
+   */
+  MessageTemplate::ConstPtr msg_template;
+  DecodeFixedFunction decode_fixed;
+  DecodeVariableFunction decode_variable;
+};
+
+struct DecodeField;
+struct DecodeProgram;
+
+/*!
+ * Advances bytes_read past the given field without creating any messages.
+ * @throws BabelFishException If the field exceeds the stream.
+ */
+typedef void (*SkipFunction)( const DecodeField &field, const uint8_t *stream, size_t stream_length,
+                              size_t &bytes_read );
+
+struct DecodeField
+{
+  MessageTemplate::ConstPtr msg_template;
+  //! Whether the field always has the same size.
+  bool is_fixed_size;
+  //! The size of the field in bytes if it is fixed size.
+  size_t fixed_size;
+  //! The size of an element of an array field if the elements are fixed size, 0 otherwise.
+  size_t element_size;
+  //! The program of a compound field or of the elements of a compound array field.
+  std::shared_ptr<const DecodeProgram> program;
+  //! Used to skip the field if it is not fixed size.
+  SkipFunction skip;
+  DecodeFixedFunction decode_fixed;
+  DecodeVariableFunction decode_variable;
+};
+
+/*!
+ * A flat, linear representation of a message template that is used to decode messages of that type from a stream.
+ * Nested compound messages are inlined and consecutive fixed size fields, even across nested messages, are merged into
+ * a single block that is bounds checked once.
+ */
+struct DecodeProgram
+{
+  typedef std::shared_ptr<DecodeProgram> Ptr;
+  typedef std::shared_ptr<const DecodeProgram> ConstPtr;
+
+  std::vector<DecodeOperation> operations;
+
+  /*!
+   * The direct fields of the compound message. Used to locate and decode single fields, e.g., for lazy decoding.
+   */
+  std::vector<DecodeField> fields;
+
+  //! Whether all messages of this type have the same size.
+  bool is_fixed_size = true;
+  //! The size of a message of this type in bytes if it is fixed size.
+  size_t fixed_size = 0;
+};
+
+/*!
+ * Advances bytes_read past a message with the given program without creating any messages.
+ * @throws BabelFishException If the message exceeds the stream.
+ */
+void skipMessage( const DecodeProgram &program, const uint8_t *stream, size_t stream_length, size_t &bytes_read );
+
+/*!
+ * @return The precompiled program of the given compound message template. If the template has none, e.g., because it
+ *   was not created by a DescriptionProvider, the program is compiled on the first call and stored in the template.
+ *   Thread-safe, concurrent first calls may compile the program more than once but all store an equivalent program.
+ */
+DecodeProgram::ConstPtr getDecodeProgram( const MessageTemplate &msg_template );
+
+/*!
+ * Compiles the decode program for the given compound message template.
+ * @param msg_template A template of type MessageTypes::Compound.
+ * @return The compiled program.
+ *
+ * @throws BabelFishException If the template is not a compound template.
+ */
+DecodeProgram::ConstPtr compileDecodeProgram( const MessageTemplate &msg_template );
+} // ros_babel_fish
+
+#endif //ROS_BABEL_FISH_DECODE_PROGRAM_H
@@ -0,0 +1,157 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_DESCRIPTION_CACHE_H
+#define ROS_BABEL_FISH_DESCRIPTION_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ros_babel_fish
+{
+
+/*!
+ * Persistent on-disk cache of parsed message and service specifications.
+ *
+ * The cache file is memory mapped and starts with an index of all entries. Entries are only decoded when they are
+ * looked up, hence, opening the cache is cheap even if it contains many types.
+ * Each entry contains everything that is needed to create the description without parsing the specification or
+ * computing the MD5 sum, i.e., the parsed fields, constants and dependencies of which the message template is created.
+ * Entries are validated against the modification time and size of the file they were created from.
+ *
+ * Not thread-safe. The DescriptionProvider only accesses it while holding its resolve lock.
+ */
+class DescriptionCache
+{
+public:
+  //! The version of the file format. Files with a different version are ignored and overwritten on save.
+  static constexpr uint32_t VERSION = 1;
+
+  //! Checksum used to detect corrupted records.
+  static uint64_t checksum( const uint8_t *data, size_t size );
+
+  struct FileStamp
+  {
+    int64_t modification_time = 0;
+    uint64_t size = 0;
+
+    bool operator==( const FileStamp &other ) const
+    {
+      return modification_time == other.modification_time && size == other.size;
+    }
+
+    bool operator!=( const FileStamp &other ) const { return !(*this == other); }
+  };
+
+  struct MessageEntry
+  {
+    struct Constant
+    {
+      std::string type;
+      std::string name;
+      std::string val;
+    };
+    std::string datatype;
+    std::string package;
+    std::string md5;
+    std::string specification;
+    //! The full message definition including the specifications of all dependencies.
+    std::string definition;
+    std::vector<Constant> constants;
+    std::vector<std::string> types;
+    std::vector<std::string> names;
+    std::vector<std::string> dependencies;
+    //! The MD5 sums of the dependencies at the time the entry was created.
+    std::vector<std::string> dependency_md5s;
+    //! The path of the .msg or .srv file this entry was created from.
+    std::string source;
+    FileStamp source_stamp;
+  };
+
+  struct ServiceEntry
+  {
+    std::string datatype;
+    std::string md5;
+    std::string specification;
+    //! The path of the .srv file this entry was created from.
+    std::string source;
+    FileStamp source_stamp;
+  };
+
+  /*!
+   * Opens the cache file at the given path.
+   * If the file does not exist, can not be read or has a different version, the cache starts empty.
+   */
+  explicit DescriptionCache( std::string path );
+
+  ~DescriptionCache();
+
+  DescriptionCache( const DescriptionCache & ) = delete;
+
+  DescriptionCache &operator=( const DescriptionCache & ) = delete;
+
+  /*!
+   * @return True if an entry for the given message type was found, false otherwise.
+   *   An entry is also not found if it is corrupted.
+   */
+  bool findMessage( const std::string &datatype, MessageEntry &entry ) const;
+
+  bool findService( const std::string &datatype, ServiceEntry &entry ) const;
+
+  //! Adds or replaces the entry for the message type. Only written to disk when save is called.
+  void storeMessage( MessageEntry entry );
+
+  void storeService( ServiceEntry entry );
+
+  /*!
+   * Writes the cache file if entries were added.
+   * The file is written to a temporary file first and then renamed, hence, processes that read the cache at the same
+   * time either see the old or the new cache. If multiple processes save at the same time, the last one wins.
+   * @return True if the cache is up to date on disk, false if it could not be written.
+   */
+  bool save();
+
+  const std::string &path() const { return path_; }
+
+  //! @return True if the cache contains neither messages nor services.
+  bool empty() const;
+
+  /*!
+   * @return The default location of the cache which is in the ROS home directory, i.e., $ROS_HOME or ~/.ros.
+   *   Empty if neither is set.
+   */
+  static std::string defaultPath();
+
+  /*!
+   * Obtains the modification time and size of a file.
+   * @return True if successful, false if the file does not exist or can not be accessed.
+   */
+  static bool getFileStamp( const std::string &path, FileStamp &stamp );
+
+private:
+  //! Location of a record in the mapped file.
+  struct Record
+  {
+    size_t offset;
+    size_t size;
+    uint64_t checksum;
+  };
+
+  void load();
+
+  void unload();
+
+  std::string path_;
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  std::unordered_map<std::string, Record> message_records_;
+  std::unordered_map<std::string, Record> service_records_;
+  std::unordered_map<std::string, MessageEntry> added_messages_;
+  std::unordered_map<std::string, ServiceEntry> added_services_;
+};
+} // ros_babel_fish
+
+#endif //ROS_BABEL_FISH_DESCRIPTION_CACHE_H
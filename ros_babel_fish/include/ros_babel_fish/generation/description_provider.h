@@ -7,11 +7,26 @@
 #include "ros_babel_fish/babel_fish_message.h"
 #include "ros_babel_fish/message_description.h"
 
+#include <boost/thread/shared_mutex.hpp>
+
+#include <mutex>
 #include <unordered_map>
 
 namespace ros_babel_fish
 {
 
+/*!
+ * Base class for the look up of message and service descriptions.
+ *
+ * All public methods are thread-safe. Look ups of cached descriptions only acquire a shared lock and can be performed
+ * concurrently. Cache misses are resolved while holding an exclusive, recursive lock. Hence, each type is resolved only
+ * once even if multiple threads request it at the same time and the getMessageDescriptionImpl and
+ * getServiceDescriptionImpl implementations of subclasses are never called concurrently.
+ *
+ * Multiple versions of a message type, e.g., from bags that were recorded with different versions of a package, can
+ * coexist and are looked up by their datatype and MD5 sum. Look ups by datatype only return the version that was
+ * registered first.
+ */
 class DescriptionProvider
 {
 protected:
@@ -35,6 +50,14 @@ protected:
 public:
   typedef std::shared_ptr<DescriptionProvider> Ptr;
 
+  //! The datatype, MD5 sum and full definition of a message, e.g., of a connection in a bag.
+  struct MessageDefinition
+  {
+    std::string datatype;
+    std::string md5;
+    std::string definition;
+  };
+
   DescriptionProvider();
 
   virtual ~DescriptionProvider() = default;
@@ -43,6 +66,12 @@ public:
 
   MessageDescription::ConstPtr getMessageDescription( const IBabelFishMessage &msg );
 
+  /*!
+   * Looks up the version of a message with the given MD5 sum. If it was not registered yet, it is resolved from the
+   * given definition. The types contained in the definition are registered in the version of the definition as well,
+   * hence, this version can differ from the version that is returned when looking up the type without MD5 sum.
+   * @param definition The full definition including the specifications of all dependencies.
+   */
   MessageDescription::ConstPtr getMessageDescription( const std::string &type, const std::string &md5,
                                                       const std::string &definition );
 
@@ -57,14 +86,37 @@ protected:
   virtual MessageDescription::ConstPtr getMessageDescriptionImpl( const std::string &type,
                                                                   const std::string &definition );
 
+  /*!
+   * Resolves the version of a message with the given MD5 sum that is not registered yet.
+   * The default implementation resolves it from the given full definition.
+   */
+  virtual MessageDescription::ConstPtr getMessageDescriptionImpl( const std::string &type, const std::string &md5,
+                                                                  const std::string &definition );
+
   virtual MessageDescription::ConstPtr getMessageDescriptionImpl( const IBabelFishMessage &msg );
 
   virtual ServiceDescription::ConstPtr getServiceDescriptionImpl( const std::string &type ) = 0;
 
+  /*!
+   * Registers the messages of multiple definitions at once. Each distinct specification contained in the definitions
+   * is only parsed once and definitions with a known datatype and MD5 sum are not parsed at all.
+   * @return The descriptions in the order of the given definitions. Contains nullptr for definitions that could not be
+   *   registered.
+   */
+  std::vector<MessageDescription::ConstPtr> registerDefinitions( const std::vector<MessageDefinition> &definitions );
+
   MessageTemplate::Ptr createTemplate( const MessageSpec &spec );
 
   MessageDescription::ConstPtr registerMessage( const MessageSpec &spec, const std::string &definition );
 
+  /*!
+   * Registers a message whose dependencies are registered in the versions with the given MD5 sums which may differ
+   * from the versions that are returned when looking up the dependencies without MD5 sum.
+   * @param dependency_md5s The MD5 sums of the dependencies in the order of spec.dependencies.
+   */
+  MessageDescription::ConstPtr registerMessage( const MessageSpec &spec, const std::string &definition,
+                                                const std::vector<std::string> &dependency_md5s );
+
   MessageDescription::ConstPtr registerMessage( const std::string &type, const std::string &definition,
                                                 const std::string &md5, const std::string &specification );
 
@@ -81,21 +133,85 @@ protected:
 
   MessageSpec createSpec( const std::string &type, const std::string &package, const std::string &specification );
 
+  //! Parses the constants, fields and dependencies of a specification without computing the MD5 sum.
+  MessageSpec parseSpec( const std::string &type, const std::string &package, const std::string &specification );
+
+  //! Requires all dependencies of the spec to be registered.
+  //! @return The MD5 sum of the spec or an empty string if a dependency is not registered.
+  std::string computeMD5( const MessageSpec &spec );
+
   std::vector<std::string> getAllDepends( const MessageSpec &spec );
 
   void loadDependencies( const MessageSpec &spec );
 
   std::string computeFullText( const MessageSpec &spec );
 
-  std::string computeMD5Text( const MessageSpec &spec );
+  /*!
+   * Computes the text the MD5 sum of the spec is computed from.
+   * @param text Set to the text. Its content is undefined if the method fails.
+   * @return False if a dependency of the spec is not registered, true otherwise.
+   */
+  bool computeMD5Text( const MessageSpec &spec, std::string &text );
+
+  /*!
+   * Has to be called while holding the resolve_mutex_.
+   * @return The spec of a registered message or nullptr if the message was not registered. While a definition is
+   *   resolved, this is the version of the message in that definition, otherwise, the version registered first.
+   */
+  const MessageSpec *findMessageSpec( const std::string &type ) const;
+
+  //! @return The registered version of the type with the given MD5 sum or nullptr if it was not registered.
+  MessageDescription::ConstPtr findMessageDescription( const std::string &type, const std::string &md5 ) const;
+
+  /*!
+   * Serializes the resolution of cache misses and the registration of new messages and services.
+   * Subclasses have to hold this lock when they access their own state outside of the *Impl methods.
+   */
+  std::recursive_mutex resolve_mutex_;
 
 private:
+  struct ParsedSpec
+  {
+    //! The spec without MD5 sum.
+    MessageSpec spec;
+    //! The MD5 sums of the registered versions of this spec by the concatenated MD5 sums of its dependencies.
+    std::unordered_map<std::string, std::string> md5s;
+  };
   void initBuiltInTypes();
 
+  //! Registers all messages contained in the given full definition. Has to be called while holding the resolve_mutex_.
+  MessageDescription::ConstPtr registerDefinition( const std::string &type, const std::string &definition );
+
+  //! Registers the version of the spec that uses the current versions of its dependencies.
+  MessageDescription::ConstPtr registerParsedSpec( ParsedSpec &parsed );
+
+  //! Makes the description available under an MD5 sum that differs from its computed MD5 sum.
+  void addMD5Alias( const std::string &type, const std::string &md5, const MessageDescription::ConstPtr &description );
+
+  MessageDescription::ConstPtr findMessageDescription( const std::string &type ) const;
+
+  /*!
+   * Looks up the description of a type that another message depends on. Has to be called while holding the
+   * resolve_mutex_. If the type is contained in the definition that is currently resolved, that version is returned.
+   */
+  MessageDescription::ConstPtr getDependencyDescription( const std::string &type );
+
+  ServiceDescription::ConstPtr findServiceDescription( const std::string &type ) const;
 
-  std::unordered_map<std::string, const MessageSpec> msg_specs_;
+  //! Guards message_descriptions_, message_versions_ and service_descriptions_. Writers also hold the resolve_mutex_.
+  mutable boost::shared_mutex cache_mutex_;
+  //! The specs of all versions of each type by their MD5 sum. Only accessed while holding the resolve_mutex_.
+  std::unordered_map<std::string, std::unordered_map<std::string, const MessageSpec>> msg_specs_;
+  //! The version of each type that was registered first and is returned when looking up a type without MD5 sum.
   std::unordered_map<std::string, MessageDescription::ConstPtr> message_descriptions_;
+  //! All versions of each type by their MD5 sum.
+  std::unordered_map<std::string, std::unordered_map<std::string, MessageDescription::ConstPtr>> message_versions_;
   std::unordered_map<std::string, ServiceDescription::ConstPtr> service_descriptions_;
+  //! The MD5 sums of the types in the definition that is currently resolved. Only accessed while holding the resolve_mutex_.
+  std::unordered_map<std::string, std::string> definition_md5s_;
+  //! The specs contained in registered definitions by their type and specification. Only accessed while holding the
+  //! resolve_mutex_.
+  std::unordered_map<std::string, std::unordered_map<std::string, ParsedSpec>> parsed_specs_;
   std::set<std::string> builtin_types_;
 };
 } // ros_babel_fish
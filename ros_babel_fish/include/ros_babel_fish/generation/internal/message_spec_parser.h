@@ -0,0 +1,54 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_MESSAGE_SPEC_PARSER_H
+#define ROS_BABEL_FISH_MESSAGE_SPEC_PARSER_H
+
+#include <string>
+
+namespace ros_babel_fish
+{
+//! Internal namespace not for public use, may change at any time.
+namespace internal
+{
+
+/*
+ * Single pass tokenizers for the lines of a ROS message specification.
+ * Each function operates on a single line [first, last) without the line break and produces the same results as the
+ * regular expressions that were previously used to parse message specifications.
+ */
+
+/*!
+ * Parses a constant declaration of the form: type NAME = value
+ * Equivalent to the regex ^\s*(\w+)\s+([a-zA-Z]\w*)\s*=\s*(.*\S)\s*$
+ * @return True if the line is a constant declaration, false otherwise. The outputs are only modified on success.
+ */
+bool parseConstantLine( const char *first, const char *last, std::string &type, std::string &name, std::string &value );
+
+/*!
+ * Parses a field declaration of the form: type[N] name
+ * Equivalent to the regex ^\s*((\w+\/?\w+)(?:\s*\[\d*\])?)\s*(\w+)\s*
+ * @param type The type including the array specifier if present.
+ * @param base_type The type without array specifier.
+ * @return True if the line is a field declaration, false otherwise. The outputs are only modified on success.
+ */
+bool parseFieldLine( const char *first, const char *last, std::string &type, std::string &base_type,
+                     std::string &name );
+
+/*!
+ * Extracts the type of a field or constant declaration without array specifier.
+ * Equivalent to the regex ^\s*(\w+(?:/\w+)?)
+ * @return True if the line starts with a type, false otherwise.
+ */
+bool parseFieldType( const char *first, const char *last, std::string &type );
+
+/*!
+ * Strips a trailing comment and whitespace from a constant value.
+ * Equivalent to the first capture of the regex ([^#]*[^#\s])\s*(?:#.*)? and, hence, returns an empty string if the
+ * value contains only whitespace and comments.
+ */
+std::string stripComment( const std::string &value );
+}
+}
+
+#endif //ROS_BABEL_FISH_MESSAGE_SPEC_PARSER_H
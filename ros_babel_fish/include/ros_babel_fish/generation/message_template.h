@@ -7,10 +7,12 @@
 #include "ros_babel_fish/message.h"
 
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 namespace ros_babel_fish
 {
+struct DecodeProgram;
 
 struct MessageTemplate
 {
@@ -22,8 +24,25 @@ struct MessageTemplate
   struct
   {
     std::string datatype;
+    /*!
+     * The MD5 sum of the message type which distinguishes versions of the same datatype.
+     * Set by the DescriptionProvider, empty for templates that were created manually.
+     */
+    std::string md5;
     std::vector<std::string> names;
     std::vector<MessageTemplate::ConstPtr> types;
+    /*!
+     * Maps the names to their index in names and types.
+     * Built once by the DescriptionProvider, empty for templates that were created manually.
+     */
+    std::unordered_map<std::string, size_t> name_indices;
+    /*!
+     * Flat program used to decode messages of this type from a stream.
+     * Compiled once by the DescriptionProvider. For templates that were created manually, it is compiled and stored by
+     * getDecodeProgram when the first message is decoded, hence, such templates must not be changed afterwards.
+     * Once the template is in use, it must only be accessed using std::atomic_load and std::atomic_store.
+     */
+    mutable std::shared_ptr<const DecodeProgram> decode_program;
   } compound{};
   struct
   {
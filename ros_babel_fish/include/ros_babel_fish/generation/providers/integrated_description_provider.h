@@ -4,29 +4,93 @@
 #ifndef ROS_BABEL_FISH_INTEGRATED_DESCRIPTION_PROVIDER_H
 #define ROS_BABEL_FISH_INTEGRATED_DESCRIPTION_PROVIDER_H
 
+#include "ros_babel_fish/generation/description_cache.h"
 #include "ros_babel_fish/generation/description_provider.h"
 
+#include <atomic>
+#include <memory>
+#include <set>
+#include <thread>
+
 namespace ros_babel_fish
 {
 
 /**
  * @brief C++ Reimplementation of message look ups and message definition / md5 sum generation
+ *
+ * The msg and srv directories of a package are looked up the first time a type of that package is requested and
+ * remembered afterwards.
  */
 class IntegratedDescriptionProvider : public DescriptionProvider
 {
 public:
   /**
-   * @throws BabelFishException If the package paths could not be obtained which would render the description provider unable to serve its purpose
+   * @param cache_path Path of a persistent DescriptionCache, e.g., DescriptionCache::defaultPath(), which is used to
+   *   skip parsing the specifications of unchanged messages and services in subsequent runs. No cache is used if empty.
+   * @param prefetch_packages If true, the paths of all installed packages are resolved in the background using
+   *   resolveAllPackages to speed up the first look up of a type from each package.
+   *   Otherwise, packages are only resolved when needed.
+   */
+  explicit IntegratedDescriptionProvider( const std::string &cache_path = "", bool prefetch_packages = false );
+
+  //! Stops the prefetching of package paths and saves the persistent cache if one is used.
+  ~IntegratedDescriptionProvider() override;
+
+  /*!
+   * Writes the descriptions that were resolved since the last save to the persistent cache.
+   * @return True if successful or no cache is used, false otherwise.
    */
-  IntegratedDescriptionProvider();
+  bool saveCache();
+
+  /*!
+   * Looks up the msg and srv directories of all installed packages that were not resolved yet, e.g., if all available
+   * types are needed. The packages are distributed over multiple threads and the results are merged at the end.
+   * @param thread_count The number of threads used for the look up. If 0, the number of hardware threads is used.
+   * @return False if the list of installed packages could not be obtained, true otherwise.
+   */
+  bool resolveAllPackages( unsigned int thread_count = 0 );
 
 protected:
   MessageDescription::ConstPtr getMessageDescriptionImpl( const std::string &type ) override;
 
   ServiceDescription::ConstPtr getServiceDescriptionImpl( const std::string &type ) override;
 
+  /*!
+   * Loads the spec of a message from the persistent cache if the entry was created from the given source file in its
+   * current state and all dependencies still have the same MD5 sums.
+   */
+  bool loadCachedSpec( const std::string &type, const std::string &source, const DescriptionCache::FileStamp &stamp,
+                       MessageSpec &spec, std::string &definition );
+
+  //! Stores the spec of a registered message in the persistent cache.
+  void storeCachedSpec( const std::string &type, const std::string &source, const DescriptionCache::FileStamp &stamp );
+
+  /*!
+   * Looks up the msg and srv directories of the given package if it was not resolved before.
+   * Has to be called while holding the resolve_mutex_.
+   */
+  void resolvePackage( const std::string &package );
+
+  std::unique_ptr<DescriptionCache> cache_;
+
   std::map<std::string, std::vector<std::string>> msg_paths_;
   std::map<std::string, std::vector<std::string>> srv_paths_;
+  //! All packages that were looked up including those that were not found or have neither messages nor services.
+  std::set<std::string> resolved_packages_;
+
+private:
+  void findPackagePaths( const std::string &package, const std::string &package_path,
+                         std::vector<std::string> &msg_paths, std::vector<std::string> &srv_paths ) const;
+
+  //! Has to be called while holding the resolve_mutex_. Does nothing if the package was already resolved.
+  void addPackagePaths( const std::string &package, std::vector<std::string> msg_paths,
+                        std::vector<std::string> srv_paths );
+
+  void prefetchPackages();
+
+  std::vector<std::string> workspace_shares_;
+  std::thread prefetch_thread_;
+  std::atomic<bool> stop_prefetch_;
 };
 } // ros_babel_fish
 
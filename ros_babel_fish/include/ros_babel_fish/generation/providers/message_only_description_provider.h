@@ -34,6 +34,20 @@ public:
     return DescriptionProvider::getMessageDescriptionImpl( type, definition );
   }
 
+  /*!
+   * This method registers the messages of multiple connections at once, e.g., all connections of one or more bags.
+   * Specifications that are contained in multiple definitions, e.g., common dependencies, are only parsed once.
+   *
+   * @param definitions The datatype, MD5 sum and full definition of each message.
+   * @return The descriptions in the order of the given definitions. Contains nullptr for definitions that could not be
+   *   registered, e.g., because they depend on messages that are neither contained in the definition nor registered.
+   */
+  std::vector<MessageDescription::ConstPtr>
+  registerMessagesByDefinition( const std::vector<MessageDefinition> &definitions )
+  {
+    return DescriptionProvider::registerDefinitions( definitions );
+  }
+
   /*!
    * This method registers a message by its specification. This requires all dependencies to be either inbuilt types or
    * registered before.
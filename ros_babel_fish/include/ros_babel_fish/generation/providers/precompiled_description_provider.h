@@ -0,0 +1,57 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_PRECOMPILED_DESCRIPTION_PROVIDER_H
+#define ROS_BABEL_FISH_PRECOMPILED_DESCRIPTION_PROVIDER_H
+
+#include "ros_babel_fish/generation/description_cache.h"
+#include "ros_babel_fish/generation/description_provider.h"
+
+namespace ros_babel_fish
+{
+
+/**
+ * @brief DescriptionProvider that looks up messages and services in a database that was created at build time.
+ *
+ * The database contains the parsed specifications, MD5 sums and full definitions of all messages and services and is
+ * generated by the generate_description_database tool, e.g., using the ros_babel_fish_description_database target.
+ * Message specifications are never parsed and MD5 sums never computed at runtime, hence, the time it takes to look up
+ * a type does not depend on the file system or the installed packages.
+ * Messages that come with their definition, e.g., received by a subscriber, are looked up by their type and MD5 sum.
+ * Only versions that are not contained in the database are resolved from their definition.
+ * Types that are not contained in the database can not be looked up otherwise.
+ */
+class PrecompiledDescriptionProvider : public DescriptionProvider
+{
+public:
+  /*!
+   * @param database_path The path of the database created by the generate_description_database tool.
+   * @throws BabelFishException If the database does not exist, is empty or was created for a different version.
+   */
+  explicit PrecompiledDescriptionProvider( const std::string &database_path );
+
+protected:
+  MessageDescription::ConstPtr getMessageDescriptionImpl( const std::string &type ) override;
+
+  MessageDescription::ConstPtr getMessageDescriptionImpl( const std::string &type, const std::string &md5,
+                                                          const std::string &definition ) override;
+
+  ServiceDescription::ConstPtr getServiceDescriptionImpl( const std::string &type ) override;
+
+  //! Loads the spec and full definition of the given message type from the database.
+  bool loadSpec( const std::string &type, MessageSpec &spec, std::string &definition );
+
+  static void loadSpec( DescriptionCache::MessageEntry &entry, MessageSpec &spec, std::string &definition );
+
+  /*!
+   * Registers the version of the given message type with the given MD5 sum and the versions of its dependencies it was
+   * created with from the database.
+   * @return The description or nullptr if the database does not contain this version.
+   */
+  MessageDescription::ConstPtr registerVersion( const std::string &type, const std::string &md5 );
+
+  DescriptionCache database_;
+};
+} // ros_babel_fish
+
+#endif // ROS_BABEL_FISH_PRECOMPILED_DESCRIPTION_PROVIDER_H
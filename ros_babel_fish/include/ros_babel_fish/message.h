@@ -8,10 +8,15 @@
 #include "ros_babel_fish/exceptions/babel_fish_exception.h"
 #include <ros/time.h>
 
+#include <atomic>
+#include <cassert>
 #include <memory>
 
 namespace ros_babel_fish
 {
+class MessageArena;
+
+class OutputStream;
 
 namespace MessageTypes
 {
@@ -57,6 +62,26 @@ public:
 
   virtual ~Message();
 
+  /**
+   * @defgroup Allocation of messages
+   * @brief Messages can either be allocated on the heap using new or in a MessageArena using MessageArena::create.
+   * Messages allocated in an arena must not be deleted, their destructor is run by destroy and their memory is released
+   * when the arena is destroyed.
+   * @{
+   */
+
+  /*!
+   * Destroys a message that was either created using new or allocated in a MessageArena.
+   */
+  static void destroy( Message *message );
+
+  /*!
+   * @return Whether the given message was allocated in a MessageArena.
+   */
+  static bool isArenaAllocated( const Message *message ) { return message->arena_allocated_; }
+
+  /**@}*/
+
   MessageType type() const { return type_; }
 
   const uint8_t *_stream() const { return stream_; }
@@ -95,6 +120,27 @@ public:
    */
   virtual size_t writeToStream( uint8_t *stream ) const = 0;
 
+  /**
+   * Appends the message's content to the given stream using the ROS message binary format.
+   * In contrast to writeToStream(uint8_t*), the size of the message does not have to be known beforehand if the
+   * stream grows as needed, hence, the message is only traversed once.
+   * @param stream The stream the message is appended to
+   */
+  virtual void writeToStream( OutputStream &stream ) const;
+
+  /**
+   * Writes the message to a copy of a stream that contains a message of the same type at the given offset, e.g., the
+   * stream the message was read from. Parts that are unchanged since they were read from the source stream at the
+   * same offset are skipped, hence, only the modified parts are written if the message is patched into a copy of the
+   * stream it was read from.
+   * @param source The stream that target is a copy of.
+   * @param target The copy of source the message is written to.
+   * @param offset The offset of the message in target.
+   * @param size The size of the message of the same type in target that is overwritten.
+   * @return False if the message does not have the given size. In that case, target may be partially written.
+   */
+  virtual bool _patchStream( const uint8_t *source, uint8_t *target, size_t offset, size_t size ) const;
+
   /**
    * Convenience method to access the child with the given key  of a CompoundMessage.
    * @param key The name or path of the child
@@ -118,6 +164,18 @@ public:
     return *this;
   }
 
+  /**
+   * Moves the content of other to this message. Children of compound messages and elements of compound arrays are
+   * transferred without copying them, other must only be destroyed or assigned to afterwards.
+   * @param other The other message
+   * @return A reference to this message
+   */
+  Message &operator=( Message &&other )
+  {
+    assign( std::move( other ));
+    return *this;
+  }
+
   /**
    * @defgroup Convenience methods for ValueMessage
    * @brief Will try to set the value of ValueMessage to the given value.
@@ -182,14 +240,36 @@ public:
 
 
   /**
-   * Clones the message including its content. The cloned message will be a full copy including for each part whether
-   * it is detached from the stream or not.
+   * Clones the message including its content. The clone is detached from the stream, i.e., children of lazy messages
+   * that were not accessed yet are decoded and values that are still read from the stream are copied, hence, the
+   * clone stays valid after the stream or the MessageArena of this message was destroyed.
    * @return A clone of the message.
    */
   virtual Message *clone() const = 0;
 
+  /**
+   * Clones the message using copy-on-write. Instead of copying them, the children of compound messages and the
+   * elements of compound arrays are shared with the clone by reference count. A shared child is copied once it is
+   * accessed for writing through a parent, e.g., using the non-const operator[], hence, cloning a large message costs
+   * a reference count increment per direct child until either the message or the clone is modified.
+   * Lazy children that were already accessed are fully decoded before they are shared, hence, the message and its
+   * clones can be read concurrently. Fields that were not accessed yet are not shared and decoded by each copy.
+   * References to children that were obtained before cloning must not be used to modify them afterwards.
+   * Since shared children may be allocated in a MessageArena, the arena has to outlive the clone.
+   * Messages without children are copied.
+   * @return A clone of the message.
+   */
+  virtual Message *cloneShared() const;
+
+  /*!
+   * @return Whether this message is shared between multiple parents, i.e., copy-on-write clones of its parent.
+   */
+  bool _isShared() const { return owners_.load( std::memory_order_acquire ) > 1; }
+
   /*!
    * Convenience method that casts the message to the given type.
+   * The type is checked using the type tags of the message, i.e., type() and ArrayMessageBase::elementType(), instead
+   * of RTTI.
    * Example:
    * @code
    * Message &msg = getMessage();
@@ -203,25 +283,77 @@ public:
   template<typename T>
   T &as()
   {
-    T *result = dynamic_cast<T *>(this);
-    if ( result == nullptr ) throw BabelFishException( "Tried to cast message to incompatible type!" );
-    return *result;
+    if ( !T::isInstance( *this )) throw BabelFishException( "Tried to cast message to incompatible type!" );
+    return static_cast<T &>(*this);
   }
 
   //! @copydoc Message::as()
   template<typename T>
   const T &as() const
   {
-    const T *result = dynamic_cast<const T *>(this);
-    if ( result == nullptr ) throw BabelFishException( "Tried to cast message to incompatible type!" );
-    return *result;
+    if ( !T::isInstance( *this )) throw BabelFishException( "Tried to cast message to incompatible type!" );
+    return static_cast<const T &>(*this);
+  }
+
+  /*!
+   * Casts the message to the given type without any checks in release builds.
+   * Use only if the type is known, e.g., from the MessageTemplate or type(). In debug builds, an assertion fails if
+   * the message is not of the target type.
+   * @tparam T Target type
+   * @return Message casted to the target type as reference
+   */
+  template<typename T>
+  T &asUnchecked()
+  {
+    assert( T::isInstance( *this ) && dynamic_cast<T *>(this) != nullptr );
+    return static_cast<T &>(*this);
+  }
+
+  //! @copydoc Message::asUnchecked()
+  template<typename T>
+  const T &asUnchecked() const
+  {
+    assert( T::isInstance( *this ) && dynamic_cast<const T *>(this) != nullptr );
+    return static_cast<const T &>(*this);
   }
 
+  /*!
+   * Every message class provides this method to check using the type tags whether a message is an instance of it.
+   * Used by as() and asUnchecked().
+   */
+  static bool isInstance( const Message & ) { return true; }
+
 protected:
+  Message( Message &&other ) noexcept
+    : type_( other.type_ ), stream_( other.stream_ ), owners_( 1 ), arena_allocated_( false ) { }
+
+  //! Registers an additional parent of the given child which is shared with a copy-on-write clone.
+  static void addOwner( const Message *message );
+
+  //! Removes a parent of the given child and deletes the child if it was the last one.
+  static void removeOwner( Message *message );
+
+  /*!
+   * Replaces the given child by a copy-on-write clone if it is shared with other parents, hence, it can be modified
+   * afterwards without affecting the other parents.
+   */
+  static void makeExclusive( Message *&message );
+
   virtual void assign( const Message &other ) = 0;
 
+  //! Moves the content of other to this message. Copies the content if the message type does not support moving.
+  virtual void assign( Message &&other );
+
   const MessageType type_;
   const uint8_t *stream_; // TODO regard endianness
+
+private:
+  // The number of parents that share this message, the message is deleted once the last one removes it
+  mutable std::atomic<uint32_t> owners_;
+  // Set by MessageArena::create. Only arena allocations are marked, heap allocations carry no additional data.
+  bool arena_allocated_;
+
+  friend class MessageArena;
 };
 
 
@@ -353,6 +485,15 @@ struct array_type
   typedef T ArgumentType;
   typedef T StorageType;
 };
+//! Bools are stored as bytes that are either 0 or 1 since std::vector<bool> is a bitset with slow element access.
+template<>
+struct array_type<bool>
+{
+  typedef bool ReturnType;
+  typedef bool ConstReturnType;
+  typedef bool ArgumentType;
+  typedef uint8_t StorageType;
+};
 template<>
 struct array_type<std::string>
 {
@@ -0,0 +1,89 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_MESSAGE_ARENA_H
+#define ROS_BABEL_FISH_MESSAGE_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace ros_babel_fish
+{
+class Message;
+
+/*!
+ * Monotonic memory arena used to allocate the nodes of a translated message tree.
+ * Memory is handed out from large blocks and is only released when the arena is destroyed, hence, the arena has
+ * to outlive all messages that were allocated from it.
+ * Messages allocated from an arena are destroyed using Message::destroy which runs their destructors, their memory is
+ * only returned when the arena is destroyed. The storage of their arrays and strings is allocated on the heap.
+ *
+ * The arena is not thread-safe.
+ */
+class MessageArena
+{
+public:
+  typedef std::shared_ptr<MessageArena> Ptr;
+
+  /*!
+   * @param initial_block_size The size of the first block in bytes. Subsequent blocks double in size.
+   */
+  explicit MessageArena( size_t initial_block_size = 4096 );
+
+  MessageArena( const MessageArena & ) = delete;
+
+  MessageArena &operator=( const MessageArena & ) = delete;
+
+  ~MessageArena();
+
+  /*!
+   * Allocates the given number of bytes aligned to alignof(std::max_align_t).
+   * @param size The number of bytes to allocate.
+   * @return Pointer to the allocated memory which is valid until the arena is destroyed.
+   */
+  void *allocate( size_t size );
+
+  /*!
+   * Creates a message of type T in this arena. The message is marked as arena allocated (see
+   * Message::isArenaAllocated), hence, it must be destroyed using Message::destroy instead of delete.
+   */
+  template<typename T, typename ...Args>
+  T *create( Args &&... args )
+  {
+    T *result = ::new( allocate( sizeof( T ))) T( std::forward<Args>( args )... );
+    static_cast<Message *>(result)->arena_allocated_ = true;
+    return result;
+  }
+
+  /*!
+   * @return The total number of bytes reserved from the system by this arena.
+   */
+  size_t capacity() const { return capacity_; }
+
+private:
+  std::vector<uint8_t *> blocks_;
+  uint8_t *current_;
+  size_t remaining_;
+  size_t next_block_size_;
+  size_t capacity_;
+};
+
+namespace internal
+{
+/*!
+ * Creates a message of type T either on the heap if arena is nullptr or in the given arena.
+ */
+template<typename T, typename ...Args>
+T *createMessage( MessageArena *arena, Args &&... args )
+{
+  if ( arena == nullptr ) return new T( std::forward<Args>( args )... );
+  return arena->create<T>( std::forward<Args>( args )... );
+}
+}
+} // ros_babel_fish
+
+#endif //ROS_BABEL_FISH_MESSAGE_ARENA_H
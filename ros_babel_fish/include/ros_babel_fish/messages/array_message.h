@@ -6,12 +6,16 @@
 
 #include "ros_babel_fish/generation/message_template.h"
 #include "ros_babel_fish/exceptions/babel_fish_exception.h"
+#include "ros_babel_fish/messages/internal/array_conversion.h"
 #include "ros_babel_fish/message.h"
+#include "ros_babel_fish/message_arena.h"
+#include "ros_babel_fish/output_stream.h"
 
 #include <ros/time.h>
 
 namespace ros_babel_fish
 {
+class CompoundMessage;
 
 class ArrayMessageBase : public Message
 {
@@ -20,6 +24,8 @@ public:
     : Message( MessageTypes::Array, stream ), element_type_( element_type ), length_( length )
       , fixed_length_( fixed_length ) { }
 
+  static bool isInstance( const Message &msg ) { return msg.type() == MessageTypes::Array; }
+
   MessageType elementType() const { return element_type_; }
 
   bool isFixedSize() const { return fixed_length_; }
@@ -59,9 +65,30 @@ public:
   {
   }
 
+  /*!
+   * Moves the elements of other to this array without copying them. Other is empty afterwards.
+   */
+  ArrayMessage( ArrayMessage<T> &&other ) noexcept
+    : ArrayMessageBase( std::move( other )), values_( std::move( other.values_ )), from_stream_( other.from_stream_ )
+      , stream_offsets_( std::move( other.stream_offsets_ ))
+  {
+    other.resetMovedFrom();
+  }
+
   ~ArrayMessage() override { }
 
-  static ArrayMessage<T> *fromStream( ssize_t length, const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+  /*!
+   * Arrays of Message are expected to contain compound messages since nested arrays do not exist in ROS messages.
+   */
+  static bool isInstance( const Message &msg )
+  {
+    return msg.type() == MessageTypes::Array &&
+           static_cast<const ArrayMessageBase &>(msg).elementType() ==
+           (std::is_same<T, Message>::value ? MessageTypes::Compound : message_type_traits::message_type<T>::value);
+  }
+
+  static ArrayMessage<T> *fromStream( ssize_t length, const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                      MessageArena *arena = nullptr )
   {
     (void) stream_length; // For unused warning
     bool fixed_length = length >= 0;
@@ -75,7 +102,7 @@ public:
     bytes_read += sizeof( T ) * length;
     if ( bytes_read > stream_length )
       throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-    return new ArrayMessage<T>( length, fixed_length, stream );
+    return internal::createMessage<ArrayMessage<T>>( arena, length, fixed_length, stream );
   }
 
   ReturnType operator[]( size_t index )
@@ -96,6 +123,69 @@ public:
 
   ConstReturnType at( size_t index ) const { return operator[]( index ); }
 
+  /*!
+   * Provides read access to all elements at once without any copies or bounds checks.
+   * Only available for numeric element types, i.e., not for bool, string, time, duration and compound arrays.
+   * @return Pointer to the length() contiguous elements which are located either in the stream the array was read
+   *   from or in the internal storage. Invalidated by any modification of the array.
+   */
+  const T *data() const
+  {
+    static_assert( std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                   "Contiguous access is only available for numeric arrays!" );
+    if ( from_stream_ ) return reinterpret_cast<const T *>(stream_);
+    return values_.data();
+  }
+
+  /*!
+   * Converts all elements to the type U and writes them to the given buffer.
+   * Common conversions, e.g., float32 to float64 or uint8, int16 and uint16 to float32, are vectorized.
+   * Like Message::value, values that do not fit into U result in an exception. The range is checked in batches,
+   * hence, the buffer may be partially written if an exception is thrown.
+   * @param buffer The buffer which has to be large enough for length() elements.
+   *
+   * @throws BabelFishException If a value does not fit into U.
+   */
+  template<typename U>
+  void convertTo( U *buffer ) const
+  {
+    static_assert( std::is_arithmetic<U>::value && !std::is_same<U, bool>::value,
+                   "Arrays can only be converted to numeric types!" );
+    internal::convertArray( data(), buffer, length_ );
+  }
+
+  /*!
+   * Converts all elements to the floating point type U and multiplies them with the given scale, e.g., to normalize
+   * uint8 image data to [0, 1] using a scale of 1 / 255.
+   * @param buffer The buffer which has to be large enough for length() elements.
+   * @param scale The factor each converted element is multiplied with.
+   */
+  template<typename U>
+  void convertTo( U *buffer, U scale ) const
+  {
+    static_assert( std::is_floating_point<U>::value, "Scaled conversion is only available for floating point types!" );
+    internal::convertArrayScaled( data(), buffer, length_, scale );
+  }
+
+  /*!
+   * Replaces the content of the array with the given elements which are copied at once.
+   * A stream-backed array is not detached first since its content is replaced anyway.
+   * @param values Pointer to the new elements.
+   * @param count The number of elements.
+   *
+   * @throws BabelFishException If the array is fixed size and count does not match its length.
+   */
+  template<typename U, typename std::enable_if<std::is_same<U, T>::value, int>::type = 0>
+  void assign( const U *values, size_t count )
+  {
+    static_assert( !std::is_same<T, Message>::value, "Compound arrays can not be assigned in bulk!" );
+    if ( fixed_length_ && count != length_ )
+      throw BabelFishException( "Can not change the length of a fixed size array!" );
+    values_.assign( values, values + count );
+    length_ = count;
+    from_stream_ = false;
+  }
+
   /*!
    * @param index The index at which the array element is set/overwritten
    * @param value The value with which the array element is overwritten, has to be the same as the element type.
@@ -135,6 +225,43 @@ public:
    */
   void append( ArgumentType value ) { push_back( value ); }
 
+  /*!
+   * Appends the given elements which are copied at once.
+   * @param values Pointer to the elements.
+   * @param count The number of elements.
+   *
+   * @throws BabelFishException If the array is fixed size.
+   */
+  void append( const T *values, size_t count )
+  {
+    static_assert( !std::is_same<T, Message>::value, "Compound arrays can not be appended in bulk!" );
+    if ( fixed_length_ )
+    {
+      throw BabelFishException( "Can not add items to a fixed size array!" );
+    }
+    if ( from_stream_ ) detachFromStream();
+    values_.insert( values_.end(), values, values + count );
+    length_ += count;
+  }
+
+  /*!
+   * Changes the length of the array. Added elements are value-initialized, i.e., zero for numeric types.
+   *
+   * @throws BabelFishException If the array is fixed size and length does not match its length.
+   */
+  void resize( size_t length )
+  {
+    static_assert( !std::is_same<T, Message>::value, "Compound arrays can not be resized!" );
+    if ( length == length_ ) return;
+    if ( fixed_length_ )
+    {
+      throw BabelFishException( "Can not change the length of a fixed size array!" );
+    }
+    if ( from_stream_ ) detachFromStream();
+    values_.resize( length );
+    length_ = length;
+  }
+
   /*!
    * Alias for push_back
    * Deprecated, will be removed in a future release
@@ -157,13 +284,7 @@ public:
   {
     if ( !from_stream_ ) return;
     auto data = reinterpret_cast<const T *>(stream_);
-    values_.clear();
-    values_.reserve( length_ );
-    for ( size_t i = 0; i < length_; ++i )
-    {
-      values_.push_back( *data );
-      ++data;
-    }
+    values_.assign( data, data + length_ );
     from_stream_ = false;
   }
 
@@ -182,10 +303,23 @@ public:
       std::memcpy( stream, stream_, count );
       return length;
     }
-    std::memcpy( stream, values_.data(), count );
+    if ( count > 0 ) std::memcpy( stream, values_.data(), count );
     return length;
   }
 
+  void writeToStream( OutputStream &stream ) const override
+  {
+    // Qualified calls to avoid the virtual dispatch, specializations are still used
+    ArrayMessage<T>::writeToStream( stream.advance( ArrayMessage<T>::_sizeInBytes()));
+  }
+
+  bool _patchStream( const uint8_t *source, uint8_t *target, size_t offset, size_t size ) const override
+  {
+    // An array that is still read from the same position of the source is already contained in the copy
+    if ( from_stream_ && stream_ == source + offset + (fixed_length_ ? 0 : 4)) return true;
+    return Message::_patchStream( source, target, offset, size );
+  }
+
   ArrayMessage<T> &operator=( const ArrayMessage<T> &other )
   {
     from_stream_ = other.from_stream_;
@@ -194,6 +328,21 @@ public:
     fixed_length_ = other.fixed_length_;
     values_.clear();
     values_ = other.values_;
+    stream_offsets_ = other.stream_offsets_;
+    return *this;
+  }
+
+  //! @copydoc ArrayMessage(ArrayMessage<T> &&)
+  ArrayMessage<T> &operator=( ArrayMessage<T> &&other )
+  {
+    if ( this == &other ) return *this;
+    from_stream_ = other.from_stream_;
+    stream_ = other.stream_;
+    length_ = other.length_;
+    fixed_length_ = other.fixed_length_;
+    values_ = std::move( other.values_ );
+    stream_offsets_ = std::move( other.stream_offsets_ );
+    other.resetMovedFrom();
     return *this;
   }
 
@@ -202,20 +351,46 @@ public:
     auto result = new ArrayMessage<T>( elementType(), length(), isFixedSize(), stream_, true );
     result->from_stream_ = from_stream_;
     result->values_ = values_;
+    result->stream_offsets_ = stream_offsets_;
+    // The clone is independent of the stream
+    result->detachFromStream();
+    result->stream_ = nullptr;
     return result;
   }
 
 protected:
   void assign( const Message &other ) override
   {
-    auto o = dynamic_cast<const ArrayMessage<T> *>(&other);
-    if ( o == nullptr ) throw BabelFishException( "Tried to assign incompatible Message type to ArrayMessage!" );
-    *this = *o;
+    if ( !isInstance( other ))
+      throw BabelFishException( "Tried to assign incompatible Message type to ArrayMessage!" );
+    *this = other.asUnchecked<ArrayMessage<T>>();
+  }
+
+  void assign( Message &&other ) override
+  {
+    if ( !isInstance( other ))
+      throw BabelFishException( "Tried to assign incompatible Message type to ArrayMessage!" );
+    *this = std::move( other.asUnchecked<ArrayMessage<T>>());
+  }
+
+  void resetMovedFrom()
+  {
+    values_.clear();
+    stream_offsets_.clear();
+    length_ = 0;
+    from_stream_ = false;
   }
 
 protected:
   std::vector<StorageType> values_;
   bool from_stream_;
+  /*!
+   * Only used by stream-backed arrays of variable size elements, i.e., strings.
+   * The offsets of the elements relative to stream_ followed by the total size of all elements in bytes.
+   * Built when the array is read from a stream. If the array was constructed from a stream directly, they are built on
+   * the first non-const access and const methods skip the preceding strings instead to stay safe for concurrent reads.
+   */
+  std::vector<uint32_t> stream_offsets_;
 };
 
 
@@ -243,14 +418,21 @@ template<>
 size_t ArrayMessage<Message>::writeToStream( uint8_t *stream ) const;
 
 template<>
-inline void ArrayMessage<Message>::detachFromStream()
-{
-  /* So compiler won't complain. This specialization can not be from stream anyway. */
-}
+void ArrayMessage<Message>::writeToStream( OutputStream &stream ) const;
+
+//! The array itself is never read from a stream but its elements may be.
+template<>
+bool ArrayMessage<Message>::isDetachedFromStream() const;
+
+template<>
+void ArrayMessage<Message>::detachFromStream();
 
 template<>
 ArrayMessage<Message> &ArrayMessage<Message>::operator=( const ArrayMessage<Message> &other );
 
+template<>
+ArrayMessage<Message> &ArrayMessage<Message>::operator=( ArrayMessage<Message> &&other );
+
 template<>
 Message *ArrayMessage<Message>::clone() const;
 
@@ -260,6 +442,8 @@ class CompoundArrayMessage : public ArrayMessage<Message>
   explicit CompoundArrayMessage( MessageTemplate::ConstPtr msg_template, size_t length, bool fixed_length,
                                  const uint8_t *stream );
 
+  friend class MessageArena;
+
 public:
   /*!
    * Creates a compound array, i.e., an array of compound messages in contrast to arrays of primitives such as int, bool etc.
@@ -272,8 +456,21 @@ public:
    */
   explicit CompoundArrayMessage( MessageTemplate::ConstPtr msg_template, size_t length = 0, bool fixed_length = false );
 
+  //! Moves the elements of other to this array without copying them. Other is empty afterwards.
+  CompoundArrayMessage( CompoundArrayMessage &&other ) noexcept;
+
+  CompoundArrayMessage &operator=( const CompoundArrayMessage &other ) = default;
+
+  //! @copydoc CompoundArrayMessage(CompoundArrayMessage &&)
+  CompoundArrayMessage &operator=( CompoundArrayMessage &&other );
+
+  /*!
+   * @copydoc CompoundMessage::fromStream
+   * @param lazy If true, the elements are created as lazy CompoundMessages.
+   */
   static CompoundArrayMessage *fromStream( ssize_t length, MessageTemplate::ConstPtr msg_template,
-                                           const uint8_t *stream, size_t stream_length, size_t &bytes_read );
+                                           const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                           MessageArena *arena = nullptr, bool lazy = false );
 
   const std::string &elementDataType() const { return msg_template_->compound.datatype; }
 
@@ -281,8 +478,28 @@ public:
 
   Message &appendEmpty();
 
+  using ArrayMessage<Message>::push_back;
+
+  /*!
+   * Appends the given message by moving its children to a new element instead of copying them.
+   * The given message must only be destroyed or assigned to afterwards.
+   * @return The appended element.
+   *
+   * @throws BabelFishException If the array is fixed size or the message is not of the element type.
+   */
+  CompoundMessage &push_back( CompoundMessage &&message );
+
+  using ArrayMessage<Message>::append;
+
+  //! Alias for push_back(CompoundMessage &&)
+  CompoundMessage &append( CompoundMessage &&message );
+
+  bool _patchStream( const uint8_t *source, uint8_t *target, size_t offset, size_t size ) const override;
+
   Message *clone() const override;
 
+  Message *cloneShared() const override;
+
 private:
   MessageTemplate::ConstPtr msg_template_;
 };
@@ -296,7 +513,7 @@ bool ArrayMessage<bool>::operator[]( size_t index ) const;
 
 template<>
 ArrayMessage<bool> *ArrayMessage<bool>::fromStream( ssize_t length, const uint8_t *stream, size_t stream_length,
-                                                    size_t &bytes_read );
+                                                    size_t &bytes_read, MessageArena *arena );
 
 template<>
 size_t ArrayMessage<bool>::_sizeInBytes() const;
@@ -316,7 +533,8 @@ std::string ArrayMessage<std::string>::operator[]( size_t index ) const;
 
 template<>
 ArrayMessage<std::string> *ArrayMessage<std::string>::fromStream( ssize_t length, const uint8_t *stream,
-                                                                  size_t stream_length, size_t &bytes_read );
+                                                                  size_t stream_length, size_t &bytes_read,
+                                                                  MessageArena *arena );
 
 template<>
 size_t ArrayMessage<std::string>::_sizeInBytes() const;
@@ -336,7 +554,8 @@ ros::Time ArrayMessage<ros::Time>::operator[]( size_t index ) const;
 
 template<>
 ArrayMessage<ros::Time> *ArrayMessage<ros::Time>::fromStream( ssize_t length, const uint8_t *stream,
-                                                              size_t stream_length, size_t &bytes_read );
+                                                              size_t stream_length, size_t &bytes_read,
+                                                              MessageArena *arena );
 
 template<>
 size_t ArrayMessage<ros::Time>::_sizeInBytes() const;
@@ -357,7 +576,8 @@ ros::Duration ArrayMessage<ros::Duration>::operator[]( size_t index ) const;
 
 template<>
 ArrayMessage<ros::Duration> *ArrayMessage<ros::Duration>::fromStream( ssize_t length, const uint8_t *stream,
-                                                                      size_t stream_length, size_t &bytes_read );
+                                                                      size_t stream_length, size_t &bytes_read,
+                                                                      MessageArena *arena );
 
 template<>
 size_t ArrayMessage<ros::Duration>::_sizeInBytes() const;
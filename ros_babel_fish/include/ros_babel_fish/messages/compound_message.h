@@ -4,8 +4,11 @@
 #ifndef ROS_BABEL_FISH_COMPOUND_MESSAGE_H
 #define ROS_BABEL_FISH_COMPOUND_MESSAGE_H
 
+#include "ros_babel_fish/generation/decode_program.h"
 #include "ros_babel_fish/generation/message_template.h"
+#include "ros_babel_fish/messages/field_handle.h"
 #include "ros_babel_fish/message.h"
+#include "ros_babel_fish/message_arena.h"
 
 #include <vector>
 
@@ -17,28 +20,94 @@ class CompoundMessage : public Message
 
   explicit CompoundMessage( const MessageTemplate::ConstPtr &msg_template, const uint8_t *stream );
 
+  friend class MessageArena;
+  friend class CompoundArrayMessage;
+
 public:
   typedef std::shared_ptr<CompoundMessage> Ptr;
   typedef std::shared_ptr<const CompoundMessage> ConstPtr;
 
+  /*!
+   * Creates a CompoundMessage from the given stream.
+   * @param arena If not nullptr, the message and all of its children are allocated in the given arena which has to
+   *   outlive the message.
+   * @param lazy If true, only the offsets of the fields are computed and the child messages are created when they are
+   *   accessed for the first time. Lazy messages must not be accessed concurrently, not even using const methods.
+   */
   static CompoundMessage *fromStream( const MessageTemplate::ConstPtr &msg_template, const uint8_t *stream,
-                                      size_t stream_length, size_t &bytes_read );
+                                      size_t stream_length, size_t &bytes_read, MessageArena *arena = nullptr,
+                                      bool lazy = false );
 
   explicit CompoundMessage( const MessageTemplate::ConstPtr &msg_template );
 
+  /*!
+   * Moves the children of other to this message without copying them.
+   * Other has no children afterwards and must only be destroyed or assigned to. Use release to move a single field
+   * out of a message instead.
+   * Children that were allocated in a MessageArena stay in the arena which has to outlive this message.
+   */
+  CompoundMessage( CompoundMessage &&other ) noexcept;
+
   ~CompoundMessage() override;
 
+  static bool isInstance( const Message &msg ) { return msg.type() == MessageTypes::Compound; }
+
   const std::string &datatype() const { return msg_template_->compound.datatype; }
 
   Message &operator[]( const std::string &key ) override;
 
   const Message &operator[]( const std::string &key ) const override;
 
+  /*!
+   * Accesses a field using a handle that was resolved beforehand which avoids any string comparisons.
+   * @throws BabelFishException If the handle is invalid or was created for a different message type or a different
+   *   version (MD5 sum) of the same type.
+   */
+  Message &operator[]( const FieldHandle &handle );
+
+  //! @copydoc operator[](const FieldHandle &)
+  const Message &operator[]( const FieldHandle &handle ) const;
+
+  /*!
+   * @return The index of the field with the given name in the given compound template or -1 if there is no such field.
+   */
+  static size_t indexOf( const MessageTemplate &msg_template, const std::string &key );
+
   bool containsKey( const std::string &key ) const;
 
+  /*!
+   * Moves the field with the given key out of this message without copying it. The field is replaced by an empty
+   * message of the same type. Fields that were allocated in a MessageArena are copied to the heap instead.
+   * @return The removed field which is owned by the caller from now on and can be deleted. If this message was read
+   *   from a stream without an arena, the field may still be backed by the stream.
+   */
+  Message *release( const std::string &key );
+
+  /*!
+   * Replaces the field with the given key by the given message, e.g., a field that was released from another message.
+   * @param value The new field of which this message takes ownership.
+   *
+   * @throws BabelFishException If value does not match the type of the field. The ownership stays with the caller.
+   */
+  void replace( const std::string &key, Message *value );
+
   const std::vector<std::string> &keys() const { return msg_template_->compound.names; }
 
-  const std::vector<Message *> &values() const { return values_; }
+  /*!
+   * @return The child messages in the order of keys(). For lazy messages, this creates all children that were not
+   *   accessed yet.
+   *   Since the children can be modified through the returned pointers, the message is considered modified afterwards
+   *   and children that are shared with copy-on-write clones are copied.
+   *   Use childAt for read-only access.
+   */
+  const std::vector<Message *> &values() const;
+
+  /*!
+   * @return The child at the given index in the order of keys() for read-only access. For lazy messages, the child is
+   *   created if it was not accessed yet. Children shared with copy-on-write clones are not copied.
+   * @throws std::runtime_error If the index is out of bounds.
+   */
+  const Message *childAt( size_t index ) const;
 
   size_t _sizeInBytes() const override;
 
@@ -48,16 +117,106 @@ public:
 
   size_t writeToStream( uint8_t *stream ) const override;
 
+  void writeToStream( OutputStream &stream ) const override;
+
+  bool _patchStream( const uint8_t *source, uint8_t *target, size_t offset, size_t size ) const override;
+
+  /*!
+   * @return The offset of this message in the stream it was read from (see _stream()).
+   */
+  size_t _streamOffset() const { return stream_begin_; }
+
+  /*!
+   * @return The number of bytes this message occupied in the stream it was read from or 0 if it was not read from a
+   *   stream.
+   */
+  size_t _streamSize() const { return stream_end_ - stream_begin_; }
+
+  /*!
+   * @return False if this message was read from a stream and none of its children was accessed for writing since.
+   *   Unmodified messages are serialized by copying the part of the stream they were read from.
+   */
+  bool _isModified() const { return modified_ || stream_ == nullptr; }
+
+  /*!
+   * @return Whether this message was read from the given stream at the given offset and is not modified.
+   */
+  bool _isUnchangedAt( const uint8_t *stream, size_t offset ) const
+  {
+    return !_isModified() && stream_ == stream && stream_begin_ == offset;
+  }
+
   CompoundMessage &operator=( const CompoundMessage &other );
 
+  //! @copydoc CompoundMessage(CompoundMessage &&)
+  CompoundMessage &operator=( CompoundMessage &&other );
+
   Message *clone() const override;
 
+  Message *cloneShared() const override;
+
 protected:
   void assign( const Message &other ) override;
 
+  void assign( Message &&other ) override;
+
 private:
+  /*!
+   * Runs the operations of the given program starting at index until the end of the program or the EndCompound
+   * operation that closes the target message.
+   * @return The index of the operation following the last processed operation.
+   */
+  static size_t runDecodeProgram( const DecodeProgram &program, size_t index, CompoundMessage *target,
+                                  const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                  const uint8_t *&block, size_t &position, MessageArena *arena );
+
+  //! Returns the child at the given index and creates it first if it was not accessed yet in a lazy message.
+  Message *child( size_t index ) const;
+
+  Message *createChild( size_t index ) const;
+
+  //! Decodes the child at the given index of a lazy message from the stream without storing it in this message.
+  Message *decodeChild( size_t index, MessageArena *arena, bool lazy ) const;
+
+  //! Returns a copy of the child at the given index that does not reference the stream.
+  Message *cloneChild( size_t index ) const;
+
+  //! Returns the child at the given index after replacing it by a copy if it is shared with copy-on-write clones.
+  Message *mutableChild( size_t index ) const;
+
+  //! Resolves the given handle and marks all messages along the path as modified if modify is true.
+  Message *child( const FieldHandle &handle, bool modify ) const;
+
+  bool isLazy() const { return !offsets_.empty(); }
+
+  /*!
+   * Creates all children of lazy messages in the subtree of the given message. Shared children are materialized before
+   * they are shared with copy-on-write clones since creating their children through a const accessor of one clone
+   * would otherwise race with readers of the other clones.
+   */
+  static void materialize( const Message &message );
+
+  void copyStreamState( const CompoundMessage &other );
+
+  //! Removes all references to the stream, the message is serialized field by field afterwards.
+  void clearStreamState();
+
+  void resetMovedFrom();
+
   MessageTemplate::ConstPtr msg_template_;
-  std::vector<Message *> values_;
+  mutable std::vector<Message *> values_;
+
+  // For lazy messages, values_ contains nullptr for each child that was not accessed yet and the i-th child is located
+  // in the stream from offsets_[i] to offsets_[i+1].
+  std::vector<uint32_t> offsets_;
+  DecodeProgram::ConstPtr program_;
+  MessageArena *arena_ = nullptr;
+
+  // The part of the stream this message was read from and whether the message may differ from it. The message is
+  // considered modified once a child is accessed for writing since it is unknown whether the child is changed.
+  uint32_t stream_begin_ = 0;
+  uint32_t stream_end_ = 0;
+  mutable bool modified_ = true;
 };
 } // ros_babel_fish
 
@@ -0,0 +1,55 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_FIELD_HANDLE_H
+#define ROS_BABEL_FISH_FIELD_HANDLE_H
+
+#include "ros_babel_fish/generation/message_template.h"
+
+#include <vector>
+
+namespace ros_babel_fish
+{
+
+/*!
+ * A field of a compound message type that was resolved once and can be used to access the field in any
+ * CompoundMessage of that type without any string comparisons.
+ * @code
+ * FieldHandle handle( description->message_template, "pose.position.x" );
+ * double x = message[handle].value<double>();
+ * @endcode
+ */
+class FieldHandle
+{
+public:
+  //! Creates an invalid handle.
+  FieldHandle();
+
+  /*!
+   * @param msg_template The template of the compound message type the handle is used with.
+   * @param path The name of the field or a dotted path to a field of a nested message, e.g., "pose.position.x".
+   *   The first dot is optional. Only fields of nested messages can be accessed, array elements can not.
+   *
+   * @throws InvalidMessagePathException If the path is empty or does not refer to a field of the given type.
+   */
+  FieldHandle( MessageTemplate::ConstPtr msg_template, const std::string &path );
+
+  bool isValid() const { return root_template_ != nullptr; }
+
+  //! The template of the message type for which the handle was created.
+  const MessageTemplate::ConstPtr &rootTemplate() const { return root_template_; }
+
+  //! The template of the field the handle refers to.
+  const MessageTemplate::ConstPtr &messageTemplate() const { return msg_template_; }
+
+  //! The index of the field in each compound message along the path.
+  const std::vector<size_t> &indices() const { return indices_; }
+
+private:
+  std::vector<size_t> indices_;
+  MessageTemplate::ConstPtr root_template_;
+  MessageTemplate::ConstPtr msg_template_;
+};
+} // ros_babel_fish
+
+#endif //ROS_BABEL_FISH_FIELD_HANDLE_H
@@ -0,0 +1,154 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_ARRAY_CONVERSION_H
+#define ROS_BABEL_FISH_ARRAY_CONVERSION_H
+
+#include "ros_babel_fish/exceptions/babel_fish_exception.h"
+#include "ros_babel_fish/messages/internal/value_compatibility.h"
+
+#include <ros/console.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace ros_babel_fish
+{
+//! Internal namespace not for public use, may change at any time.
+namespace internal
+{
+
+/*
+ * Vectorized kernels computing out[i] = static_cast<U>(in[i]) * scale.
+ * Use SSE2 and AVX2 if the library is compiled with support for them and fall back to scalar code otherwise.
+ * The input does not have to be aligned since it usually points into a serialized message.
+ */
+void convertArrayKernel( const float *in, double *out, size_t count, double scale );
+
+void convertArrayKernel( const double *in, float *out, size_t count, float scale );
+
+void convertArrayKernel( const uint8_t *in, float *out, size_t count, float scale );
+
+void convertArrayKernel( const int16_t *in, float *out, size_t count, float scale );
+
+void convertArrayKernel( const uint16_t *in, float *out, size_t count, float scale );
+
+void convertArrayKernel( const int32_t *in, float *out, size_t count, float scale );
+
+void convertArrayKernel( const int32_t *in, double *out, size_t count, double scale );
+
+/*!
+ * Vectorized kernel computing out[i] = in[i] != 0 ? 1 : 0 to normalize serialized bools.
+ * In and out may point to the same memory.
+ */
+void normalizeBooleans( const uint8_t *in, uint8_t *out, size_t count );
+
+template<typename T, typename U>
+struct has_conversion_kernel : std::false_type
+{
+};
+
+template<>
+struct has_conversion_kernel<float, double> : std::true_type
+{
+};
+template<>
+struct has_conversion_kernel<double, float> : std::true_type
+{
+};
+template<>
+struct has_conversion_kernel<uint8_t, float> : std::true_type
+{
+};
+template<>
+struct has_conversion_kernel<int16_t, float> : std::true_type
+{
+};
+template<>
+struct has_conversion_kernel<uint16_t, float> : std::true_type
+{
+};
+template<>
+struct has_conversion_kernel<int32_t, float> : std::true_type
+{
+};
+template<>
+struct has_conversion_kernel<int32_t, double> : std::true_type
+{
+};
+
+//! Number of elements that are range checked at once before they are converted.
+constexpr size_t CONVERSION_BATCH_SIZE = 256;
+
+template<typename T, typename U>
+void convertArray( const T *in, U *out, size_t count, std::true_type )
+{
+  convertArrayKernel( in, out, count, U( 1 ));
+}
+
+template<typename T, typename U>
+void convertArray( const T *in, U *out, size_t count, std::false_type )
+{
+  if ( std::is_same<T, U>::value )
+  {
+    if ( count > 0 ) std::memcpy( out, in, count * sizeof( T ));
+    return;
+  }
+  if ( isCompatible<T, U>())
+  {
+    for ( size_t i = 0; i < count; ++i ) out[i] = static_cast<U>(in[i]);
+    return;
+  }
+  for ( size_t start = 0; start < count; start += CONVERSION_BATCH_SIZE )
+  {
+    size_t end = std::min( count, start + CONVERSION_BATCH_SIZE );
+    // Branchless accumulation to enable auto-vectorization of the range check
+    bool in_bounds = true;
+    for ( size_t i = start; i < end; ++i ) in_bounds &= inBounds<T, U>( in[i] );
+    if ( !in_bounds ) throw BabelFishException( "Value does not fit into casted type!" );
+    for ( size_t i = start; i < end; ++i ) out[i] = static_cast<U>(in[i]);
+  }
+#if RBF_WARN_ON_INCOMPATIBLE_TYPE
+  ROS_WARN_ONCE_NAMED( "RosBabelFish",
+                       "Values fit into casted type but it is smaller than the message type which may lead to catastrophic failure in the future! This message is printed only once!" );
+#endif
+}
+
+/*!
+ * Converts count elements from in to out with the same range checks as Message::value.
+ * @throws BabelFishException If a value does not fit into U. The elements of previous batches are already converted.
+ */
+template<typename T, typename U>
+void convertArray( const T *in, U *out, size_t count )
+{
+  convertArray( in, out, count, has_conversion_kernel<T, U>());
+}
+
+template<typename T, typename U>
+void convertArrayScaled( const T *in, U *out, size_t count, U scale, std::true_type )
+{
+  convertArrayKernel( in, out, count, scale );
+}
+
+template<typename T, typename U>
+void convertArrayScaled( const T *in, U *out, size_t count, U scale, std::false_type )
+{
+  for ( size_t i = 0; i < count; ++i ) out[i] = static_cast<U>(in[i]) * scale;
+}
+
+/*!
+ * Converts count elements from in to out and multiplies them with the given scale.
+ * Only available for floating point targets, hence, no range checks are necessary.
+ */
+template<typename T, typename U>
+void convertArrayScaled( const T *in, U *out, size_t count, U scale )
+{
+  static_assert( std::is_floating_point<U>::value, "Scaled conversion is only available for floating point types!" );
+  convertArrayScaled( in, out, count, scale, has_conversion_kernel<T, U>());
+}
+}
+}
+
+#endif //ROS_BABEL_FISH_ARRAY_CONVERSION_H
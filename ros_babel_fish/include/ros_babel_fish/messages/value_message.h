@@ -6,6 +6,8 @@
 
 #include "ros_babel_fish/exceptions/babel_fish_exception.h"
 #include "ros_babel_fish/message.h"
+#include "ros_babel_fish/message_arena.h"
+#include "ros_babel_fish/output_stream.h"
 
 #include <ros/time.h>
 
@@ -24,6 +26,8 @@ public:
   explicit ValueMessage( const uint8_t *stream )
     : Message( type, stream ), value_( T()), from_stream_( stream != nullptr ) { }
 
+  static bool isInstance( const Message &msg ) { return msg.type() == type; }
+
   T getValue() const
   {
     if ( from_stream_ ) return *reinterpret_cast<const T *>(stream_);
@@ -56,14 +60,28 @@ public:
     return sizeof( T );
   }
 
-  static ValueMessage<T> *fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+  void writeToStream( OutputStream &stream ) const override
+  {
+    // Qualified calls to avoid the virtual dispatch, specializations are still used
+    ValueMessage<T>::writeToStream( stream.advance( ValueMessage<T>::_sizeInBytes()));
+  }
+
+  bool _patchStream( const uint8_t *source, uint8_t *target, size_t offset, size_t size ) const override
+  {
+    // A value that is still read from the same position of the source is already contained in the copy
+    if ( from_stream_ && stream_ == source + offset ) return true;
+    return Message::_patchStream( source, target, offset, size );
+  }
+
+  static ValueMessage<T> *fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                      MessageArena *arena = nullptr )
   {
     (void) stream_length; // For unused warning
     T val = *reinterpret_cast<const T *>(stream + bytes_read);
     bytes_read += sizeof( T );
     if ( bytes_read > stream_length )
       throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-    return new ValueMessage<T>( val );
+    return internal::createMessage<ValueMessage<T>>( arena, val );
   }
 
   ValueMessage<T> &operator=( const T &value )
@@ -80,15 +98,14 @@ public:
 
   Message *clone() const override
   {
-    if ( isDetachedFromStream()) return new ValueMessage<T>( getValue());
-    return new ValueMessage<T>( stream_ );
+    return new ValueMessage<T>( getValue());
   }
 
 protected:
   void assign( const Message &other ) override
   {
     if ( type != other.type()) throw BabelFishException( "Tried to assign incompatible message to ValueMessage!" );
-    setValue( other.as<ValueMessage<T>>().getValue());
+    setValue( other.asUnchecked<ValueMessage<T>>().getValue());
   }
 
   mutable T value_;
@@ -103,7 +120,8 @@ template<>
 size_t ValueMessage<bool>::_sizeInBytes() const;
 
 template<>
-ValueMessage<bool> *ValueMessage<bool>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read );
+ValueMessage<bool> *ValueMessage<bool>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                                    MessageArena *arena );
 
 template<>
 size_t ValueMessage<bool>::writeToStream( uint8_t *stream ) const;
@@ -117,7 +135,8 @@ size_t ValueMessage<ros::Time>::_sizeInBytes() const;
 
 template<>
 ValueMessage<ros::Time> *
-ValueMessage<ros::Time>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read );
+ValueMessage<ros::Time>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                     MessageArena *arena );
 
 template<>
 size_t ValueMessage<ros::Time>::writeToStream( uint8_t *stream ) const;
@@ -131,7 +150,8 @@ size_t ValueMessage<ros::Duration>::_sizeInBytes() const;
 
 template<>
 ValueMessage<ros::Duration> *
-ValueMessage<ros::Duration>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read );
+ValueMessage<ros::Duration>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                         MessageArena *arena );
 
 template<>
 size_t ValueMessage<ros::Duration>::writeToStream( uint8_t *stream ) const;
@@ -145,7 +165,8 @@ size_t ValueMessage<std::string>::_sizeInBytes() const;
 
 template<>
 ValueMessage<std::string> *
-ValueMessage<std::string>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read );
+ValueMessage<std::string>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                       MessageArena *arena );
 
 template<>
 size_t ValueMessage<std::string>::writeToStream( uint8_t *stream ) const;
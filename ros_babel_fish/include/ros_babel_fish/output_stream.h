@@ -0,0 +1,76 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ROS_BABEL_FISH_OUTPUT_STREAM_H
+#define ROS_BABEL_FISH_OUTPUT_STREAM_H
+
+#include "ros_babel_fish/buffer_pool.h"
+
+#include <boost/shared_array.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ros_babel_fish
+{
+
+/*!
+ * Stream messages are serialized to in a single pass.
+ * The stream either writes to a fixed buffer that has to be large enough for the entire message or grows as needed.
+ * The pointer returned by advance is only valid until the next call to advance since growing moves the data.
+ */
+class OutputStream
+{
+public:
+  /*!
+   * Creates a stream that writes to the given buffer without any bounds checks.
+   */
+  explicit OutputStream( uint8_t *buffer );
+
+  /*!
+   * Creates a stream that grows as needed.
+   * @param pool The pool the buffer is allocated from or nullptr to allocate the buffer on the heap.
+   * @param initial_capacity The expected size of the serialized message in bytes.
+   */
+  explicit OutputStream( BufferPool::Ptr pool, size_t initial_capacity = 0 );
+
+  OutputStream( const OutputStream & ) = delete;
+
+  OutputStream &operator=( const OutputStream & ) = delete;
+
+  /*!
+   * Reserves the given number of bytes at the end of the stream.
+   * @return Pointer to the reserved bytes which is valid until the next call to advance.
+   */
+  uint8_t *advance( size_t size )
+  {
+    if ( size > capacity_ - size_ ) grow( size );
+    uint8_t *result = data_ + size_;
+    size_ += size;
+    return result;
+  }
+
+  /*!
+   * @return The number of bytes written to the stream.
+   */
+  size_t size() const { return size_; }
+
+  const uint8_t *data() const { return data_; }
+
+  /*!
+   * @return The owner of the data of a growing stream or an empty array if the stream writes to a fixed buffer.
+   */
+  const boost::shared_array<uint8_t> &buffer() const { return buffer_; }
+
+private:
+  void grow( size_t size );
+
+  BufferPool::Ptr pool_;
+  boost::shared_array<uint8_t> buffer_;
+  uint8_t *data_;
+  size_t size_;
+  size_t capacity_;
+};
+} // ros_babel_fish
+
+#endif //ROS_BABEL_FISH_OUTPUT_STREAM_H
@@ -6,6 +6,7 @@
 #include "ros_babel_fish/generation/providers/integrated_description_provider.h"
 #include "ros_babel_fish/generation/message_creation.h"
 #include "ros_babel_fish/message_types.h"
+#include "ros_babel_fish/output_stream.h"
 
 #include <ros/advertise_options.h>
 #include <ros/advertise_service_options.h>
@@ -27,7 +28,54 @@ BabelFish::BabelFish( DescriptionProvider::Ptr description_provider )
 
 BabelFish::~BabelFish() = default;
 
-TranslatedMessage::Ptr BabelFish::translateMessage( const IBabelFishMessage::ConstPtr &msg )
+namespace
+{
+Message::Ptr translateStream( const MessageTemplate::ConstPtr &msg_template, const IBabelFishMessage &msg,
+                              uint32_t flags )
+{
+  const uint8_t *stream = msg.buffer();
+  size_t bytes_read = 0;
+  bool lazy = (flags & TranslationFlags::Lazy) != 0;
+  Message::Ptr translated;
+  if ( flags & TranslationFlags::Arena )
+  {
+    // The arena is kept alive by the deleter of the root message and released after the tree was destroyed
+    auto arena = std::make_shared<MessageArena>();
+    translated = Message::Ptr(
+      CompoundMessage::fromStream( msg_template, stream, msg.size(), bytes_read, arena.get(), lazy ),
+      [arena]( Message *m ) { Message::destroy( m ); } );
+  }
+  else
+  {
+    translated = Message::Ptr( CompoundMessage::fromStream( msg_template, stream, msg.size(), bytes_read, nullptr,
+                                                            lazy ));
+  }
+  if ( bytes_read != msg.size())
+    throw BabelFishException( "Translated message of type '" + msg.dataType() + "' did not consume all message bytes!" );
+  return translated;
+}
+
+/*!
+ * Serializes a message that was translated from a stream by copying that stream and overwriting only the parts that
+ * were changed, e.g., a few fixed size fields of a message that is republished.
+ * @return False if the message was not translated from a stream or its size changed.
+ */
+bool patchTranslatedMessage( const CompoundMessage &msg, const BufferPool::Ptr &pool, BabelFishMessage &result )
+{
+  const uint8_t *source = msg._stream();
+  // Only messages that were translated as a whole start at the beginning of their stream
+  if ( source == nullptr || msg._streamOffset() != 0 || msg._streamSize() == 0 ) return false;
+  size_t size = msg._streamSize();
+  OutputStream stream( pool, size );
+  uint8_t *target = stream.advance( size );
+  std::memcpy( target, source, size );
+  if ( !msg._patchStream( source, target, 0, size )) return false;
+  result.share( stream.buffer(), stream.data(), stream.size());
+  return true;
+}
+}
+
+TranslatedMessage::Ptr BabelFish::translateMessage( const IBabelFishMessage::ConstPtr &msg, uint32_t flags )
 {
   const MessageDescription::ConstPtr &message_description = description_provider_->getMessageDescription( *msg );
   if ( message_description == nullptr )
@@ -36,21 +84,16 @@ TranslatedMessage::Ptr BabelFish::translateMessage( const IBabelFishMessage::Con
       "BabelFish failed to get message description for received message of type: " + msg->dataType());
   }
   const MessageTemplate::ConstPtr &msg_template = message_description->message_template;
-  const uint8_t *stream = msg->buffer();
-  size_t bytes_read = 0;
-  if ( stream == nullptr )
+  if ( msg->buffer() == nullptr )
   {
     Message::Ptr translated = std::make_shared<CompoundMessage>( msg_template );
     return std::make_shared<TranslatedMessage>( msg, translated );
   }
 
-  Message::Ptr translated( CompoundMessage::fromStream( msg_template, stream, msg->size(), bytes_read ));
-  if ( bytes_read != msg->size())
-    throw BabelFishException( "Translated message of type '" + msg->dataType() + "' did not consume all message bytes!" );
-  return std::make_shared<TranslatedMessage>( msg, translated );
+  return std::make_shared<TranslatedMessage>( msg, translateStream( msg_template, *msg, flags ));
 }
 
-Message::Ptr BabelFish::translateMessage( const IBabelFishMessage &msg )
+Message::Ptr BabelFish::translateMessage( const IBabelFishMessage &msg, uint32_t flags )
 {
   const MessageDescription::ConstPtr &message_description = description_provider_->getMessageDescription( msg );
   if ( message_description == nullptr )
@@ -59,17 +102,12 @@ Message::Ptr BabelFish::translateMessage( const IBabelFishMessage &msg )
       "BabelFish failed to get message description for received message of type: " + msg.dataType());
   }
   const MessageTemplate::ConstPtr &msg_template = message_description->message_template;
-  const uint8_t *stream = msg.buffer();
-  size_t bytes_read = 0;
-  if ( stream == nullptr )
+  if ( msg.buffer() == nullptr )
   {
     return std::make_shared<CompoundMessage>( msg_template );
   }
 
-  Message::Ptr translated( CompoundMessage::fromStream( msg_template, stream, msg.size(), bytes_read ));
-  if ( bytes_read != msg.size())
-    throw BabelFishException( "Translated message of type '" + msg.dataType() + "' did not consume all message bytes!" );
-  return translated;
+  return translateStream( msg_template, msg, flags );
 }
 
 BabelFishMessage::Ptr BabelFish::translateMessage( const Message::ConstPtr &msg )
@@ -79,9 +117,9 @@ BabelFishMessage::Ptr BabelFish::translateMessage( const Message::ConstPtr &msg
 
 BabelFishMessage::Ptr BabelFish::translateMessage( const Message &msg )
 {
-  auto compound_msg = dynamic_cast<const CompoundMessage *>(&msg);
-  if ( compound_msg == nullptr )
+  if ( msg.type() != MessageTypes::Compound )
     throw BabelFishException( "Tried to translate message that is not a compound message!" );
+  auto compound_msg = &msg.asUnchecked<CompoundMessage>();
 
   BabelFishMessage::Ptr result( new BabelFishMessage());
   const MessageDescription::ConstPtr &description = description_provider_->getMessageDescription(
@@ -90,26 +128,33 @@ BabelFishMessage::Ptr BabelFish::translateMessage( const Message &msg )
   {
     throw BabelFishException( "BabelFish doesn't know a message of type: " + compound_msg->datatype());
   }
-  result->morph( description->md5, description->datatype, description->message_definition, "0" );
-  result->allocate( msg._sizeInBytes());
-  msg.writeToStream( result->buffer());
+  result->morph( description );
+  BufferPool::Ptr pool = buffer_pool_ == nullptr ? BufferPool::defaultPool() : buffer_pool_;
+  if ( patchTranslatedMessage( *compound_msg, pool, *result )) return result;
+  OutputStream stream( std::move( pool ));
+  msg.writeToStream( stream );
+  result->share( stream.buffer(), stream.data(), stream.size());
   return result;
 }
 
 bool BabelFish::translateMessage( const Message &msg, BabelFishMessage &result )
 {
-  auto compound_msg = dynamic_cast<const CompoundMessage *>(&msg);
-  if ( compound_msg == nullptr )
+  if ( msg.type() != MessageTypes::Compound )
     throw BabelFishException( "Tried to translate message that is not a compound message!" );
+  auto compound_msg = &msg.asUnchecked<CompoundMessage>();
   const MessageDescription::ConstPtr &description = description_provider_->getMessageDescription(
     compound_msg->datatype());
   if ( description == nullptr )
   {
     throw BabelFishException( "BabelFish doesn't know a message of type: " + compound_msg->datatype());
   }
-  result.morph( description->md5, description->datatype, description->message_definition, "0" );
-  result.allocate( msg._sizeInBytes());
-  msg.writeToStream( result.buffer());
+  result.morph( description );
+  BufferPool::Ptr pool = buffer_pool_ == nullptr ? BufferPool::defaultPool() : buffer_pool_;
+  if ( patchTranslatedMessage( *compound_msg, pool, result )) return true;
+  // The previous size of the result is a good estimate if it is reused for messages of the same type
+  OutputStream stream( std::move( pool ), result.size());
+  msg.writeToStream( stream );
+  result.share( stream.buffer(), stream.data(), stream.size());
   return true;
 }
 
@@ -221,4 +266,14 @@ DescriptionProvider::Ptr &BabelFish::descriptionProvider()
 {
   return description_provider_;
 }
+
+const BufferPool::Ptr &BabelFish::bufferPool() const
+{
+  return buffer_pool_;
+}
+
+void BabelFish::setBufferPool( BufferPool::Ptr pool )
+{
+  buffer_pool_ = std::move( pool );
+}
 }
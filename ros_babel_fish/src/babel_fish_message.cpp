@@ -3,91 +3,216 @@
 
 #include "ros_babel_fish/babel_fish_message.h"
 
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
 namespace ros_babel_fish
 {
+
+namespace
+{
+std::string headerValue( const std::map<std::string, std::string> &header, const std::string &key )
+{
+  auto it = header.find( key );
+  return it == header.end() ? std::string() : it->second;
+}
+
+/*!
+ * The types of the connections a thread received messages on most recently.
+ * The cached headers are kept alive, hence, their addresses can not be reused by new connections while they are cached.
+ */
+struct ConnectionTypeCache
+{
+  static constexpr size_t SIZE = 8;
+
+  boost::shared_ptr<std::map<std::string, std::string>> headers[SIZE];
+  BabelFishMessageType::ConstPtr types[SIZE];
+  size_t next = 0;
+};
+
+/*!
+ * The types of the descriptions a thread translated messages to most recently.
+ * The cached descriptions are kept alive, hence, their addresses can not be reused by new descriptions while they are
+ * cached.
+ */
+struct DescriptionTypeCache
+{
+  static constexpr size_t SIZE = 8;
+
+  MessageDescription::ConstPtr descriptions[SIZE];
+  BabelFishMessageType::ConstPtr types[SIZE];
+  size_t next = 0;
+};
+
+struct DescriptionTypeEntry
+{
+  std::weak_ptr<const MessageDescription> description;
+  BabelFishMessageType::ConstPtr type;
+};
+
+//! Entries of descriptions that were destroyed are removed once the number of entries reaches this size.
+constexpr size_t MIN_DESCRIPTION_SWEEP_SIZE = 64;
+
+/*!
+ * Returns the type shared by all descriptions of the same datatype, MD5 sum and server md5sum.
+ */
+BabelFishMessageType::ConstPtr internDescriptionType( const MessageDescription::ConstPtr &description,
+                                                      const std::string &server_md5sum )
+{
+  static std::mutex mutex;
+  static std::unordered_map<std::string, DescriptionTypeEntry> types;
+  static size_t sweep_size = MIN_DESCRIPTION_SWEEP_SIZE;
+
+  std::lock_guard<std::mutex> lock( mutex );
+  // Multiple versions of the same datatype can be used at the same time, hence, they need separate entries
+  std::string key = description->datatype + '\n' + description->md5 + '\n' + server_md5sum;
+  auto it = types.find( key );
+  if ( it != types.end())
+  {
+    // Descriptions of the same version, e.g., from different providers, share the type
+    if ( it->second.description.expired()) it->second.description = description;
+    return it->second.type;
+  }
+
+  // Remove entries of destroyed descriptions. The sweep size grows with the number of entries, hence, the cost of
+  // sweeping is amortized over the insertions.
+  if ( types.size() >= sweep_size )
+  {
+    for ( auto entry = types.begin(); entry != types.end(); )
+    {
+      if ( entry->second.description.expired()) entry = types.erase( entry );
+      else ++entry;
+    }
+    sweep_size = std::max( MIN_DESCRIPTION_SWEEP_SIZE, 2 * types.size());
+  }
+  BabelFishMessageType::ConstPtr type = std::make_shared<BabelFishMessageType>( description->md5,
+                                                                                description->datatype,
+                                                                                description->message_definition, false,
+                                                                                server_md5sum );
+  types.insert( { key, DescriptionTypeEntry{ description, type } } );
+  return type;
+}
+}
+
+BabelFishMessageType::BabelFishMessageType( std::string md5sum, std::string datatype, std::string definition,
+                                            bool latched, std::string server_md5sum )
+  : md5( std::move( md5sum )), server_md5( std::move( server_md5sum )), datatype( std::move( datatype ))
+    , definition( std::move( definition )), latched( latched )
+{
+  if ( this->datatype.length() > 7 && this->datatype.compare( this->datatype.length() - 7, 7, "Request" ) == 0 )
+    service_datatype = this->datatype.substr( 0, this->datatype.length() - 7 );
+  else if ( this->datatype.length() > 8 && this->datatype.compare( this->datatype.length() - 8, 8, "Response" ) == 0 )
+    service_datatype = this->datatype.substr( 0, this->datatype.length() - 8 );
+}
+
+const BabelFishMessageType::ConstPtr &BabelFishMessageType::unknown()
+{
+  static const ConstPtr type = std::make_shared<BabelFishMessageType>( "*", "", "" );
+  return type;
+}
+
+BabelFishMessageType::ConstPtr
+BabelFishMessageType::fromConnectionHeader( const boost::shared_ptr<std::map<std::string, std::string>> &header )
+{
+  if ( header == nullptr ) return unknown();
+  // Each thread caches the types of its connections, hence, no lock is required
+  static thread_local ConnectionTypeCache cache;
+  for ( size_t i = 0; i < ConnectionTypeCache::SIZE; ++i )
+  {
+    if ( cache.headers[i] == header ) return cache.types[i];
+  }
+
+  ConstPtr type = std::make_shared<BabelFishMessageType>( headerValue( *header, "md5sum" ),
+                                                          headerValue( *header, "type" ),
+                                                          headerValue( *header, "message_definition" ),
+                                                          headerValue( *header, "latching" ) == "1" );
+  // Replace the entry that was added first
+  cache.headers[cache.next] = header;
+  cache.types[cache.next] = type;
+  cache.next = (cache.next + 1) % ConnectionTypeCache::SIZE;
+  return type;
+}
+
+BabelFishMessageType::ConstPtr BabelFishMessageType::fromDescription( const MessageDescription::ConstPtr &description,
+                                                                      const std::string &server_md5sum )
+{
+  // Each thread caches the types of the descriptions it used most recently, hence, repeated lookups take no lock
+  static thread_local DescriptionTypeCache cache;
+  for ( size_t i = 0; i < DescriptionTypeCache::SIZE; ++i )
+  {
+    if ( cache.descriptions[i] == description && cache.types[i]->server_md5 == server_md5sum ) return cache.types[i];
+  }
+
+  ConstPtr type = internDescriptionType( description, server_md5sum );
+  // Replace the entry that was added first
+  cache.descriptions[cache.next] = description;
+  cache.types[cache.next] = type;
+  cache.next = (cache.next + 1) % DescriptionTypeCache::SIZE;
+  return type;
+}
+
 BabelFishMessage::BabelFishMessage()
-  : md5_( "*" ), server_md5_( "*" ), latched_( false ), buffer_( nullptr ), buffer_size_( 0 ), buffer_used_( 0 )
+  : type_( BabelFishMessageType::unknown()), buffer_( nullptr ), buffer_size_( 0 ), buffer_used_( 0 )
+    , buffer_shared_( false )
 {
 }
 
 BabelFishMessage::BabelFishMessage( const BabelFishMessage &other )
-  : md5_( other.md5_ ), server_md5_( other.server_md5_ ), datatype_( other.datatype_ )
-    , service_datatype_( other.service_datatype_ ), definition_( other.definition_ ), latched_( other.latched_ )
-    , buffer_size_( other.buffer_used_ ), buffer_used_( other.buffer_used_ )
+  : type_( other.type_ ), buffer_owner_( other.buffer_owner_ ), buffer_( other.buffer_ )
+    , buffer_size_( other.buffer_size_ ), buffer_used_( other.buffer_used_ ), buffer_shared_( other.buffer_ != nullptr )
 {
-  buffer_ = new uint8_t[other.buffer_used_];
-  std::memcpy( buffer_, other.buffer_, other.buffer_used_ );
+  // The buffer is shared and only copied if either message requests write access
+  if ( buffer_shared_ ) other.buffer_shared_ = true;
 }
 
 BabelFishMessage &BabelFishMessage::operator=( const BabelFishMessage &other )
 {
   if ( this == &other ) return *this;
 
-  md5_ = other.md5_;
-  server_md5_ = other.server_md5_;
-  datatype_ = other.datatype_;
-  service_datatype_ = other.service_datatype_;
-  definition_ = other.definition_;
-  latched_ = other.latched_;
-  allocate( other.buffer_used_ );
-  std::memcpy( buffer_, other.buffer_, other.buffer_used_ );
+  type_ = other.type_;
+  buffer_owner_ = other.buffer_owner_;
+  buffer_ = other.buffer_;
+  buffer_size_ = other.buffer_size_;
+  buffer_used_ = other.buffer_used_;
+  buffer_shared_ = other.buffer_ != nullptr;
+  if ( buffer_shared_ ) other.buffer_shared_ = true;
   return *this;
 }
 
-BabelFishMessage::~BabelFishMessage()
-{
-  delete[] buffer_;
-
-  buffer_ = nullptr;
-  buffer_size_ = 0;
-  buffer_used_ = 0;
-}
+BabelFishMessage::~BabelFishMessage() = default;
 
-const std::string &BabelFishMessage::md5Sum() const { return md5_; }
+const std::string &BabelFishMessage::md5Sum() const { return type_->md5; }
 
-const std::string &BabelFishMessage::dataType() const { return datatype_; }
+const std::string &BabelFishMessage::dataType() const { return type_->datatype; }
 
-const std::string &BabelFishMessage::__getServerMD5Sum() const { return server_md5_; }
+const std::string &BabelFishMessage::__getServerMD5Sum() const { return type_->server_md5; }
 
 const std::string &BabelFishMessage::__getServiceDatatype() const
 {
-  if ( !service_datatype_.empty()) return service_datatype_;
-
-  if ( strcmp( dataType().c_str() + dataType().length() - 7, "Request" ) == 0 )
-  {
-    service_datatype_ = dataType().substr( 0, dataType().length() - 7 );
-    return service_datatype_;
-  }
-  if ( strcmp( dataType().c_str() + dataType().length() - 8, "Response" ) == 0 )
-  {
-    service_datatype_ = dataType().substr( 0, dataType().length() - 8 );
-    return service_datatype_;
-  }
+  if ( !type_->service_datatype.empty()) return type_->service_datatype;
   throw ros_babel_fish::BabelFishMessageException(
     "Tried to get service datatype for message that is not a service request or response! Datatype: " + dataType());
 }
 
-const std::string &BabelFishMessage::definition() const { return definition_; }
+const std::string &BabelFishMessage::definition() const { return type_->definition; }
 
-bool BabelFishMessage::isLatched() const { return latched_; }
+bool BabelFishMessage::isLatched() const { return type_->latched; }
 
 void BabelFishMessage::morph( const std::string &md5sum, const std::string &datatype, const std::string &definition,
                               bool latched, const std::string &server_md5sum )
 {
-  md5_ = md5sum;
-  server_md5_ = server_md5sum;
-  datatype_ = datatype;
-  definition_ = definition;
-  latched_ = latched;
+  type_ = std::make_shared<BabelFishMessageType>( md5sum, datatype, definition, latched, server_md5sum );
 }
 
 void BabelFishMessage::morph( const MessageDescription::ConstPtr &description, const std::string &server_md5sum )
 {
-  md5_ = description->md5;
-  server_md5_ = server_md5sum;
-  datatype_ = description->datatype;
-  definition_ = description->message_definition;
-  latched_ = false;
+  type_ = BabelFishMessageType::fromDescription( description, server_md5sum );
+}
+
+void BabelFishMessage::morph( BabelFishMessageType::ConstPtr type )
+{
+  type_ = type == nullptr ? BabelFishMessageType::unknown() : std::move( type );
 }
 
 uint32_t BabelFishMessage::size() const
@@ -95,13 +220,62 @@ uint32_t BabelFishMessage::size() const
   return buffer_used_;
 }
 
+void BabelFishMessage::share( const boost::shared_array<uint8_t> &owner, const uint8_t *data, uint32_t size )
+{
+  buffer_owner_ = owner;
+  buffer_ = const_cast<uint8_t *>(data);
+  buffer_size_ = size;
+  buffer_used_ = size;
+  buffer_shared_ = true;
+}
+
+void BabelFishMessage::share( const ros::SerializedMessage &serialized_message )
+{
+  const uint8_t *start = serialized_message.message_start == nullptr ? serialized_message.buf.get()
+                                                                      : serialized_message.message_start;
+  size_t offset = start - serialized_message.buf.get();
+  if ( offset > serialized_message.num_bytes )
+    throw BabelFishMessageException( "Invalid serialized message! Message start is outside of the buffer." );
+  share( serialized_message.buf, start, static_cast<uint32_t>(serialized_message.num_bytes - offset));
+}
+
+bool BabelFishMessage::isBufferShared() const
+{
+  return buffer_shared_;
+}
+
+uint8_t *BabelFishMessage::buffer()
+{
+  if ( !isBufferShared()) return buffer_;
+  boost::shared_array<uint8_t> shared_owner = buffer_owner_;
+  const uint8_t *shared_buffer = buffer_;
+  allocate( buffer_used_ );
+  std::memcpy( buffer_, shared_buffer, buffer_used_ );
+  return buffer_;
+}
+
 void BabelFishMessage::allocate( size_t size )
+{
+  allocate( size, BufferPool::defaultPool());
+}
+
+void BabelFishMessage::allocate( size_t size, const BufferPool::Ptr &pool )
 {
   buffer_used_ = size;
   // Only reallocate if necessary
-  if ( buffer_size_ > size ) return;
-  delete[] buffer_;
-  buffer_ = new uint8_t[size];
-  buffer_size_ = size;
+  if ( buffer_size_ >= size && !isBufferShared()) return;
+  if ( pool == nullptr )
+  {
+    buffer_owner_.reset( new uint8_t[size] );
+    buffer_size_ = size;
+  }
+  else
+  {
+    size_t capacity;
+    buffer_owner_ = pool->acquire( size, capacity );
+    buffer_size_ = capacity;
+  }
+  buffer_ = buffer_owner_.get();
+  buffer_shared_ = false;
 }
 }
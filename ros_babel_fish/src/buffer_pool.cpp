@@ -0,0 +1,129 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/buffer_pool.h"
+
+namespace ros_babel_fish
+{
+
+namespace
+{
+BufferPool::Ptr &defaultPoolInstance()
+{
+  static BufferPool::Ptr pool = std::make_shared<BucketBufferPool>();
+  return pool;
+}
+
+size_t nextPowerOfTwo( size_t value )
+{
+  size_t result = 1;
+  while ( result < value ) result <<= 1;
+  return result;
+}
+}
+
+BufferPool::Ptr BufferPool::defaultPool()
+{
+  return std::atomic_load( &defaultPoolInstance());
+}
+
+void BufferPool::setDefaultPool( Ptr pool )
+{
+  std::atomic_store( &defaultPoolInstance(), std::move( pool ));
+}
+
+BucketBufferPool::BucketBufferPool( size_t min_buffer_size, size_t max_buffer_size, size_t max_retained_bytes,
+                                    size_t max_buffers_per_bucket )
+  : storage_( std::make_shared<Storage>()), min_buffer_size_( nextPowerOfTwo( min_buffer_size ))
+{
+  size_t bucket_count = 0;
+  for ( size_t bucket_size = min_buffer_size_; bucket_size <= max_buffer_size; bucket_size <<= 1 ) ++bucket_count;
+  storage_->buckets.resize( bucket_count );
+  storage_->max_retained_bytes = max_retained_bytes;
+  storage_->max_buffers_per_bucket = max_buffers_per_bucket;
+}
+
+BucketBufferPool::~BucketBufferPool() = default;
+
+boost::shared_array<uint8_t> BucketBufferPool::acquire( size_t size, size_t &capacity )
+{
+  size_t bucket = 0;
+  capacity = min_buffer_size_;
+  while ( capacity < size && bucket < storage_->buckets.size())
+  {
+    capacity <<= 1;
+    ++bucket;
+  }
+  if ( bucket >= storage_->buckets.size())
+  {
+    // Too large to be recycled
+    capacity = size;
+    return boost::shared_array<uint8_t>( new uint8_t[size] );
+  }
+
+  uint8_t *buffer = nullptr;
+  {
+    std::lock_guard<std::mutex> lock( storage_->mutex );
+    std::vector<uint8_t *> &free_buffers = storage_->buckets[bucket];
+    if ( !free_buffers.empty())
+    {
+      buffer = free_buffers.back();
+      free_buffers.pop_back();
+      storage_->retained_bytes -= capacity;
+    }
+  }
+  if ( buffer == nullptr ) buffer = new uint8_t[capacity];
+  return boost::shared_array<uint8_t>( buffer, Deleter{ storage_, bucket, capacity } );
+}
+
+size_t BucketBufferPool::retainedBytes() const
+{
+  std::lock_guard<std::mutex> lock( storage_->mutex );
+  return storage_->retained_bytes;
+}
+
+void BucketBufferPool::clear()
+{
+  std::lock_guard<std::mutex> lock( storage_->mutex );
+  for ( auto &free_buffers : storage_->buckets )
+  {
+    for ( uint8_t *buffer : free_buffers ) delete[] buffer;
+    free_buffers.clear();
+  }
+  storage_->retained_bytes = 0;
+}
+
+BucketBufferPool::Storage::~Storage()
+{
+  for ( auto &free_buffers : buckets )
+  {
+    for ( uint8_t *buffer : free_buffers ) delete[] buffer;
+  }
+}
+
+void BucketBufferPool::Storage::release( uint8_t *buffer, size_t bucket, size_t capacity )
+{
+  {
+    std::lock_guard<std::mutex> lock( mutex );
+    std::vector<uint8_t *> &free_buffers = buckets[bucket];
+    if ( free_buffers.size() < max_buffers_per_bucket && retained_bytes + capacity <= max_retained_bytes )
+    {
+      free_buffers.push_back( buffer );
+      retained_bytes += capacity;
+      return;
+    }
+  }
+  delete[] buffer;
+}
+
+void BucketBufferPool::Deleter::operator()( uint8_t *buffer ) const
+{
+  std::shared_ptr<Storage> locked_storage = storage.lock();
+  if ( locked_storage == nullptr )
+  {
+    delete[] buffer;
+    return;
+  }
+  locked_storage->release( buffer, bucket, capacity );
+}
+} // ros_babel_fish
@@ -0,0 +1,351 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/generation/decode_program.h"
+
+#include "ros_babel_fish/exceptions/babel_fish_exception.h"
+#include "ros_babel_fish/messages/array_message.h"
+#include "ros_babel_fish/messages/compound_message.h"
+#include "ros_babel_fish/messages/value_message.h"
+
+#include <limits>
+#include <memory>
+
+namespace ros_babel_fish
+{
+
+namespace
+{
+// The bounds of fixed size fields are checked once for the entire block, hence, the limit is only a formality
+constexpr size_t NO_LIMIT = std::numeric_limits<size_t>::max();
+
+template<typename T>
+Message *decodeFixedValue( const MessageTemplate &, const uint8_t *data, MessageArena *arena )
+{
+  size_t bytes_read = 0;
+  return ValueMessage<T>::fromStream( data, NO_LIMIT, bytes_read, arena );
+}
+
+template<typename T>
+Message *decodeFixedArray( const MessageTemplate &msg_template, const uint8_t *data, MessageArena *arena )
+{
+  size_t bytes_read = 0;
+  return ArrayMessage<T>::fromStream( msg_template.array.length, data, NO_LIMIT, bytes_read, arena );
+}
+
+template<typename T>
+Message *decodeVariableValue( const MessageTemplate::ConstPtr &, const uint8_t *stream, size_t stream_length,
+                              size_t &bytes_read, MessageArena *arena )
+{
+  return ValueMessage<T>::fromStream( stream, stream_length, bytes_read, arena );
+}
+
+template<typename T>
+Message *decodeVariableArray( const MessageTemplate::ConstPtr &msg_template, const uint8_t *stream,
+                              size_t stream_length, size_t &bytes_read, MessageArena *arena )
+{
+  return ArrayMessage<T>::fromStream( msg_template->array.length, stream, stream_length, bytes_read, arena );
+}
+
+Message *decodeCompoundArray( const MessageTemplate::ConstPtr &msg_template, const uint8_t *stream,
+                              size_t stream_length, size_t &bytes_read, MessageArena *arena )
+{
+  return CompoundArrayMessage::fromStream( msg_template->array.length, msg_template->array.element_template, stream,
+                                           stream_length, bytes_read, arena );
+}
+
+struct FieldDecoder
+{
+  //! Size of the field in bytes if it is fixed size, 0 otherwise.
+  size_t size;
+  //! Size of an array element in bytes if the elements are fixed size, 0 otherwise.
+  size_t element_size;
+  DecodeFixedFunction decode_fixed;
+  DecodeVariableFunction decode_variable;
+};
+
+template<typename T>
+FieldDecoder fixedValueDecoder( size_t size ) { return { size, 0, &decodeFixedValue<T>, nullptr }; }
+
+template<typename T>
+FieldDecoder arrayDecoder( ssize_t length, size_t element_size )
+{
+  if ( length < 0 ) return { 0, element_size, nullptr, &decodeVariableArray<T> };
+  return { length * element_size, element_size, &decodeFixedArray<T>, nullptr };
+}
+
+FieldDecoder valueDecoder( MessageType type )
+{
+  using namespace message_type_traits;
+  switch ( type )
+  {
+    case MessageTypes::Bool:
+      return fixedValueDecoder<value_type<MessageTypes::Bool>::value>( 1 );
+    case MessageTypes::UInt8:
+      return fixedValueDecoder<value_type<MessageTypes::UInt8>::value>( 1 );
+    case MessageTypes::UInt16:
+      return fixedValueDecoder<value_type<MessageTypes::UInt16>::value>( 2 );
+    case MessageTypes::UInt32:
+      return fixedValueDecoder<value_type<MessageTypes::UInt32>::value>( 4 );
+    case MessageTypes::UInt64:
+      return fixedValueDecoder<value_type<MessageTypes::UInt64>::value>( 8 );
+    case MessageTypes::Int8:
+      return fixedValueDecoder<value_type<MessageTypes::Int8>::value>( 1 );
+    case MessageTypes::Int16:
+      return fixedValueDecoder<value_type<MessageTypes::Int16>::value>( 2 );
+    case MessageTypes::Int32:
+      return fixedValueDecoder<value_type<MessageTypes::Int32>::value>( 4 );
+    case MessageTypes::Int64:
+      return fixedValueDecoder<value_type<MessageTypes::Int64>::value>( 8 );
+    case MessageTypes::Float32:
+      return fixedValueDecoder<value_type<MessageTypes::Float32>::value>( 4 );
+    case MessageTypes::Float64:
+      return fixedValueDecoder<value_type<MessageTypes::Float64>::value>( 8 );
+    case MessageTypes::Time:
+      return fixedValueDecoder<value_type<MessageTypes::Time>::value>( 8 );
+    case MessageTypes::Duration:
+      return fixedValueDecoder<value_type<MessageTypes::Duration>::value>( 8 );
+    case MessageTypes::String:
+      return { 0, 0, nullptr, &decodeVariableValue<value_type<MessageTypes::String>::value> };
+    case MessageTypes::Compound:
+    case MessageTypes::Array:
+    case MessageTypes::None:
+      break;
+  }
+  return { 0, 0, nullptr, nullptr };
+}
+
+FieldDecoder arrayDecoder( MessageType element_type, ssize_t length )
+{
+  using namespace message_type_traits;
+  switch ( element_type )
+  {
+    case MessageTypes::Bool:
+      return arrayDecoder<value_type<MessageTypes::Bool>::value>( length, 1 );
+    case MessageTypes::UInt8:
+      return arrayDecoder<value_type<MessageTypes::UInt8>::value>( length, 1 );
+    case MessageTypes::UInt16:
+      return arrayDecoder<value_type<MessageTypes::UInt16>::value>( length, 2 );
+    case MessageTypes::UInt32:
+      return arrayDecoder<value_type<MessageTypes::UInt32>::value>( length, 4 );
+    case MessageTypes::UInt64:
+      return arrayDecoder<value_type<MessageTypes::UInt64>::value>( length, 8 );
+    case MessageTypes::Int8:
+      return arrayDecoder<value_type<MessageTypes::Int8>::value>( length, 1 );
+    case MessageTypes::Int16:
+      return arrayDecoder<value_type<MessageTypes::Int16>::value>( length, 2 );
+    case MessageTypes::Int32:
+      return arrayDecoder<value_type<MessageTypes::Int32>::value>( length, 4 );
+    case MessageTypes::Int64:
+      return arrayDecoder<value_type<MessageTypes::Int64>::value>( length, 8 );
+    case MessageTypes::Float32:
+      return arrayDecoder<value_type<MessageTypes::Float32>::value>( length, 4 );
+    case MessageTypes::Float64:
+      return arrayDecoder<value_type<MessageTypes::Float64>::value>( length, 8 );
+    case MessageTypes::Time:
+      return arrayDecoder<value_type<MessageTypes::Time>::value>( length, 8 );
+    case MessageTypes::Duration:
+      return arrayDecoder<value_type<MessageTypes::Duration>::value>( length, 8 );
+    case MessageTypes::String:
+      // Strings are never fixed size, even in fixed length arrays
+      return { 0, 0, nullptr, &decodeVariableArray<value_type<MessageTypes::String>::value> };
+    case MessageTypes::Compound:
+      return { 0, 0, nullptr, &decodeCompoundArray };
+    case MessageTypes::Array:
+    case MessageTypes::None:
+      // These don't exist here
+      break;
+  }
+  return { 0, 0, nullptr, nullptr };
+}
+
+void checkBounds( size_t bytes_read, size_t stream_length )
+{
+  if ( bytes_read > stream_length )
+    throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
+}
+
+uint32_t readLength( const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+{
+  checkBounds( bytes_read + sizeof( uint32_t ), stream_length );
+  uint32_t length = *reinterpret_cast<const uint32_t *>(stream + bytes_read);
+  bytes_read += sizeof( uint32_t );
+  return length;
+}
+
+size_t arrayLength( const DecodeField &field, const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+{
+  ssize_t length = field.msg_template->array.length;
+  if ( length >= 0 ) return static_cast<size_t>(length);
+  return readLength( stream, stream_length, bytes_read );
+}
+
+void skipString( const DecodeField &, const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+{
+  bytes_read += readLength( stream, stream_length, bytes_read );
+  checkBounds( bytes_read, stream_length );
+}
+
+void skipArray( const DecodeField &field, const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+{
+  bytes_read += arrayLength( field, stream, stream_length, bytes_read ) * field.element_size;
+  checkBounds( bytes_read, stream_length );
+}
+
+void skipStringArray( const DecodeField &field, const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+{
+  size_t length = arrayLength( field, stream, stream_length, bytes_read );
+  for ( size_t i = 0; i < length; ++i )
+  {
+    skipString( field, stream, stream_length, bytes_read );
+  }
+}
+
+void skipCompound( const DecodeField &field, const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+{
+  skipMessage( *field.program, stream, stream_length, bytes_read );
+}
+
+void skipCompoundArray( const DecodeField &field, const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+{
+  size_t length = arrayLength( field, stream, stream_length, bytes_read );
+  if ( field.program->is_fixed_size )
+  {
+    bytes_read += length * field.program->fixed_size;
+    checkBounds( bytes_read, stream_length );
+    return;
+  }
+  for ( size_t i = 0; i < length; ++i )
+  {
+    skipMessage( *field.program, stream, stream_length, bytes_read );
+  }
+}
+
+void compileFields( const MessageTemplate &msg_template, DecodeProgram &program )
+{
+  for ( size_t i = 0; i < msg_template.compound.types.size(); ++i )
+  {
+    const MessageTemplate::ConstPtr &sub_template = msg_template.compound.types[i];
+    DecodeField field{ sub_template, false, 0, 0, nullptr, nullptr, nullptr, nullptr };
+    if ( sub_template->type == MessageTypes::Compound )
+    {
+      field.program = getDecodeProgram( *sub_template );
+      field.is_fixed_size = field.program->is_fixed_size;
+      field.fixed_size = field.program->fixed_size;
+      field.skip = &skipCompound;
+    }
+    else if ( sub_template->type == MessageTypes::Array &&
+              sub_template->array.element_type == MessageTypes::Compound )
+    {
+      field.program = getDecodeProgram( *sub_template->array.element_template );
+      field.is_fixed_size = sub_template->array.length >= 0 && field.program->is_fixed_size;
+      field.fixed_size = field.is_fixed_size ? sub_template->array.length * field.program->fixed_size : 0;
+      field.skip = &skipCompoundArray;
+      field.decode_variable = &decodeCompoundArray;
+    }
+    else
+    {
+      FieldDecoder decoder = sub_template->type == MessageTypes::Array
+                             ? arrayDecoder( sub_template->array.element_type, sub_template->array.length )
+                             : valueDecoder( sub_template->type );
+      // The fields have to match the names of the template, hence, fields of unknown type can not be skipped
+      if ( decoder.decode_fixed == nullptr && decoder.decode_variable == nullptr )
+        throw BabelFishException( "Can not compile decode program for field '" + msg_template.compound.names[i] +
+                                  "' of message '" + msg_template.compound.datatype + "' with unknown type!" );
+      field.is_fixed_size = decoder.decode_fixed != nullptr;
+      field.fixed_size = decoder.size;
+      field.element_size = decoder.element_size;
+      field.decode_fixed = decoder.decode_fixed;
+      field.decode_variable = decoder.decode_variable;
+      if ( sub_template->type == MessageTypes::String )
+        field.skip = &skipString;
+      else if ( sub_template->array.element_type == MessageTypes::String )
+        field.skip = &skipStringArray;
+      else
+        field.skip = &skipArray;
+    }
+    program.is_fixed_size = program.is_fixed_size && field.is_fixed_size;
+    program.fixed_size += field.fixed_size;
+    program.fields.push_back( std::move( field ));
+  }
+  if ( !program.is_fixed_size ) program.fixed_size = 0;
+}
+
+void compileCompound( const MessageTemplate &msg_template, std::vector<DecodeOperation> &operations,
+                      ssize_t &current_block )
+{
+  for ( auto &sub_template : msg_template.compound.types )
+  {
+    if ( sub_template->type == MessageTypes::Compound )
+    {
+      // Fixed size fields of nested messages are contiguous with the surrounding fields, hence, the block stays open
+      operations.push_back( { DecodeOperationTypes::BeginCompound, 0, 0, sub_template, nullptr, nullptr } );
+      compileCompound( *sub_template, operations, current_block );
+      operations.push_back( { DecodeOperationTypes::EndCompound, 0, 0, nullptr, nullptr, nullptr } );
+      continue;
+    }
+    FieldDecoder decoder = sub_template->type == MessageTypes::Array
+                           ? arrayDecoder( sub_template->array.element_type, sub_template->array.length )
+                           : valueDecoder( sub_template->type );
+    if ( decoder.decode_fixed != nullptr )
+    {
+      if ( current_block == -1 )
+      {
+        current_block = static_cast<ssize_t>(operations.size());
+        operations.push_back( { DecodeOperationTypes::FixedBlock, 0, 0, nullptr, nullptr, nullptr } );
+      }
+      size_t offset = operations[current_block].value;
+      operations[current_block].value += decoder.size;
+      operations.push_back( { DecodeOperationTypes::FixedField, offset, decoder.size, sub_template,
+                              decoder.decode_fixed, nullptr } );
+    }
+    else if ( decoder.decode_variable != nullptr )
+    {
+      current_block = -1;
+      operations.push_back( { DecodeOperationTypes::VariableField, 0, 0, sub_template, nullptr,
+                              decoder.decode_variable } );
+    }
+    // Fields of unknown type are rejected by compileFields
+  }
+}
+}
+
+DecodeProgram::ConstPtr getDecodeProgram( const MessageTemplate &msg_template )
+{
+  DecodeProgram::ConstPtr program = std::atomic_load( &msg_template.compound.decode_program );
+  if ( program != nullptr ) return program;
+  // Cache the program of manually created templates to avoid compiling it for every message
+  program = compileDecodeProgram( msg_template );
+  std::atomic_store( &msg_template.compound.decode_program, program );
+  return program;
+}
+
+DecodeProgram::ConstPtr compileDecodeProgram( const MessageTemplate &msg_template )
+{
+  if ( msg_template.type != MessageTypes::Compound )
+    throw BabelFishException( "Decode programs can only be compiled for compound message templates!" );
+  DecodeProgram::Ptr program = std::make_shared<DecodeProgram>();
+  ssize_t current_block = -1;
+  compileCompound( msg_template, program->operations, current_block );
+  compileFields( msg_template, *program );
+  return program;
+}
+
+void skipMessage( const DecodeProgram &program, const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+{
+  if ( program.is_fixed_size )
+  {
+    bytes_read += program.fixed_size;
+    checkBounds( bytes_read, stream_length );
+    return;
+  }
+  for ( auto &field : program.fields )
+  {
+    if ( field.is_fixed_size )
+      bytes_read += field.fixed_size;
+    else
+      field.skip( field, stream, stream_length, bytes_read );
+  }
+  checkBounds( bytes_read, stream_length );
+}
+} // ros_babel_fish
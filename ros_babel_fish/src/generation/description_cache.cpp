@@ -0,0 +1,461 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/generation/description_cache.h"
+
+#include <ros/console.h>
+
+#include <experimental/filesystem>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::experimental::filesystem;
+
+namespace ros_babel_fish
+{
+
+constexpr uint32_t DescriptionCache::VERSION;
+
+namespace
+{
+/*
+ * File format (native byte order, strings are prefixed with their length as uint32):
+ *   char[4] magic, uint32 version, uint32 byte order marker, uint32 message count, uint32 service count
+ *   Index: For each message and then for each service: string datatype, uint64 offset, uint64 size, uint64 checksum
+ *   Records: The entries at the offsets in the index
+ */
+const char MAGIC[4] = { 'R', 'B', 'F', 'C' };
+const uint32_t BYTE_ORDER_MARKER = 0x01020304;
+const size_t HEADER_SIZE = sizeof( MAGIC ) + 4 * sizeof( uint32_t );
+
+class Reader
+{
+public:
+  Reader( const uint8_t *data, size_t size ) : it_( data ), end_( data + size ) { }
+
+  template<typename T>
+  T read()
+  {
+    T result;
+    ensure( sizeof( T ));
+    std::memcpy( &result, it_, sizeof( T ));
+    it_ += sizeof( T );
+    return result;
+  }
+
+  void read( std::string &result )
+  {
+    auto length = read<uint32_t>();
+    ensure( length );
+    result.assign( reinterpret_cast<const char *>(it_), length );
+    it_ += length;
+  }
+
+  void read( std::vector<std::string> &result )
+  {
+    auto count = read<uint32_t>();
+    // Each string requires at least its length, this prevents huge allocations for corrupted files
+    ensure( static_cast<size_t>(count) * sizeof( uint32_t ));
+    result.resize( count );
+    for ( auto &entry : result ) read( entry );
+  }
+
+  void read( DescriptionCache::FileStamp &stamp )
+  {
+    stamp.modification_time = read<int64_t>();
+    stamp.size = read<uint64_t>();
+  }
+
+private:
+  void ensure( size_t size ) const
+  {
+    if ( size > static_cast<size_t>(end_ - it_)) throw std::out_of_range( "Description cache is corrupted!" );
+  }
+
+  const uint8_t *it_;
+  const uint8_t *end_;
+};
+
+class Writer
+{
+public:
+  explicit Writer( std::string &buffer ) : buffer_( buffer ) { }
+
+  template<typename T>
+  void write( const T &value )
+  {
+    buffer_.append( reinterpret_cast<const char *>(&value), sizeof( T ));
+  }
+
+  void write( const std::string &value )
+  {
+    write( static_cast<uint32_t>(value.length()));
+    buffer_.append( value );
+  }
+
+  void write( const std::vector<std::string> &values )
+  {
+    write( static_cast<uint32_t>(values.size()));
+    for ( auto &value : values ) write( value );
+  }
+
+  void write( const DescriptionCache::FileStamp &stamp )
+  {
+    write( stamp.modification_time );
+    write( stamp.size );
+  }
+
+private:
+  std::string &buffer_;
+};
+
+void readEntry( Reader &reader, DescriptionCache::MessageEntry &entry )
+{
+  reader.read( entry.datatype );
+  reader.read( entry.package );
+  reader.read( entry.md5 );
+  reader.read( entry.specification );
+  reader.read( entry.definition );
+  auto constant_count = reader.read<uint32_t>();
+  entry.constants.clear();
+  for ( uint32_t i = 0; i < constant_count; ++i )
+  {
+    entry.constants.emplace_back();
+    reader.read( entry.constants.back().type );
+    reader.read( entry.constants.back().name );
+    reader.read( entry.constants.back().val );
+  }
+  reader.read( entry.types );
+  reader.read( entry.names );
+  reader.read( entry.dependencies );
+  reader.read( entry.dependency_md5s );
+  reader.read( entry.source );
+  reader.read( entry.source_stamp );
+  if ( entry.types.size() != entry.names.size() || entry.dependencies.size() != entry.dependency_md5s.size())
+    throw std::out_of_range( "Description cache is corrupted!" );
+}
+
+void readEntry( Reader &reader, DescriptionCache::ServiceEntry &entry )
+{
+  reader.read( entry.datatype );
+  reader.read( entry.md5 );
+  reader.read( entry.specification );
+  reader.read( entry.source );
+  reader.read( entry.source_stamp );
+}
+
+void writeEntry( Writer &writer, const DescriptionCache::MessageEntry &entry )
+{
+  writer.write( entry.datatype );
+  writer.write( entry.package );
+  writer.write( entry.md5 );
+  writer.write( entry.specification );
+  writer.write( entry.definition );
+  writer.write( static_cast<uint32_t>(entry.constants.size()));
+  for ( auto &constant : entry.constants )
+  {
+    writer.write( constant.type );
+    writer.write( constant.name );
+    writer.write( constant.val );
+  }
+  writer.write( entry.types );
+  writer.write( entry.names );
+  writer.write( entry.dependencies );
+  writer.write( entry.dependency_md5s );
+  writer.write( entry.source );
+  writer.write( entry.source_stamp );
+}
+
+void writeEntry( Writer &writer, const DescriptionCache::ServiceEntry &entry )
+{
+  writer.write( entry.datatype );
+  writer.write( entry.md5 );
+  writer.write( entry.specification );
+  writer.write( entry.source );
+  writer.write( entry.source_stamp );
+}
+
+struct IndexEntry
+{
+  std::string datatype;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t checksum;
+};
+
+/*!
+ * Appends the added entries and the records of the mapped file that were not replaced to the records buffer.
+ * Existing records are copied without decoding them.
+ */
+template<typename Entry, typename Record>
+void collectRecords( const std::unordered_map<std::string, Entry> &added,
+                     const std::unordered_map<std::string, Record> &existing, const uint8_t *data,
+                     std::vector<IndexEntry> &index, std::string &records )
+{
+  Writer writer( records );
+  for ( auto &pair : added )
+  {
+    size_t offset = records.size();
+    writeEntry( writer, pair.second );
+    size_t size = records.size() - offset;
+    uint64_t checksum = DescriptionCache::checksum( reinterpret_cast<const uint8_t *>(records.data()) + offset, size );
+    index.push_back( { pair.first, offset, size, checksum } );
+  }
+  for ( auto &pair : existing )
+  {
+    if ( added.find( pair.first ) != added.end()) continue;
+    index.push_back( { pair.first, records.size(), pair.second.size, pair.second.checksum } );
+    records.append( reinterpret_cast<const char *>(data + pair.second.offset), pair.second.size );
+  }
+}
+}
+
+DescriptionCache::DescriptionCache( std::string path ) : path_( std::move( path ))
+{
+  load();
+}
+
+DescriptionCache::~DescriptionCache()
+{
+  unload();
+}
+
+void DescriptionCache::load()
+{
+  int fd = ::open( path_.c_str(), O_RDONLY );
+  if ( fd < 0 ) return;
+  struct stat file_stat{};
+  if ( ::fstat( fd, &file_stat ) != 0 || static_cast<size_t>(file_stat.st_size) < HEADER_SIZE )
+  {
+    ::close( fd );
+    return;
+  }
+  size_t size = file_stat.st_size;
+  void *mapping = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  // The mapping stays valid after the file is closed
+  ::close( fd );
+  if ( mapping == MAP_FAILED ) return;
+  data_ = static_cast<const uint8_t *>(mapping);
+  size_ = size;
+
+  try
+  {
+    Reader reader( data_, size_ );
+    char magic[sizeof( MAGIC )];
+    for ( char &c : magic ) c = reader.read<char>();
+    if ( std::memcmp( magic, MAGIC, sizeof( MAGIC )) != 0 || reader.read<uint32_t>() != VERSION ||
+         reader.read<uint32_t>() != BYTE_ORDER_MARKER )
+    {
+      ROS_DEBUG_NAMED( "RosBabelFish", "Ignoring description cache '%s' with different version.", path_.c_str());
+      unload();
+      return;
+    }
+    auto message_count = reader.read<uint32_t>();
+    auto service_count = reader.read<uint32_t>();
+    std::string datatype;
+    for ( uint32_t i = 0; i < message_count + service_count; ++i )
+    {
+      reader.read( datatype );
+      auto offset = reader.read<uint64_t>();
+      auto record_size = reader.read<uint64_t>();
+      auto record_checksum = reader.read<uint64_t>();
+      if ( offset > size_ || record_size > size_ - offset )
+        throw std::out_of_range( "Description cache is corrupted!" );
+      auto &records = i < message_count ? message_records_ : service_records_;
+      records.insert(
+        { datatype, Record{ static_cast<size_t>(offset), static_cast<size_t>(record_size), record_checksum }} );
+    }
+  }
+  catch ( std::out_of_range & )
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Ignoring corrupted description cache '%s'.", path_.c_str());
+    unload();
+  }
+}
+
+void DescriptionCache::unload()
+{
+  if ( data_ != nullptr ) ::munmap( const_cast<uint8_t *>(data_), size_ );
+  data_ = nullptr;
+  size_ = 0;
+  message_records_.clear();
+  service_records_.clear();
+}
+
+bool DescriptionCache::findMessage( const std::string &datatype, MessageEntry &entry ) const
+{
+  auto added = added_messages_.find( datatype );
+  if ( added != added_messages_.end())
+  {
+    entry = added->second;
+    return true;
+  }
+  auto it = message_records_.find( datatype );
+  if ( it == message_records_.end()) return false;
+  try
+  {
+    const uint8_t *record = data_ + it->second.offset;
+    if ( checksum( record, it->second.size ) != it->second.checksum )
+      throw std::out_of_range( "Description cache is corrupted!" );
+    Reader reader( record, it->second.size );
+    readEntry( reader, entry );
+  }
+  catch ( std::out_of_range & )
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Corrupted description cache entry for '%s'.", datatype.c_str());
+    return false;
+  }
+  return entry.datatype == datatype;
+}
+
+bool DescriptionCache::findService( const std::string &datatype, ServiceEntry &entry ) const
+{
+  auto added = added_services_.find( datatype );
+  if ( added != added_services_.end())
+  {
+    entry = added->second;
+    return true;
+  }
+  auto it = service_records_.find( datatype );
+  if ( it == service_records_.end()) return false;
+  try
+  {
+    const uint8_t *record = data_ + it->second.offset;
+    if ( checksum( record, it->second.size ) != it->second.checksum )
+      throw std::out_of_range( "Description cache is corrupted!" );
+    Reader reader( record, it->second.size );
+    readEntry( reader, entry );
+  }
+  catch ( std::out_of_range & )
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Corrupted description cache entry for '%s'.", datatype.c_str());
+    return false;
+  }
+  return entry.datatype == datatype;
+}
+
+bool DescriptionCache::empty() const
+{
+  return message_records_.empty() && service_records_.empty() && added_messages_.empty() && added_services_.empty();
+}
+
+void DescriptionCache::storeMessage( MessageEntry entry )
+{
+  std::string datatype = entry.datatype;
+  added_messages_[datatype] = std::move( entry );
+}
+
+void DescriptionCache::storeService( ServiceEntry entry )
+{
+  std::string datatype = entry.datatype;
+  added_services_[datatype] = std::move( entry );
+}
+
+bool DescriptionCache::save()
+{
+  if ( added_messages_.empty() && added_services_.empty()) return true;
+
+  std::vector<IndexEntry> message_index, service_index;
+  std::string records;
+  collectRecords( added_messages_, message_records_, data_, message_index, records );
+  collectRecords( added_services_, service_records_, data_, service_index, records );
+
+  size_t index_size = 0;
+  for ( auto *index : { &message_index, &service_index } )
+  {
+    for ( auto &entry : *index ) index_size += sizeof( uint32_t ) + entry.datatype.length() + 3 * sizeof( uint64_t );
+  }
+  std::string buffer;
+  buffer.reserve( HEADER_SIZE + index_size + records.size());
+  Writer writer( buffer );
+  buffer.append( MAGIC, sizeof( MAGIC ));
+  writer.write( VERSION );
+  writer.write( BYTE_ORDER_MARKER );
+  writer.write( static_cast<uint32_t>(message_index.size()));
+  writer.write( static_cast<uint32_t>(service_index.size()));
+  const uint64_t records_offset = HEADER_SIZE + index_size;
+  for ( auto *index : { &message_index, &service_index } )
+  {
+    for ( auto &entry : *index )
+    {
+      writer.write( entry.datatype );
+      writer.write( static_cast<uint64_t>(records_offset + entry.offset));
+      writer.write( entry.size );
+      writer.write( entry.checksum );
+    }
+  }
+  buffer += records;
+
+  // Write to a temporary file and rename it to replace the cache atomically
+  std::string tmp_path = path_ + ".tmp" + std::to_string( ::getpid());
+  try
+  {
+    fs::path parent = fs::path( path_ ).parent_path();
+    if ( !parent.empty()) fs::create_directories( parent );
+    std::ofstream output( tmp_path, std::ios::binary | std::ios::trunc );
+    output.write( buffer.data(), buffer.size());
+    output.close();
+    if ( !output ) throw std::runtime_error( "Failed to write file." );
+  }
+  catch ( std::exception &ex )
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Failed to write description cache '%s': %s", path_.c_str(), ex.what());
+    std::remove( tmp_path.c_str());
+    return false;
+  }
+  if ( std::rename( tmp_path.c_str(), path_.c_str()) != 0 )
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Failed to replace description cache '%s'.", path_.c_str());
+    std::remove( tmp_path.c_str());
+    return false;
+  }
+  unload();
+  added_messages_.clear();
+  added_services_.clear();
+  load();
+  return true;
+}
+
+uint64_t DescriptionCache::checksum( const uint8_t *data, size_t size )
+{
+  // 64 bit FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for ( size_t i = 0; i < size; ++i )
+  {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::string DescriptionCache::defaultPath()
+{
+  const char *ros_home = std::getenv( "ROS_HOME" );
+  if ( ros_home != nullptr ) return (fs::path( ros_home ) / "babel_fish_description_cache").string();
+  const char *home = std::getenv( "HOME" );
+  if ( home != nullptr ) return (fs::path( home ) / ".ros" / "babel_fish_description_cache").string();
+  return {};
+}
+
+bool DescriptionCache::getFileStamp( const std::string &path, FileStamp &stamp )
+{
+  std::error_code ec;
+  auto modification_time = fs::last_write_time( path, ec );
+  if ( ec ) return false;
+  auto size = fs::file_size( path, ec );
+  if ( ec ) return false;
+  stamp.modification_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    modification_time.time_since_epoch()).count();
+  stamp.size = size;
+  return true;
+}
+}
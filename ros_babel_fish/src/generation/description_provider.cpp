@@ -2,10 +2,10 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "ros_babel_fish/generation/description_provider.h"
+#include "ros_babel_fish/generation/internal/message_spec_parser.h"
 #include "ros_babel_fish/message_types.h"
 
 #include <openssl/md5.h>
-#include <regex>
 #include <ros_babel_fish/generation/message_template.h>
 
 namespace ros_babel_fish
@@ -21,6 +21,82 @@ std::string md5ToString( const unsigned char md5[MD5_DIGEST_LENGTH] )
     md5string << std::setw( 2 ) << (int) md5[i];
   return md5string.str();
 }
+
+/*!
+ * Splits a full message definition into the specification of the message and the specifications of the messages it
+ * depends on which are separated by a line of '=' and start with a line containing their type, e.g., MSG: pkg/Type
+ * @param blocks Receives the type and specification of each message starting with the given type.
+ */
+void splitDefinition( const std::string &type, const std::string &definition,
+                      std::vector<std::pair<std::string, std::string>> &blocks )
+{
+  std::string::size_type end = definition.find( "\n===" );
+  blocks.emplace_back( type, definition.substr( 0, end ));
+  if ( end == std::string::npos ) return;
+  std::string package = type.substr( 0, type.find( '/' ));
+  std::string::size_type start = definition.find( '\n', end + 3 );
+  if ( start == std::string::npos ) return;
+  ++start;
+  std::string buffer;
+  buffer.reserve( 2048 );
+  bool msg_line = true;
+  while ( true )
+  {
+    end = definition.find( '\n', start );
+    if ( definition.compare( start, 3, "===" ) == 0 )
+    {
+      if ( !buffer.empty()) buffer.pop_back();
+      if ( blocks.size() > 1 ) blocks.back().second = buffer;
+      buffer.clear();
+      if ( end == std::string::npos ) return;
+      start = end + 1;
+      msg_line = true;
+      continue;
+    }
+
+    if ( msg_line )
+    {
+      start += 5; // Skip "MSG: "
+      std::string msg_type = start < definition.length() ? definition.substr( start, end - start ) : std::string();
+      if ( msg_type == "Header" ) msg_type = "std_msgs/Header";
+      if ( msg_type.find( '/' ) == std::string::npos ) msg_type.insert( 0, package + '/' );
+      blocks.emplace_back( msg_type, std::string());
+      if ( end == std::string::npos ) return;
+      start = end + 1;
+      msg_line = false;
+      continue;
+    }
+
+    if ( end == std::string::npos )
+    {
+      buffer += definition.substr( start );
+      break;
+    }
+    buffer += definition.substr( start, end - start + 1 );
+    start = end + 1;
+  }
+  if ( blocks.size() > 1 ) blocks.back().second = buffer;
+}
+
+/*!
+ * Makes the types of a definition take precedence over registered types with the same name while the definition is
+ * resolved and restores the previous state afterwards.
+ */
+class DefinitionScope
+{
+public:
+  explicit DefinitionScope( std::unordered_map<std::string, std::string> &definition_md5s )
+    : definition_md5s_( definition_md5s )
+  {
+    previous_md5s_.swap( definition_md5s_ );
+  }
+
+  ~DefinitionScope() { definition_md5s_.swap( previous_md5s_ ); }
+
+private:
+  std::unordered_map<std::string, std::string> &definition_md5s_;
+  std::unordered_map<std::string, std::string> previous_md5s_;
+};
 }
 
 DescriptionProvider::DescriptionProvider()
@@ -33,12 +109,43 @@ bool DescriptionProvider::isBuiltIn( const std::string &type ) const
   return builtin_types_.find( type ) != builtin_types_.end();
 }
 
-MessageDescription::ConstPtr DescriptionProvider::getMessageDescription( const std::string &type )
+MessageDescription::ConstPtr DescriptionProvider::findMessageDescription( const std::string &type ) const
 {
-  // Check cache
+  boost::shared_lock<boost::shared_mutex> lock( cache_mutex_ );
   auto it = message_descriptions_.find( type );
   if ( it != message_descriptions_.end()) return it->second;
+  return nullptr;
+}
 
+MessageDescription::ConstPtr DescriptionProvider::findMessageDescription( const std::string &type,
+                                                                         const std::string &md5 ) const
+{
+  boost::shared_lock<boost::shared_mutex> lock( cache_mutex_ );
+  auto it = message_versions_.find( type );
+  if ( it == message_versions_.end()) return nullptr;
+  auto version_it = it->second.find( md5 );
+  if ( version_it != it->second.end()) return version_it->second;
+  return nullptr;
+}
+
+ServiceDescription::ConstPtr DescriptionProvider::findServiceDescription( const std::string &type ) const
+{
+  boost::shared_lock<boost::shared_mutex> lock( cache_mutex_ );
+  auto it = service_descriptions_.find( type );
+  if ( it != service_descriptions_.end()) return it->second;
+  return nullptr;
+}
+
+MessageDescription::ConstPtr DescriptionProvider::getMessageDescription( const std::string &type )
+{
+  // Check cache
+  MessageDescription::ConstPtr description = findMessageDescription( type );
+  if ( description != nullptr ) return description;
+
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+  // Check again since another thread may have resolved the type while we were waiting for the lock
+  description = findMessageDescription( type );
+  if ( description != nullptr ) return description;
   return getMessageDescriptionImpl( type );
 }
 
@@ -52,155 +159,173 @@ DescriptionProvider::getMessageDescription( const std::string &type, const std::
                                             const std::string &definition )
 {
   // Check cache
-  auto it = message_descriptions_.find( type );
-  if ( it != message_descriptions_.end())
-  {
-    if ( it->second->md5 != md5 )
-    {
-      throw BabelFishException( "Message '" + type +"' found but MD5 sum differed!\n" +
-                                md5 + " (provided) vs " + it->second->md5 + " (cached)." );
-    }
-    return it->second;
-  }
-
-  return getMessageDescriptionImpl( type, definition );
+  MessageDescription::ConstPtr description = findMessageDescription( type, md5 );
+  if ( description != nullptr ) return description;
+
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+  description = findMessageDescription( type, md5 );
+  if ( description != nullptr ) return description;
+  description = getMessageDescriptionImpl( type, md5, definition );
+  if ( description != nullptr && description->md5 != md5 ) addMD5Alias( type, md5, description );
+  return description;
 }
 
 ServiceDescription::ConstPtr DescriptionProvider::getServiceDescription( const std::string &type )
 {
   // Check cache
-  auto it = service_descriptions_.find( type );
-  if ( it != service_descriptions_.end()) return it->second;
+  ServiceDescription::ConstPtr description = findServiceDescription( type );
+  if ( description != nullptr ) return description;
 
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+  description = findServiceDescription( type );
+  if ( description != nullptr ) return description;
   return getServiceDescriptionImpl( type );
 }
 
 MessageDescription::ConstPtr DescriptionProvider::getMessageDescriptionImpl( const std::string &type,
                                                                              const std::string &definition )
 {
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
   // This will split the message definition and register all of the embedded message types, so look ups can be avoided
-  std::string::size_type pos_separator = type.find( '/' );
-  std::string package = type.substr( 0, pos_separator );
+  return registerDefinition( type, definition );
+}
 
-  std::string::size_type start = definition.find( "\n===" );
-  std::string::size_type end;
-  if ( start != std::string::npos )
+MessageDescription::ConstPtr DescriptionProvider::getMessageDescriptionImpl( const std::string &type,
+                                                                             const std::string &,
+                                                                             const std::string &definition )
+{
+  return getMessageDescriptionImpl( type, definition );
+}
+
+std::vector<MessageDescription::ConstPtr>
+DescriptionProvider::registerDefinitions( const std::vector<MessageDefinition> &definitions )
+{
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+  std::vector<MessageDescription::ConstPtr> result;
+  result.reserve( definitions.size());
+  for ( const auto &definition : definitions )
   {
-    // Message contains dependencies, collect specs and dependencies for each spec
-    std::vector<std::string> types;
-    std::vector<std::string> specs;
-    std::vector<std::vector<std::string>> dependencies;
-
-    static std::regex field_type_regex( R"(^\s*(\w+(?:/\w+)?))" );
-    std::smatch match;
-    std::string buffer;
-    std::string curr_package;
-    buffer.reserve( 2048 );
-    start = definition.find( '\n', start + 3 ) + 1;
-    dependencies.emplace_back();
-    bool msg_line = true;
-    while ( true )
+    MessageDescription::ConstPtr description = findMessageDescription( definition.datatype, definition.md5 );
+    if ( description == nullptr )
     {
-      end = definition.find( '\n', start );
-      if ( definition[start] == '=' && definition[start + 1] == '=' && definition[start + 2] == '=' )
+      try
       {
-        if ( !buffer.empty()) buffer.pop_back();
-        specs.push_back( buffer );
-        buffer.clear();
-        dependencies.emplace_back();
-        start = end + 1;
-        msg_line = true;
-        continue;
+        description = getMessageDescriptionImpl( definition.datatype, definition.md5, definition.definition );
+        if ( description != nullptr && description->md5 != definition.md5 )
+          addMD5Alias( definition.datatype, definition.md5, description );
       }
-
-      if ( msg_line )
+      catch ( BabelFishException &ex )
       {
-        start += 5;
-        std::string msg_type = definition.substr( start, end - start );
-        if ( msg_type == "Header" ) msg_type = "std_msgs/Header";
-        if ( msg_type.find( '/' ) == std::string::npos ) msg_type.insert( 0, package + '/' );
-        curr_package = msg_type.substr( 0, msg_type.find( '/' ));
-        types.push_back( msg_type );
-        start = end + 1;
-        msg_line = false;
-        continue;
+        ROS_WARN_NAMED( "RosBabelFish", "Failed to register message '%s': %s", definition.datatype.c_str(), ex.what());
       }
+    }
+    result.push_back( description );
+  }
+  return result;
+}
 
-      std::string::const_iterator first = definition.begin() + start;
-      std::string::const_iterator last = end == std::string::npos ? definition.end() : definition.begin() + end;
-      if ( std::regex_search( first, last, match, field_type_regex ) && match.size() == 2 )
-      {
-        std::string field_type = match.str( 1 );
-        if ( !isBuiltIn( field_type ))
-        {
-          if ( field_type == "Header" ) field_type = "std_msgs/Header";
-          if ( field_type.find( '/' ) == std::string::npos ) field_type.insert( 0, curr_package + '/' );
-          bool found = false;
-          for ( auto &dep : dependencies[specs.size()] )
-          {
-            if ( dep != field_type ) continue;
-            found = true;
-            break;
-          }
-          if ( !found )
-          {
-            dependencies[specs.size()].push_back( field_type );
-          }
-        }
-      }
+MessageDescription::ConstPtr DescriptionProvider::registerDefinition( const std::string &type,
+                                                                      const std::string &definition )
+{
+  // The definition may contain other versions of its dependencies than those that were registered before
+  DefinitionScope scope( definition_md5s_ );
+
+  std::vector<std::pair<std::string, std::string>> blocks;
+  splitDefinition( type, definition, blocks );
+  // Specs contained in multiple definitions, e.g., common dependencies, are only parsed once
+  std::vector<ParsedSpec *> parsed( blocks.size());
+  for ( size_t i = 0; i < blocks.size(); ++i )
+  {
+    auto &specs = parsed_specs_[blocks[i].first];
+    auto it = specs.find( blocks[i].second );
+    if ( it == specs.end())
+    {
+      const std::string &block_type = blocks[i].first;
+      ParsedSpec parsed_spec;
+      parsed_spec.spec = parseSpec( block_type, block_type.substr( 0, block_type.find( '/' )), blocks[i].second );
+      it = specs.insert( { blocks[i].second, std::move( parsed_spec ) } ).first;
+    }
+    parsed[i] = &it->second;
+  }
 
-      if ( end == std::string::npos )
+  // Register all message dependencies, each after the dependencies it contains
+  std::vector<bool> registered( blocks.size(), false );
+  bool new_registered = true;
+  while ( new_registered )
+  {
+    new_registered = false;
+    for ( size_t i = 1; i < blocks.size(); ++i )
+    {
+      if ( registered[i] ) continue;
+      // Check if all dependencies that are contained in the definition have been registered
+      bool all_deps = true;
+      for ( auto &dep : parsed[i]->spec.dependencies )
       {
-        buffer += definition.substr( start );
+        if ( definition_md5s_.find( dep ) != definition_md5s_.end()) continue;
+        if ( std::find_if( blocks.begin() + 1, blocks.end(), [&dep]( const std::pair<std::string, std::string> &block )
+        { return block.first == dep; } ) == blocks.end())
+          continue;
+        all_deps = false;
         break;
       }
-      buffer += definition.substr( start, end - start + 1 );
-      start = end + 1;
+      if ( !all_deps ) continue;
+      new_registered = true;
+      registered[i] = true;
+      registerParsedSpec( *parsed[i] );
     }
-    specs.push_back( buffer );
+  }
+
+  // Now register the message
+  MessageDescription::ConstPtr description = registerParsedSpec( *parsed[0] );
+  if ( description == nullptr )
+    ROS_DEBUG_NAMED( "RosBabelFish", "Failed to register message '%s'!", type.c_str());
+  return description;
+}
 
-    // Register all message dependencies
-    bool registered[specs.size()];
-    std::fill_n( registered, specs.size(), false );
-    bool new_registered = true;
-    while ( new_registered )
+MessageDescription::ConstPtr DescriptionProvider::registerParsedSpec( ParsedSpec &parsed )
+{
+  // The MD5 sum depends on the versions of the dependencies, hence, each combination is registered as its own version
+  loadDependencies( parsed.spec );
+  std::string dependency_md5s;
+  for ( auto &dependency : parsed.spec.dependencies )
+  {
+    const MessageSpec *dependency_spec = findMessageSpec( dependency );
+    if ( dependency_spec == nullptr )
     {
-      new_registered = false;
-      for ( size_t i = 0; i < specs.size(); ++i )
-      {
-        if ( registered[i] ) continue;
-        new_registered = true;
-        registered[i] = true;
-        if ( msg_specs_.find( types[i] ) != msg_specs_.end()) continue;
-        // Check if all dependencies have been registered
-        bool all_deps = true;
-        for ( auto &dep : dependencies[i] )
-        {
-          if ( msg_specs_.find( dep ) != msg_specs_.end()) continue;
-          all_deps = false;
-          registered[i] = false;
-        }
-        if ( !all_deps ) continue;
-        MessageSpec spec = createSpec( types[i], types[i].substr( 0, types[i].find( '/' )), specs[i] );
-        if ( spec.md5.empty())
-        {
-          ROS_DEBUG_NAMED( "RosBabelFish", "Failed to compute MD5 for message '%s'!", type.c_str());
-          return nullptr;
-        }
-        registerMessage( spec, computeFullText( spec ));
-      }
+      ROS_DEBUG_NAMED( "RosBabelFish", "Failed to compute MD5 for message '%s'!", parsed.spec.name.c_str());
+      return nullptr;
     }
+    dependency_md5s += dependency_spec->md5;
+  }
+  auto it = parsed.md5s.find( dependency_md5s );
+  if ( it != parsed.md5s.end())
+  {
+    definition_md5s_[parsed.spec.name] = it->second;
+    return findMessageDescription( parsed.spec.name, it->second );
   }
 
-  // Now register the message
-  end = definition.find( "\n===" );
-  MessageSpec spec = createSpec( type, package, definition.substr( 0, end ));
+  MessageSpec spec = parsed.spec;
+  spec.md5 = computeMD5( spec );
   if ( spec.md5.empty())
   {
-    ROS_DEBUG_NAMED( "RosBabelFish", "Failed to compute MD5 for message '%s'!", type.c_str());
+    ROS_DEBUG_NAMED( "RosBabelFish", "Failed to compute MD5 for message '%s'!", spec.name.c_str());
     return nullptr;
   }
-  return registerMessage( spec, computeFullText( spec ));
+  MessageDescription::ConstPtr description = registerMessage( spec, computeFullText( spec ));
+  if ( description == nullptr ) return nullptr;
+  parsed.md5s.insert( { dependency_md5s, spec.md5 } );
+  definition_md5s_[spec.name] = spec.md5;
+  return description;
+}
+
+void DescriptionProvider::addMD5Alias( const std::string &type, const std::string &md5,
+                                       const MessageDescription::ConstPtr &description )
+{
+  ROS_WARN_NAMED( "RosBabelFish", "Computed MD5 for message '%s' differed from provided!\n%s (provided) vs %s (computed).",
+                  type.c_str(), md5.c_str(), description->md5.c_str());
+  // Remember the description for the provided MD5 sum, so the definition is not resolved again on the next look up
+  boost::unique_lock<boost::shared_mutex> cache_lock( cache_mutex_ );
+  message_versions_[type].insert( { md5, description } );
 }
 
 MessageDescription::ConstPtr DescriptionProvider::getMessageDescriptionImpl( const IBabelFishMessage &msg )
@@ -213,6 +338,7 @@ MessageTemplate::Ptr DescriptionProvider::createTemplate( const MessageSpec &spe
   MessageTemplate::Ptr msg_template = std::make_shared<MessageTemplate>();
   msg_template->type = MessageTypes::Compound;
   msg_template->compound.datatype = spec.name;
+  msg_template->compound.md5 = spec.md5;
   // Initialize constants
   for ( auto &constant : spec.constants )
   {
@@ -279,6 +405,11 @@ MessageTemplate::Ptr DescriptionProvider::createTemplate( const MessageSpec &spe
     msg_template->constants.insert( { constant.name, value } );
   }
   msg_template->compound.names = spec.names;
+  msg_template->compound.name_indices.reserve( spec.names.size());
+  for ( size_t i = 0; i < spec.names.size(); ++i )
+  {
+    msg_template->compound.name_indices.insert( { spec.names[i], i } );
+  }
   for ( size_t i = 0; i < spec.types.size(); ++i )
   {
     std::string type = spec.types[i];
@@ -294,7 +425,7 @@ MessageTemplate::Ptr DescriptionProvider::createTemplate( const MessageSpec &spe
       std::string package = spec.package;
       type_name = package.append( "/" ).append( type_name );
     }
-    MessageDescription::ConstPtr sub_message_description = getMessageDescription( type_name );
+    MessageDescription::ConstPtr sub_message_description = getDependencyDescription( type_name );
     if ( sub_message_description == nullptr ) return nullptr;
     MessageTemplate::ConstPtr sub_template = sub_message_description->message_template;
     // Check if the declared type is an array by checking if the type contains an array specifier
@@ -316,14 +447,21 @@ MessageTemplate::Ptr DescriptionProvider::createTemplate( const MessageSpec &spe
       msg_template->compound.types.push_back( array_template );
     }
   }
+  msg_template->compound.decode_program = compileDecodeProgram( *msg_template );
   return msg_template;
 }
 
 MessageDescription::ConstPtr DescriptionProvider::registerMessage( const DescriptionProvider::MessageSpec &spec,
                                                                    const std::string &definition )
 {
-  auto it = message_descriptions_.find( spec.name );
-  if ( it != message_descriptions_.end()) return it->second;
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+  // Reading without the cache_mutex_ is safe since all writers hold the resolve_mutex_
+  auto it = message_versions_.find( spec.name );
+  if ( it != message_versions_.end())
+  {
+    auto version_it = it->second.find( spec.md5 );
+    if ( version_it != it->second.end()) return version_it->second;
+  }
   MessageDescription::Ptr description = std::make_shared<MessageDescription>();
   description->datatype = spec.name;
   description->message_definition = definition;
@@ -333,14 +471,29 @@ MessageDescription::ConstPtr DescriptionProvider::registerMessage( const Descrip
   description->message_template = createTemplate( spec );
   if ( description->message_template == nullptr ) return nullptr;
 
-  msg_specs_.insert( { spec.name, spec } );
+  msg_specs_[spec.name].insert( { spec.md5, spec } );
+  boost::unique_lock<boost::shared_mutex> cache_lock( cache_mutex_ );
+  message_versions_[spec.name].insert( { spec.md5, description } );
+  // Only the first version of a type is returned by look ups without MD5 sum
   message_descriptions_.insert( { spec.name, description } );
   return description;
 }
 
+MessageDescription::ConstPtr DescriptionProvider::registerMessage( const MessageSpec &spec,
+                                                                   const std::string &definition,
+                                                                   const std::vector<std::string> &dependency_md5s )
+{
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+  DefinitionScope scope( definition_md5s_ );
+  for ( size_t i = 0; i < spec.dependencies.size() && i < dependency_md5s.size(); ++i )
+    definition_md5s_[spec.dependencies[i]] = dependency_md5s[i];
+  return registerMessage( spec, definition );
+}
+
 MessageDescription::ConstPtr DescriptionProvider::registerMessage( const std::string &type,
                                                                    const std::string &specification )
 {
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
   std::string::size_type pos_separator = type.find( '/' );
   std::string package = type.substr( 0, pos_separator );
   if ( type == "Header" ) package = "std_msgs";
@@ -358,6 +511,7 @@ MessageDescription::ConstPtr DescriptionProvider::registerMessage( const std::st
                                                                    const std::string &md5,
                                                                    const std::string &specification )
 {
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
   std::string::size_type pos_separator = type.find( '/' );
   std::string package = type.substr( 0, pos_separator );
   if ( type == "Header" ) package = "std_msgs";
@@ -382,6 +536,7 @@ ServiceDescription::ConstPtr DescriptionProvider::registerService( const std::st
                                                                    const DescriptionProvider::MessageSpec &resp_spec,
                                                                    const std::string &resp_definition )
 {
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
   auto it = service_descriptions_.find( type );
   if ( it != service_descriptions_.end()) return it->second;
   ServiceDescription::Ptr description = std::make_shared<ServiceDescription>();
@@ -390,9 +545,20 @@ ServiceDescription::ConstPtr DescriptionProvider::registerService( const std::st
   description->specification = specification;
 
   description->request = registerMessage( req_spec, req_definition );
+  if ( description->request == nullptr )
+  {
+    ROS_DEBUG_NAMED( "RosBabelFish", "Failed to register request of service '%s'!", type.c_str());
+    return nullptr;
+  }
 
   description->response = registerMessage( resp_spec, resp_definition );
+  if ( description->response == nullptr )
+  {
+    ROS_DEBUG_NAMED( "RosBabelFish", "Failed to register response of service '%s'!", type.c_str());
+    return nullptr;
+  }
 
+  boost::unique_lock<boost::shared_mutex> cache_lock( cache_mutex_ );
   service_descriptions_.insert( { type, description } );
   return description;
 }
@@ -402,16 +568,23 @@ ServiceDescription::ConstPtr DescriptionProvider::registerService( const std::st
                                                                    const std::string &req_specification,
                                                                    const std::string &resp_specification )
 {
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
   std::string::size_type pos_separator = type.find( '/' );
   std::string package = type.substr( 0, pos_separator );
   MessageSpec request_spec = createSpec( type + "Request", package, req_specification );
   MessageSpec response_spec = createSpec( type + "Response", package, resp_specification );
+  if ( request_spec.md5.empty() || response_spec.md5.empty())
+  {
+    ROS_DEBUG_NAMED( "RosBabelFish", "Failed to compute MD5 for service '%s'!", type.c_str());
+    return nullptr;
+  }
 
   MD5_CTX md5_ctx;
   MD5_Init( &md5_ctx );
-  std::string md5_text = computeMD5Text( request_spec );
+  std::string md5_text;
+  computeMD5Text( request_spec, md5_text );
   MD5_Update( &md5_ctx, md5_text.data(), md5_text.length());
-  md5_text = computeMD5Text( response_spec );
+  computeMD5Text( response_spec, md5_text );
   MD5_Update( &md5_ctx, md5_text.data(), md5_text.length());
 
   unsigned char md5_digest[MD5_DIGEST_LENGTH];
@@ -422,41 +595,41 @@ ServiceDescription::ConstPtr DescriptionProvider::registerService( const std::st
 
 DescriptionProvider::MessageSpec DescriptionProvider::createSpec( const std::string &type, const std::string &package,
                                                                   const std::string &specification )
+{
+  MessageSpec spec = parseSpec( type, package, specification );
+  loadDependencies( spec );
+  spec.md5 = computeMD5( spec );
+  return spec;
+}
+
+DescriptionProvider::MessageSpec DescriptionProvider::parseSpec( const std::string &type, const std::string &package,
+                                                                 const std::string &specification )
 {
   MessageSpec spec;
   spec.name = type.find( '/' ) == std::string::npos ? package + '/' + type : type;
   spec.package = package;
   spec.text = specification;
 
-  static std::regex constant_regex( R"(^\s*(\w+)\s+([a-zA-Z]\w*)\s*=\s*(.*\S)\s*$)" );
-  static std::regex strip_comment_regex( R"(([^#]*[^#\s])\s*(?:#.*)?)" );
-  static std::regex field_regex( R"(^\s*((\w+\/?\w+)(?:\s*\[\d*\])?)\s*(\w+)\s*)" );
-  std::smatch match;
-  std::string definition;
-  definition.reserve( 8192 );
+  // Each line is either a constant, a field or neither, e.g., a comment or an empty line
+  std::string field_type;
+  std::string dep_type;
+  std::string name;
+  std::string value;
   std::string::size_type start = 0;
   std::string::size_type end;
   while ( true )
   {
     end = specification.find( '\n', start );
-    std::string::const_iterator first = specification.begin() + start;
-    std::string::const_iterator last = end == std::string::npos ? specification.end() : specification.begin() + end;
-    if ( std::regex_search( first, last, match, constant_regex ) && match.size() == 4 )
+    const char *first = specification.data() + start;
+    const char *last = specification.data() + (end == std::string::npos ? specification.length() : end);
+    if ( internal::parseConstantLine( first, last, field_type, name, value ))
     {
-      std::string constant_type = match.str( 1 );
-      std::string name = match.str( 2 );
-      std::string val = match.str( 3 );
-      if ( constant_type != "string" )
-      {
-        std::regex_search( val.cbegin(), val.cend(), match, strip_comment_regex );
-        val = match.str( 1 );
-      }
+      if ( field_type != "string" ) value = internal::stripComment( value );
       spec.constants.push_back(
-        MessageSpec::Constant{ .type = constant_type, .name = name, .val = val } );
+        MessageSpec::Constant{ .type = field_type, .name = name, .val = value } );
     }
-    else if ( std::regex_search( first, last, match, field_regex ) && match.size() == 4 )
+    else if ( internal::parseFieldLine( first, last, field_type, dep_type, name ))
     {
-      std::string dep_type = match.str( 2 );
       if ( dep_type == "Header" ) dep_type = "std_msgs/Header";
       if ( !isBuiltIn( dep_type ))
       {
@@ -466,21 +639,23 @@ DescriptionProvider::MessageSpec DescriptionProvider::createSpec( const std::str
           spec.dependencies.push_back( dep_type );
         }
       }
-      spec.types.push_back( match.str( 1 ));
-      spec.names.push_back( match.str( 3 ));
+      spec.types.push_back( field_type );
+      spec.names.push_back( name );
     }
 
     if ( end == std::string::npos ) break;
     start = end + 1;
   }
+  return spec;
+}
 
-  loadDependencies( spec );
-
-  std::string md5_text = computeMD5Text( spec );
+std::string DescriptionProvider::computeMD5( const MessageSpec &spec )
+{
+  std::string md5_text;
+  if ( !computeMD5Text( spec, md5_text )) return {};
   unsigned char md5_digest[MD5_DIGEST_LENGTH];
   MD5( reinterpret_cast<const unsigned char *>(md5_text.data()), md5_text.length(), md5_digest );
-  spec.md5 = md5ToString( md5_digest );
-  return spec;
+  return md5ToString( md5_digest );
 }
 
 std::vector<std::string> DescriptionProvider::getAllDepends( const MessageSpec &spec )
@@ -491,8 +666,9 @@ std::vector<std::string> DescriptionProvider::getAllDepends( const MessageSpec &
     std::string::size_type pos_separator = dependency.find( '/' );
     std::string type = pos_separator != std::string::npos ? dependency : spec.package + '/' + dependency;
     if ( std::find( result.begin(), result.end(), type ) == result.end()) result.push_back( type );
-    auto it = msg_specs_.find( type );
-    std::vector<std::string> sub_deps = getAllDepends( it->second );
+    const MessageSpec *dependency_spec = findMessageSpec( type );
+    if ( dependency_spec == nullptr ) continue;
+    std::vector<std::string> sub_deps = getAllDepends( *dependency_spec );
     for ( auto &s : sub_deps )
     {
       if ( std::find( result.begin(), result.end(), s ) != result.end()) continue;
@@ -508,11 +684,40 @@ void DescriptionProvider::loadDependencies( const MessageSpec &spec )
   {
     std::string::size_type pos_separator = dependency.find( '/' );
     std::string type = pos_separator != std::string::npos ? dependency : spec.package + '/' + dependency;
-    if ( msg_specs_.find( type ) != msg_specs_.end()) continue;
+    if ( findMessageSpec( type ) != nullptr ) continue;
     getMessageDescription( type );
   }
 }
 
+const DescriptionProvider::MessageSpec *DescriptionProvider::findMessageSpec( const std::string &type ) const
+{
+  auto it = msg_specs_.find( type );
+  if ( it == msg_specs_.end()) return nullptr;
+  const std::string *md5;
+  auto definition_it = definition_md5s_.find( type );
+  if ( definition_it != definition_md5s_.end())
+  {
+    md5 = &definition_it->second;
+  }
+  else
+  {
+    auto description_it = message_descriptions_.find( type );
+    if ( description_it == message_descriptions_.end()) return nullptr;
+    md5 = &description_it->second->md5;
+  }
+  auto version_it = it->second.find( *md5 );
+  if ( version_it == it->second.end()) return nullptr;
+  return &version_it->second;
+}
+
+MessageDescription::ConstPtr DescriptionProvider::getDependencyDescription( const std::string &type )
+{
+  auto definition_it = definition_md5s_.find( type );
+  if ( definition_it == definition_md5s_.end()) return getMessageDescription( type );
+  // Types in the definition are registered before the types that depend on them
+  return findMessageDescription( type, definition_it->second );
+}
+
 std::string DescriptionProvider::computeFullText( const MessageSpec &spec )
 {
   static std::string separator = "================================================================================\n";
@@ -526,7 +731,8 @@ std::string DescriptionProvider::computeFullText( const MessageSpec &spec )
     result += "MSG: ";
     result += dependency;
     result += '\n';
-    result += msg_specs_.find( dependency )->second.text;
+    const MessageSpec *dependency_spec = findMessageSpec( dependency );
+    if ( dependency_spec != nullptr ) result += dependency_spec->text;
     result += '\n';
   }
 
@@ -535,9 +741,9 @@ std::string DescriptionProvider::computeFullText( const MessageSpec &spec )
   return result;
 }
 
-std::string DescriptionProvider::computeMD5Text( const MessageSpec &spec )
+bool DescriptionProvider::computeMD5Text( const MessageSpec &spec, std::string &buffer )
 {
-  std::string buffer;
+  buffer.clear();
   buffer.reserve( 8192 );
   for ( auto &c : spec.constants )
   {
@@ -563,13 +769,10 @@ std::string DescriptionProvider::computeMD5Text( const MessageSpec &spec )
       std::string::size_type pos_separator = type.find( '/' );
       if ( pos_separator == std::string::npos )
         type.insert( 0, (type == "Header" ? "std_msgs" : spec.package) + '/' );
-      auto it = msg_specs_.find( type );
-      if ( it == msg_specs_.end()) return {};
-      std::string sub_md5 = computeMD5Text( it->second );
-      if ( sub_md5.empty()) return {};
-      unsigned char md5_digest[MD5_DIGEST_LENGTH];
-      MD5( reinterpret_cast<const unsigned char *>(sub_md5.data()), sub_md5.length(), md5_digest );
-      buffer += md5ToString( md5_digest );
+      const MessageSpec *dependency_spec = findMessageSpec( type );
+      if ( dependency_spec == nullptr ) return false;
+      // Registered specs already contain their MD5 sum which does not have to be computed again
+      buffer += dependency_spec->md5;
       buffer += ' ';
       buffer += spec.names[index];
     }
@@ -577,7 +780,7 @@ std::string DescriptionProvider::computeMD5Text( const MessageSpec &spec )
   }
   if ( !buffer.empty())
     buffer.pop_back(); // Remove trailing newline
-  return buffer;
+  return true;
 }
 
 namespace
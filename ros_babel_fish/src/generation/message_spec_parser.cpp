@@ -0,0 +1,160 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/generation/internal/message_spec_parser.h"
+
+namespace ros_babel_fish
+{
+namespace internal
+{
+
+namespace
+{
+inline bool isSpace( char c )
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+inline bool isAlpha( char c ) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+inline bool isDigit( char c ) { return c >= '0' && c <= '9'; }
+
+inline bool isWord( char c ) { return isAlpha( c ) || isDigit( c ) || c == '_'; }
+
+inline const char *skipSpace( const char *it, const char *last )
+{
+  while ( it != last && isSpace( *it )) ++it;
+  return it;
+}
+
+inline const char *skipWord( const char *it, const char *last )
+{
+  while ( it != last && isWord( *it )) ++it;
+  return it;
+}
+
+inline const char *skipDigits( const char *it, const char *last )
+{
+  while ( it != last && isDigit( *it )) ++it;
+  return it;
+}
+
+/*!
+ * Parses the optional array specifier and the name following a type that starts at type_begin and ends at type_end.
+ */
+bool parseFieldTail( const char *type_begin, const char *type_end, const char *last, std::string &type,
+                     std::string &base_type, std::string &name )
+{
+  const char *it = skipSpace( type_end, last );
+  if ( it != last && *it == '[' )
+  {
+    const char *array_end = skipDigits( it + 1, last );
+    if ( array_end != last && *array_end == ']' )
+    {
+      const char *name_begin = skipSpace( array_end + 1, last );
+      const char *name_end = skipWord( name_begin, last );
+      if ( name_end != name_begin )
+      {
+        type.assign( type_begin, array_end + 1 );
+        base_type.assign( type_begin, type_end );
+        name.assign( name_begin, name_end );
+        return true;
+      }
+    }
+  }
+  const char *name_end = skipWord( it, last );
+  if ( name_end == it ) return false;
+  type.assign( type_begin, type_end );
+  base_type = type;
+  name.assign( it, name_end );
+  return true;
+}
+}
+
+bool parseConstantLine( const char *first, const char *last, std::string &type, std::string &name, std::string &value )
+{
+  const char *type_begin = skipSpace( first, last );
+  const char *type_end = skipWord( type_begin, last );
+  if ( type_end == type_begin ) return false;
+  const char *name_begin = skipSpace( type_end, last );
+  if ( name_begin == type_end || name_begin == last || !isAlpha( *name_begin )) return false;
+  const char *name_end = skipWord( name_begin, last );
+  const char *it = skipSpace( name_end, last );
+  if ( it == last || *it != '=' ) return false;
+  const char *value_begin = skipSpace( it + 1, last );
+  const char *value_end = last;
+  while ( value_end != value_begin && isSpace( *(value_end - 1))) --value_end;
+  if ( value_end == value_begin ) return false;
+  // The value may not span multiple lines
+  for ( it = value_begin; it != value_end; ++it )
+  {
+    if ( *it == '\n' || *it == '\r' ) return false;
+  }
+  type.assign( type_begin, type_end );
+  name.assign( name_begin, name_end );
+  value.assign( value_begin, value_end );
+  return true;
+}
+
+bool parseFieldLine( const char *first, const char *last, std::string &type, std::string &base_type,
+                     std::string &name )
+{
+  const char *type_begin = skipSpace( first, last );
+  const char *word_end = skipWord( type_begin, last );
+  if ( word_end == type_begin ) return false;
+  if ( word_end != last && *word_end == '/' )
+  {
+    const char *type_end = skipWord( word_end + 1, last );
+    if ( type_end - word_end >= 2 )
+    {
+      if ( parseFieldTail( type_begin, type_end, last, type, base_type, name )) return true;
+      // The regex would backtrack and use the last character of the type as name if that is possible
+      if ( type_end - word_end >= 3 )
+      {
+        base_type.assign( type_begin, type_end - 1 );
+        type = base_type;
+        name.assign( type_end - 1, type_end );
+        return true;
+      }
+    }
+  }
+  // A type without package has to have at least two characters
+  if ( word_end - type_begin < 2 ) return false;
+  if ( parseFieldTail( type_begin, word_end, last, type, base_type, name )) return true;
+  if ( word_end - type_begin < 3 ) return false;
+  base_type.assign( type_begin, word_end - 1 );
+  type = base_type;
+  name.assign( word_end - 1, word_end );
+  return true;
+}
+
+bool parseFieldType( const char *first, const char *last, std::string &type )
+{
+  const char *type_begin = skipSpace( first, last );
+  const char *type_end = skipWord( type_begin, last );
+  if ( type_end == type_begin ) return false;
+  if ( type_end != last && *type_end == '/' )
+  {
+    const char *package_type_end = skipWord( type_end + 1, last );
+    if ( package_type_end != type_end + 1 ) type_end = package_type_end;
+  }
+  type.assign( type_begin, type_end );
+  return true;
+}
+
+std::string stripComment( const std::string &value )
+{
+  std::string::size_type start = 0;
+  while ( start < value.length())
+  {
+    std::string::size_type comment = value.find( '#', start );
+    if ( comment == std::string::npos ) comment = value.length();
+    std::string::size_type end = comment;
+    while ( end > start && isSpace( value[end - 1] )) --end;
+    if ( end > start ) return value.substr( start, end - start );
+    start = comment + 1;
+  }
+  return {};
+}
+}
+}
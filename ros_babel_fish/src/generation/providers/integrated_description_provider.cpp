@@ -5,6 +5,7 @@
 
 #include <ros/package.h>
 
+#include <algorithm>
 #include <experimental/filesystem>
 #include <fstream>
 #include <regex>
@@ -54,51 +55,241 @@ std::vector<fs::path> findWorkspaceShares()
   }
   return paths;
 }
+
+/*!
+ * Obtains the names and paths of all packages with a single rospack call instead of one call per package.
+ * If the paths can not be obtained this way, only the names are listed and the paths are left empty.
+ */
+bool listPackages( std::vector<std::pair<std::string, std::string>> &packages )
+{
+  ros::V_string lines;
+  ros::package::command( "list", lines );
+  for ( const auto &line : lines )
+  {
+    std::string::size_type separator = line.find( ' ' );
+    if ( separator == std::string::npos ) continue;
+    packages.emplace_back( line.substr( 0, separator ), line.substr( separator + 1 ));
+  }
+  if ( !packages.empty()) return true;
+
+  ros::V_string names;
+  if ( !ros::package::getAll( names )) return false;
+  for ( auto &name : names ) packages.emplace_back( std::move( name ), std::string());
+  return true;
+}
 }
 
-IntegratedDescriptionProvider::IntegratedDescriptionProvider()
+IntegratedDescriptionProvider::IntegratedDescriptionProvider( const std::string &cache_path, bool prefetch_packages )
+  : stop_prefetch_( false )
 {
-  ros::V_string packages;
-  if ( !ros::package::getAll( packages ))
-    throw BabelFishException( "Failed to retrieve package paths, will not be able to look up message definitions!" );
+  if ( !cache_path.empty()) cache_.reset( new DescriptionCache( cache_path ));
 
+  for ( auto &share : findWorkspaceShares()) workspace_shares_.push_back( share.string());
+  if ( prefetch_packages ) prefetch_thread_ = std::thread( &IntegratedDescriptionProvider::prefetchPackages, this );
+}
 
-  std::vector<fs::path> workspace_shares = findWorkspaceShares();
-  for ( auto &pkg : packages )
-  {
-    fs::path base_path = ros::package::getPath( pkg );
-    std::vector<std::string> msg_paths, srv_paths;
+IntegratedDescriptionProvider::~IntegratedDescriptionProvider()
+{
+  stop_prefetch_ = true;
+  if ( prefetch_thread_.joinable()) prefetch_thread_.join();
+  saveCache();
+}
 
-    // First check directories returned by ros::package::getPath
+void IntegratedDescriptionProvider::findPackagePaths( const std::string &package, const std::string &package_path,
+                                                      std::vector<std::string> &msg_paths,
+                                                      std::vector<std::string> &srv_paths ) const
+{
+  // First check directories returned by ros::package::getPath
+  fs::path base_path = package_path;
+  if ( !package_path.empty())
+  {
     fs::path msg_path = base_path / "msg";
     if ( fs::is_directory( msg_path ))
       msg_paths.push_back( msg_path.string());
     fs::path srv_path = base_path / "srv";
     if ( fs::is_directory( srv_path ))
       srv_paths.push_back( srv_path.string());
+  }
+
+  // Then check first result in workspaces
+  for ( const std::string &workspace_share : workspace_shares_ )
+  {
+    fs::path project_path = fs::path( workspace_share ) / package;
+    if ( fs::is_directory( project_path ))
+    {
+      if ( project_path == base_path ) break;
+      fs::path workspace_msg_path = project_path / "msg";
+      if ( fs::is_directory( workspace_msg_path ))
+        msg_paths.push_back( workspace_msg_path.string());
+      fs::path workspace_srv_path = project_path / "srv";
+      if ( fs::is_directory( workspace_srv_path ))
+        srv_paths.push_back( workspace_srv_path.string());
+      // Only add the first match and only if it differed from the base_path
+      break;
+    }
+  }
+}
 
-    // Then check first result in workspaces
-    for ( const fs::path &workspace_share : workspace_shares )
+void IntegratedDescriptionProvider::addPackagePaths( const std::string &package, std::vector<std::string> msg_paths,
+                                                     std::vector<std::string> srv_paths )
+{
+  // Packages that do not exist or have no messages and services are remembered as well to look them up only once
+  if ( !resolved_packages_.insert( package ).second ) return;
+  if ( !msg_paths.empty()) msg_paths_.insert( { package, std::move( msg_paths ) } );
+  if ( !srv_paths.empty()) srv_paths_.insert( { package, std::move( srv_paths ) } );
+}
+
+void IntegratedDescriptionProvider::resolvePackage( const std::string &package )
+{
+  if ( resolved_packages_.find( package ) != resolved_packages_.end()) return;
+  std::vector<std::string> msg_paths, srv_paths;
+  findPackagePaths( package, ros::package::getPath( package ), msg_paths, srv_paths );
+  addPackagePaths( package, std::move( msg_paths ), std::move( srv_paths ));
+}
+
+bool IntegratedDescriptionProvider::resolveAllPackages( unsigned int thread_count )
+{
+  std::vector<std::pair<std::string, std::string>> packages;
+  if ( !listPackages( packages ))
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Failed to retrieve package list, packages will only be resolved on demand." );
+    return false;
+  }
+  {
+    std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+    packages.erase( std::remove_if( packages.begin(), packages.end(),
+                                    [this]( const std::pair<std::string, std::string> &package )
+                                    {
+                                      return resolved_packages_.find( package.first ) != resolved_packages_.end();
+                                    } ), packages.end());
+  }
+  if ( packages.empty()) return true;
+
+  struct PackagePaths
+  {
+    std::vector<std::string> msg_paths;
+    std::vector<std::string> srv_paths;
+    bool resolved = false;
+  };
+  // Each package is looked up by exactly one thread which writes only to the result at the index of the package
+  std::vector<PackagePaths> results( packages.size());
+  std::atomic<size_t> next_index( 0 );
+  auto scan = [this, &packages, &results, &next_index]()
+  {
+    for ( size_t i = next_index++; i < packages.size() && !stop_prefetch_; i = next_index++ )
     {
-      fs::path project_path = workspace_share / pkg;
-      if ( fs::is_directory( project_path ))
+      const std::string &package = packages[i].first;
+      try
       {
-        if ( project_path == base_path ) break;
-        fs::path workspace_msg_path = project_path / "msg";
-        if ( fs::is_directory( workspace_msg_path ))
-          msg_paths.push_back( workspace_msg_path.string());
-        fs::path workspace_srv_path = project_path / "srv";
-        if ( fs::is_directory( workspace_srv_path ))
-          srv_paths.push_back( workspace_srv_path.string());
-        // Only add the first match and only if it differed from the base_path
-        break;
+        std::string package_path = packages[i].second.empty() ? ros::package::getPath( package ) : packages[i].second;
+        findPackagePaths( package, package_path, results[i].msg_paths, results[i].srv_paths );
+        results[i].resolved = true;
+      }
+      catch ( std::exception &ex )
+      {
+        ROS_WARN_NAMED( "RosBabelFish", "Failed to look up paths of package '%s': %s", package.c_str(), ex.what());
       }
     }
-    if ( !msg_paths.empty()) msg_paths_.insert( { pkg, msg_paths } );
-    if ( !srv_paths.empty()) srv_paths_.insert( { pkg, srv_paths } );
+  };
+  if ( thread_count == 0 ) thread_count = std::max( 1U, std::thread::hardware_concurrency());
+  thread_count = static_cast<unsigned int>(std::min<size_t>( thread_count, packages.size()));
+  std::vector<std::thread> threads;
+  try
+  {
+    for ( unsigned int i = 1; i < thread_count; ++i ) threads.emplace_back( scan );
+  }
+  catch ( std::system_error &ex )
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Could only start %lu threads to look up packages: %s", threads.size() + 1, ex.what());
+  }
+  scan();
+  for ( auto &thread : threads ) thread.join();
+
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+  for ( size_t i = 0; i < packages.size(); ++i )
+  {
+    if ( !results[i].resolved ) continue;
+    addPackagePaths( packages[i].first, std::move( results[i].msg_paths ), std::move( results[i].srv_paths ));
+  }
+  return true;
+}
+
+void IntegratedDescriptionProvider::prefetchPackages()
+{
+  try
+  {
+    resolveAllPackages();
+  }
+  catch ( std::exception &ex )
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Prefetching package paths failed: %s", ex.what());
   }
 }
 
+bool IntegratedDescriptionProvider::saveCache()
+{
+  std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+  return cache_ == nullptr || cache_->save();
+}
+
+bool IntegratedDescriptionProvider::loadCachedSpec( const std::string &type, const std::string &source,
+                                                    const DescriptionCache::FileStamp &stamp, MessageSpec &spec,
+                                                    std::string &definition )
+{
+  DescriptionCache::MessageEntry entry;
+  if ( !cache_->findMessage( type, entry ) || entry.source != source || entry.source_stamp != stamp ) return false;
+  // The MD5 sum and definition depend on the dependencies which may have changed even if this message did not
+  for ( size_t i = 0; i < entry.dependencies.size(); ++i )
+  {
+    MessageDescription::ConstPtr dependency = getMessageDescription( entry.dependencies[i] );
+    if ( dependency == nullptr || dependency->md5 != entry.dependency_md5s[i] ) return false;
+  }
+  spec.name = std::move( entry.datatype );
+  spec.package = std::move( entry.package );
+  spec.text = std::move( entry.specification );
+  spec.constants.reserve( entry.constants.size());
+  for ( auto &constant : entry.constants )
+  {
+    spec.constants.push_back( MessageSpec::Constant{ .type = constant.type, .name = constant.name, .val = constant.val } );
+  }
+  spec.types = std::move( entry.types );
+  spec.names = std::move( entry.names );
+  spec.dependencies = std::move( entry.dependencies );
+  spec.md5 = std::move( entry.md5 );
+  definition = std::move( entry.definition );
+  return true;
+}
+
+void IntegratedDescriptionProvider::storeCachedSpec( const std::string &type, const std::string &source,
+                                                     const DescriptionCache::FileStamp &stamp )
+{
+  const MessageSpec *spec = findMessageSpec( type );
+  MessageDescription::ConstPtr description = getMessageDescription( type );
+  if ( spec == nullptr || description == nullptr ) return;
+  DescriptionCache::MessageEntry entry;
+  entry.datatype = spec->name;
+  entry.package = spec->package;
+  entry.md5 = spec->md5;
+  entry.specification = spec->text;
+  entry.definition = description->message_definition;
+  for ( auto &constant : spec->constants )
+  {
+    entry.constants.push_back( { constant.type, constant.name, constant.val } );
+  }
+  entry.types = spec->types;
+  entry.names = spec->names;
+  entry.dependencies = spec->dependencies;
+  for ( auto &dependency : spec->dependencies )
+  {
+    MessageDescription::ConstPtr dependency_description = getMessageDescription( dependency );
+    if ( dependency_description == nullptr ) return;
+    entry.dependency_md5s.push_back( dependency_description->md5 );
+  }
+  entry.source = source;
+  entry.source_stamp = stamp;
+  cache_->storeMessage( std::move( entry ));
+}
+
 MessageDescription::ConstPtr IntegratedDescriptionProvider::getMessageDescriptionImpl( const std::string &type )
 {
   if ( type == "Header" ) return getMessageDescription( "std_msgs/Header" );
@@ -110,6 +301,7 @@ MessageDescription::ConstPtr IntegratedDescriptionProvider::getMessageDescriptio
   }
   std::string package = type.substr( 0, pos_separator );
   std::string msg_type = type.substr( package.length() + 1 );
+  resolvePackage( package );
   auto it = msg_paths_.find( package );
   if ( it == msg_paths_.end())
   {
@@ -132,6 +324,16 @@ MessageDescription::ConstPtr IntegratedDescriptionProvider::getMessageDescriptio
     return nullptr;
   }
 
+  DescriptionCache::FileStamp stamp;
+  bool use_cache = cache_ != nullptr && DescriptionCache::getFileStamp( message_path.string(), stamp );
+  if ( use_cache )
+  {
+    MessageSpec spec;
+    std::string definition;
+    if ( loadCachedSpec( type, message_path.string(), stamp, spec, definition ))
+      return registerMessage( spec, definition );
+  }
+
   // Load message specification from file
   std::ifstream file_input( message_path );
   file_input.seekg( 0, std::ios::end );
@@ -141,7 +343,9 @@ MessageDescription::ConstPtr IntegratedDescriptionProvider::getMessageDescriptio
   file_input.read( &specification[0], specification.size());
   file_input.close();
 
-  return registerMessage( type, specification );
+  MessageDescription::ConstPtr description = registerMessage( type, specification );
+  if ( use_cache && description != nullptr ) storeCachedSpec( type, message_path.string(), stamp );
+  return description;
 }
 
 ServiceDescription::ConstPtr IntegratedDescriptionProvider::getServiceDescriptionImpl( const std::string &type )
@@ -154,6 +358,7 @@ ServiceDescription::ConstPtr IntegratedDescriptionProvider::getServiceDescriptio
   }
   std::string package = type.substr( 0, pos_separator );
   std::string msg_type = type.substr( package.length() + 1 );
+  resolvePackage( package );
   auto it = srv_paths_.find( package );
   if ( it == srv_paths_.end())
   {
@@ -176,6 +381,22 @@ ServiceDescription::ConstPtr IntegratedDescriptionProvider::getServiceDescriptio
     return nullptr;
   }
 
+  DescriptionCache::FileStamp stamp;
+  bool use_cache = cache_ != nullptr && DescriptionCache::getFileStamp( service_path.string(), stamp );
+  if ( use_cache )
+  {
+    DescriptionCache::ServiceEntry entry;
+    MessageSpec request_spec, response_spec;
+    std::string request_definition, response_definition;
+    if ( cache_->findService( type, entry ) && entry.source == service_path.string() && entry.source_stamp == stamp &&
+         loadCachedSpec( type + "Request", entry.source, stamp, request_spec, request_definition ) &&
+         loadCachedSpec( type + "Response", entry.source, stamp, response_spec, response_definition ))
+    {
+      return registerService( type, entry.md5, entry.specification, request_spec, request_definition, response_spec,
+                              response_definition );
+    }
+  }
+
   // Load service specification from file
   std::ifstream file_input( service_path );
   file_input.seekg( 0, std::ios::end );
@@ -205,6 +426,13 @@ ServiceDescription::ConstPtr IntegratedDescriptionProvider::getServiceDescriptio
       response = std::string( spec, end + 1 ) + "\n";
   }
 
-  return registerService( type, spec, request, response );
+  ServiceDescription::ConstPtr description = registerService( type, spec, request, response );
+  if ( use_cache && description != nullptr )
+  {
+    storeCachedSpec( type + "Request", service_path.string(), stamp );
+    storeCachedSpec( type + "Response", service_path.string(), stamp );
+    cache_->storeService( { type, description->md5, spec, service_path.string(), stamp } );
+  }
+  return description;
 }
 } // ros_babel_fish
@@ -0,0 +1,103 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/generation/providers/precompiled_description_provider.h"
+
+namespace ros_babel_fish
+{
+
+PrecompiledDescriptionProvider::PrecompiledDescriptionProvider( const std::string &database_path )
+  : database_( database_path )
+{
+  if ( database_.empty())
+    throw BabelFishException( "Failed to load description database '" + database_path +
+                              "'! Make sure it exists and was generated for this version of ros_babel_fish." );
+}
+
+bool PrecompiledDescriptionProvider::loadSpec( const std::string &type, MessageSpec &spec, std::string &definition )
+{
+  DescriptionCache::MessageEntry entry;
+  if ( !database_.findMessage( type, entry )) return false;
+  loadSpec( entry, spec, definition );
+  return true;
+}
+
+void PrecompiledDescriptionProvider::loadSpec( DescriptionCache::MessageEntry &entry, MessageSpec &spec,
+                                               std::string &definition )
+{
+  spec.name = std::move( entry.datatype );
+  spec.package = std::move( entry.package );
+  spec.text = std::move( entry.specification );
+  spec.constants.reserve( entry.constants.size());
+  for ( auto &constant : entry.constants )
+  {
+    spec.constants.push_back( MessageSpec::Constant{ .type = constant.type, .name = constant.name, .val = constant.val } );
+  }
+  spec.types = std::move( entry.types );
+  spec.names = std::move( entry.names );
+  spec.dependencies = std::move( entry.dependencies );
+  spec.md5 = std::move( entry.md5 );
+  definition = std::move( entry.definition );
+}
+
+MessageDescription::ConstPtr PrecompiledDescriptionProvider::getMessageDescriptionImpl( const std::string &type )
+{
+  if ( type == "Header" ) return getMessageDescription( "std_msgs/Header" );
+  MessageSpec spec;
+  std::string definition;
+  if ( !loadSpec( type, spec, definition ))
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Message '%s' is not contained in the description database!", type.c_str());
+    return nullptr;
+  }
+  // The dependencies are looked up in the database when the template is created
+  return registerMessage( spec, definition );
+}
+
+MessageDescription::ConstPtr PrecompiledDescriptionProvider::getMessageDescriptionImpl( const std::string &type,
+                                                                                       const std::string &md5,
+                                                                                       const std::string &definition )
+{
+  MessageDescription::ConstPtr description = registerVersion( type, md5 );
+  if ( description != nullptr ) return description;
+  ROS_DEBUG_NAMED( "RosBabelFish", "Message '%s' with MD5 sum %s is not contained in the description database. "
+                                   "Resolving it from its definition.", type.c_str(), md5.c_str());
+  return DescriptionProvider::getMessageDescriptionImpl( type, md5, definition );
+}
+
+MessageDescription::ConstPtr PrecompiledDescriptionProvider::registerVersion( const std::string &type,
+                                                                             const std::string &md5 )
+{
+  DescriptionCache::MessageEntry entry;
+  if ( !database_.findMessage( type, entry ) || entry.md5 != md5 ||
+       entry.dependency_md5s.size() != entry.dependencies.size())
+    return nullptr;
+  // The registered default version of a dependency may differ from the version the entry was created with
+  for ( size_t i = 0; i < entry.dependencies.size(); ++i )
+  {
+    if ( findMessageDescription( entry.dependencies[i], entry.dependency_md5s[i] ) != nullptr ) continue;
+    if ( registerVersion( entry.dependencies[i], entry.dependency_md5s[i] ) == nullptr ) return nullptr;
+  }
+  std::vector<std::string> dependency_md5s = std::move( entry.dependency_md5s );
+  MessageSpec spec;
+  std::string definition;
+  loadSpec( entry, spec, definition );
+  return registerMessage( spec, definition, dependency_md5s );
+}
+
+ServiceDescription::ConstPtr PrecompiledDescriptionProvider::getServiceDescriptionImpl( const std::string &type )
+{
+  DescriptionCache::ServiceEntry entry;
+  MessageSpec request_spec, response_spec;
+  std::string request_definition, response_definition;
+  if ( !database_.findService( type, entry ) ||
+       !loadSpec( type + "Request", request_spec, request_definition ) ||
+       !loadSpec( type + "Response", response_spec, response_definition ))
+  {
+    ROS_WARN_NAMED( "RosBabelFish", "Service '%s' is not contained in the description database!", type.c_str());
+    return nullptr;
+  }
+  return registerService( type, entry.md5, entry.specification, request_spec, request_definition, response_spec,
+                          response_definition );
+}
+} // ros_babel_fish
@@ -6,12 +6,14 @@
 #include "ros_babel_fish/messages/compound_message.h"
 #include "ros_babel_fish/messages/value_message.h"
 #include "ros_babel_fish/babel_fish.h"
+#include "ros_babel_fish/output_stream.h"
 
 
 namespace ros_babel_fish
 {
 
-Message::Message( MessageType type, const uint8_t *stream ) : type_( type ), stream_( stream ) { }
+Message::Message( MessageType type, const uint8_t *stream )
+  : type_( type ), stream_( stream ), owners_( 1 ), arena_allocated_( false ) { }
 
 Message &Message::operator[]( const std::string & )
 {
@@ -27,6 +29,55 @@ const Message &Message::operator[]( const std::string & ) const
 
 Message::~Message() = default;
 
+void Message::writeToStream( OutputStream &stream ) const
+{
+  writeToStream( stream.advance( _sizeInBytes()));
+}
+
+Message *Message::cloneShared() const
+{
+  return clone();
+}
+
+void Message::destroy( Message *message )
+{
+  if ( message == nullptr ) return;
+  // The memory of arena allocated messages is released with the arena
+  if ( message->arena_allocated_ ) message->~Message();
+  else delete message;
+}
+
+void Message::addOwner( const Message *message )
+{
+  message->owners_.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void Message::removeOwner( Message *message )
+{
+  if ( message == nullptr ) return;
+  if ( message->owners_.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) destroy( message );
+}
+
+void Message::makeExclusive( Message *&message )
+{
+  if ( message == nullptr || !message->_isShared()) return;
+  Message *copy = message->cloneShared();
+  removeOwner( message );
+  message = copy;
+}
+
+void Message::assign( Message &&other )
+{
+  assign( static_cast<const Message &>(other));
+}
+
+bool Message::_patchStream( const uint8_t *, uint8_t *target, size_t offset, size_t size ) const
+{
+  if ( _sizeInBytes() != size ) return false;
+  writeToStream( target + offset );
+  return true;
+}
+
 namespace
 {
 
@@ -46,7 +97,7 @@ void assignValue( Message *m, const T &value )
                          "Assigned value fits but the type of the assignment can not be converted without loss of information in some cases! This message is printed only once!" );
 #endif
   }
-  m->as<ValueMessage<U>>().setValue( static_cast<U>(value));
+  m->asUnchecked<ValueMessage<U>>().setValue( static_cast<U>(value));
 }
 
 template<typename T>
@@ -198,7 +249,7 @@ template<typename T, typename U>
 U obtainValue( const Message *m )
 {
   using namespace message_type_traits;
-  T val = m->as<ValueMessage<T>>().getValue();
+  T val = m->asUnchecked<ValueMessage<T>>().getValue();
   if ( !internal::isCompatible<T, U>())
   {
     if ( !internal::inBounds<T, U>( val ))
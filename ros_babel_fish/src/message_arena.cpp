@@ -0,0 +1,49 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/message_arena.h"
+
+namespace ros_babel_fish
+{
+
+namespace
+{
+constexpr size_t ALIGNMENT = alignof( std::max_align_t );
+
+constexpr size_t alignUp( size_t size ) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+}
+
+MessageArena::MessageArena( size_t initial_block_size )
+  : current_( nullptr ), remaining_( 0 ), next_block_size_( alignUp( initial_block_size == 0 ? 1 : initial_block_size ))
+    , capacity_( 0 )
+{
+}
+
+MessageArena::~MessageArena()
+{
+  for ( auto &block : blocks_ )
+  {
+    ::operator delete( block );
+  }
+  blocks_.clear();
+}
+
+void *MessageArena::allocate( size_t size )
+{
+  size = alignUp( size );
+  if ( size > remaining_ )
+  {
+    size_t block_size = next_block_size_;
+    while ( block_size < size ) block_size *= 2;
+    next_block_size_ = block_size * 2;
+    current_ = static_cast<uint8_t *>(::operator new( block_size ));
+    blocks_.push_back( current_ );
+    remaining_ = block_size;
+    capacity_ += block_size;
+  }
+  void *result = current_;
+  current_ += size;
+  remaining_ -= size;
+  return result;
+}
+} // ros_babel_fish
@@ -0,0 +1,221 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/messages/internal/array_conversion.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ros_babel_fish
+{
+namespace internal
+{
+
+void normalizeBooleans( const uint8_t *in, uint8_t *out, size_t count )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256i zero32 = _mm256_setzero_si256();
+  const __m256i ones32 = _mm256_set1_epi8( 1 );
+  for ( ; i + 32 <= count; i += 32 )
+  {
+    __m256i values = _mm256_loadu_si256( reinterpret_cast<const __m256i *>(in + i));
+    // The comparison yields 0xFF for zeros, hence, and-not with ones yields 1 for all non-zero values
+    __m256i result = _mm256_andnot_si256( _mm256_cmpeq_epi8( values, zero32 ), ones32 );
+    _mm256_storeu_si256( reinterpret_cast<__m256i *>(out + i), result );
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi8( 1 );
+  for ( ; i + 16 <= count; i += 16 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    __m128i result = _mm_andnot_si128( _mm_cmpeq_epi8( values, zero ), ones );
+    _mm_storeu_si128( reinterpret_cast<__m128i *>(out + i), result );
+  }
+#endif
+  for ( ; i < count; ++i ) out[i] = in[i] != 0 ? 1 : 0;
+}
+
+void convertArrayKernel( const float *in, double *out, size_t count, double scale )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256d scale8 = _mm256_set1_pd( scale );
+  for ( ; i + 8 <= count; i += 8 )
+  {
+    __m256d lo = _mm256_cvtps_pd( _mm_loadu_ps( in + i ));
+    __m256d hi = _mm256_cvtps_pd( _mm_loadu_ps( in + i + 4 ));
+    _mm256_storeu_pd( out + i, _mm256_mul_pd( lo, scale8 ));
+    _mm256_storeu_pd( out + i + 4, _mm256_mul_pd( hi, scale8 ));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128d scale4 = _mm_set1_pd( scale );
+  for ( ; i + 4 <= count; i += 4 )
+  {
+    __m128 values = _mm_loadu_ps( in + i );
+    _mm_storeu_pd( out + i, _mm_mul_pd( _mm_cvtps_pd( values ), scale4 ));
+    _mm_storeu_pd( out + i + 2, _mm_mul_pd( _mm_cvtps_pd( _mm_movehl_ps( values, values )), scale4 ));
+  }
+#endif
+  for ( ; i < count; ++i ) out[i] = static_cast<double>(in[i]) * scale;
+}
+
+void convertArrayKernel( const double *in, float *out, size_t count, float scale )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256 scale8 = _mm256_set1_ps( scale );
+  for ( ; i + 8 <= count; i += 8 )
+  {
+    __m128 lo = _mm256_cvtpd_ps( _mm256_loadu_pd( in + i ));
+    __m128 hi = _mm256_cvtpd_ps( _mm256_loadu_pd( in + i + 4 ));
+    // _mm256_set_m128 is not available before GCC 8
+    __m256 combined = _mm256_insertf128_ps( _mm256_castps128_ps256( lo ), hi, 1 );
+    _mm256_storeu_ps( out + i, _mm256_mul_ps( combined, scale8 ));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128 scale4 = _mm_set1_ps( scale );
+  for ( ; i + 4 <= count; i += 4 )
+  {
+    __m128 lo = _mm_cvtpd_ps( _mm_loadu_pd( in + i ));
+    __m128 hi = _mm_cvtpd_ps( _mm_loadu_pd( in + i + 2 ));
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_movelh_ps( lo, hi ), scale4 ));
+  }
+#endif
+  for ( ; i < count; ++i ) out[i] = static_cast<float>(in[i]) * scale;
+}
+
+void convertArrayKernel( const uint8_t *in, float *out, size_t count, float scale )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256 scale8 = _mm256_set1_ps( scale );
+  for ( ; i + 16 <= count; i += 16 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    __m256 lo = _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( values ));
+    __m256 hi = _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_srli_si128( values, 8 )));
+    _mm256_storeu_ps( out + i, _mm256_mul_ps( lo, scale8 ));
+    _mm256_storeu_ps( out + i + 8, _mm256_mul_ps( hi, scale8 ));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128 scale4 = _mm_set1_ps( scale );
+  const __m128i zero = _mm_setzero_si128();
+  for ( ; i + 16 <= count; i += 16 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    __m128i lo16 = _mm_unpacklo_epi8( values, zero );
+    __m128i hi16 = _mm_unpackhi_epi8( values, zero );
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo16, zero )), scale4 ));
+    _mm_storeu_ps( out + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo16, zero )), scale4 ));
+    _mm_storeu_ps( out + i + 8, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi16, zero )), scale4 ));
+    _mm_storeu_ps( out + i + 12, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi16, zero )), scale4 ));
+  }
+#endif
+  for ( ; i < count; ++i ) out[i] = static_cast<float>(in[i]) * scale;
+}
+
+void convertArrayKernel( const int16_t *in, float *out, size_t count, float scale )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256 scale8 = _mm256_set1_ps( scale );
+  for ( ; i + 8 <= count; i += 8 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    _mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_cvtepi16_epi32( values )), scale8 ));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128 scale4 = _mm_set1_ps( scale );
+  for ( ; i + 8 <= count; i += 8 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    // Move each value into the upper half of a 32 bit lane and shift it back to sign extend it
+    __m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( values, values ), 16 );
+    __m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( values, values ), 16 );
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( lo ), scale4 ));
+    _mm_storeu_ps( out + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( hi ), scale4 ));
+  }
+#endif
+  for ( ; i < count; ++i ) out[i] = static_cast<float>(in[i]) * scale;
+}
+
+void convertArrayKernel( const uint16_t *in, float *out, size_t count, float scale )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256 scale8 = _mm256_set1_ps( scale );
+  for ( ; i + 8 <= count; i += 8 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    _mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( values )), scale8 ));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128 scale4 = _mm_set1_ps( scale );
+  const __m128i zero = _mm_setzero_si128();
+  for ( ; i + 8 <= count; i += 8 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( values, zero )), scale4 ));
+    _mm_storeu_ps( out + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( values, zero )), scale4 ));
+  }
+#endif
+  for ( ; i < count; ++i ) out[i] = static_cast<float>(in[i]) * scale;
+}
+
+void convertArrayKernel( const int32_t *in, float *out, size_t count, float scale )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256 scale8 = _mm256_set1_ps( scale );
+  for ( ; i + 8 <= count; i += 8 )
+  {
+    __m256i values = _mm256_loadu_si256( reinterpret_cast<const __m256i *>(in + i));
+    _mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_cvtepi32_ps( values ), scale8 ));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128 scale4 = _mm_set1_ps( scale );
+  for ( ; i + 4 <= count; i += 4 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( values ), scale4 ));
+  }
+#endif
+  for ( ; i < count; ++i ) out[i] = static_cast<float>(in[i]) * scale;
+}
+
+void convertArrayKernel( const int32_t *in, double *out, size_t count, double scale )
+{
+  size_t i = 0;
+#ifdef __AVX2__
+  const __m256d scale8 = _mm256_set1_pd( scale );
+  for ( ; i + 8 <= count; i += 8 )
+  {
+    __m256d lo = _mm256_cvtepi32_pd( _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i)));
+    __m256d hi = _mm256_cvtepi32_pd( _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i + 4)));
+    _mm256_storeu_pd( out + i, _mm256_mul_pd( lo, scale8 ));
+    _mm256_storeu_pd( out + i + 4, _mm256_mul_pd( hi, scale8 ));
+  }
+#endif
+#ifdef __SSE2__
+  const __m128d scale4 = _mm_set1_pd( scale );
+  for ( ; i + 4 <= count; i += 4 )
+  {
+    __m128i values = _mm_loadu_si128( reinterpret_cast<const __m128i *>(in + i));
+    _mm_storeu_pd( out + i, _mm_mul_pd( _mm_cvtepi32_pd( values ), scale4 ));
+    _mm_storeu_pd( out + i + 2, _mm_mul_pd( _mm_cvtepi32_pd( _mm_srli_si128( values, 8 )), scale4 ));
+  }
+#endif
+  for ( ; i < count; ++i ) out[i] = static_cast<double>(in[i]) * scale;
+}
+}
+}
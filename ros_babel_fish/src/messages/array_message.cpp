@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "ros_babel_fish/messages/array_message.h"
+#include "ros_babel_fish/generation/decode_program.h"
 #include "ros_babel_fish/messages/compound_message.h"
 
 namespace ros_babel_fish
@@ -21,7 +22,7 @@ ArrayMessage<Message>::~ArrayMessage()
 {
   for ( auto &entry : values_ )
   {
-    delete entry;
+    removeOwner( entry );
   }
   values_.clear();
 }
@@ -29,6 +30,8 @@ ArrayMessage<Message>::~ArrayMessage()
 template<>
 Message &ArrayMessage<Message>::operator[]( size_t index )
 {
+  // Elements shared with copy-on-write clones are copied since they may be modified through the returned reference
+  makeExclusive( values_[index] );
   return *values_[index];
 }
 
@@ -43,7 +46,7 @@ void ArrayMessage<Message>::assign( size_t index, Message *value )
 {
   if ( index >= length_ )
     throw BabelFishException( "Index in setItem was out of bounds! Maybe you meant push_back?" );
-  delete values_[index];
+  removeOwner( values_[index] );
   values_[index] = value;
 }
 
@@ -58,20 +61,71 @@ size_t ArrayMessage<Message>::_sizeInBytes() const
   return result;
 }
 
+template<>
+bool ArrayMessage<Message>::isDetachedFromStream() const
+{
+  for ( auto &value : values_ )
+  {
+    if ( !value->isDetachedFromStream()) return false;
+  }
+  return true;
+}
+
+template<>
+void ArrayMessage<Message>::detachFromStream()
+{
+  for ( auto &value : values_ )
+  {
+    makeExclusive( value );
+    value->detachFromStream();
+  }
+}
+
 template<>
 size_t ArrayMessage<Message>::writeToStream( uint8_t *stream ) const
 {
-  size_t offset = 0;
+  OutputStream output( stream );
+  writeToStream( output );
+  return output.size();
+}
+
+template<>
+void ArrayMessage<Message>::writeToStream( OutputStream &stream ) const
+{
   if ( !fixed_length_ )
   {
-    *reinterpret_cast<uint32_t *>(stream) = length_;
-    offset = 4;
+    *reinterpret_cast<uint32_t *>(stream.advance( 4 )) = length_;
   }
+  // Consecutive elements that are unchanged and were read from consecutive parts of the same stream are copied at once
+  const uint8_t *run_stream = nullptr;
+  size_t run_begin = 0;
+  size_t run_end = 0;
+  auto copyRun = [ & ]()
+  {
+    size_t size = run_end - run_begin;
+    if ( size > 0 ) std::memcpy( stream.advance( size ), run_stream + run_begin, size );
+  };
   for ( auto &value : values_ )
   {
-    offset += value->writeToStream( stream + offset );
+    auto &element = value->asUnchecked<CompoundMessage>();
+    if ( run_stream != nullptr && element._isUnchangedAt( run_stream, run_end ))
+    {
+      run_end += element._streamSize();
+      continue;
+    }
+    copyRun();
+    if ( !element._isModified())
+    {
+      run_stream = element._stream();
+      run_begin = element._streamOffset();
+      run_end = run_begin + element._streamSize();
+      continue;
+    }
+    run_stream = nullptr;
+    run_begin = run_end = 0;
+    element.writeToStream( stream );
   }
-  return offset;
+  copyRun();
 }
 
 template<>
@@ -79,11 +133,12 @@ ArrayMessage<Message> &ArrayMessage<Message>::operator=( const ArrayMessage<Mess
 {
   if ( type() != other.type() ||
        (elementType() == MessageTypes::Compound &&
-        as<CompoundArrayMessage>().elementDataType() != other.as<CompoundArrayMessage>().elementDataType()))
+        asUnchecked<CompoundArrayMessage>().elementDataType() !=
+        other.asUnchecked<CompoundArrayMessage>().elementDataType()))
     throw BabelFishException( "Can not assign incompatible ArrayMessage! They need to have exactly the same type!" );
   for ( auto &entry : values_ )
   {
-    delete entry;
+    removeOwner( entry );
   }
   values_.clear();
   values_.reserve( other._sizeInBytes());
@@ -95,10 +150,31 @@ ArrayMessage<Message> &ArrayMessage<Message>::operator=( const ArrayMessage<Mess
   return *this;
 }
 
+template<>
+ArrayMessage<Message> &ArrayMessage<Message>::operator=( ArrayMessage<Message> &&other )
+{
+  if ( this == &other ) return *this;
+  if ( type() != other.type() ||
+       (elementType() == MessageTypes::Compound &&
+        asUnchecked<CompoundArrayMessage>().elementDataType() !=
+        other.asUnchecked<CompoundArrayMessage>().elementDataType()))
+    throw BabelFishException( "Can not assign incompatible ArrayMessage! They need to have exactly the same type!" );
+  for ( auto &entry : values_ )
+  {
+    removeOwner( entry );
+  }
+  values_ = std::move( other.values_ );
+  length_ = other.length_;
+  fixed_length_ = other.fixed_length_;
+  stream_ = other.stream_;
+  other.resetMovedFrom();
+  return *this;
+}
+
 template<>
 Message *ArrayMessage<Message>::clone() const
 {
-  auto result = new ArrayMessage<Message>( elementType(), length(), isFixedSize(), stream_ );
+  auto result = new ArrayMessage<Message>( elementType(), length(), isFixedSize());
   result->values_.clear();
   std::transform( values_.begin(), values_.end(), std::back_inserter( result->values_ ),
                   []( Message *m ) { return m->clone(); } );
@@ -133,7 +209,7 @@ bool ArrayMessage<bool>::operator[]( size_t index ) const
 
 template<>
 ArrayMessage<bool> *ArrayMessage<bool>::fromStream( ssize_t length, const uint8_t *stream, size_t stream_length,
-                                                    size_t &bytes_read )
+                                                    size_t &bytes_read, MessageArena *arena )
 {
   (void) stream_length; // For unused warning
   bool fixed_length = length >= 0;
@@ -147,7 +223,7 @@ ArrayMessage<bool> *ArrayMessage<bool>::fromStream( ssize_t length, const uint8_
   bytes_read += sizeof( uint8_t ) * length;
   if ( bytes_read > stream_length )
     throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-  return new ArrayMessage<bool>( length, fixed_length, stream );
+  return internal::createMessage<ArrayMessage<bool>>( arena, length, fixed_length, stream );
 }
 
 template<>
@@ -160,14 +236,8 @@ template<>
 void ArrayMessage<bool>::detachFromStream()
 {
   if ( !from_stream_ ) return;
-  const uint8_t *data = stream_;
-  values_.clear();
-  values_.reserve( length_ );
-  for ( size_t i = 0; i < length_; ++i )
-  {
-    values_.push_back( *data != 0 );
-    ++data;
-  }
+  values_.resize( length_ );
+  internal::normalizeBooleans( stream_, values_.data(), length_ );
   from_stream_ = false;
 }
 
@@ -187,11 +257,8 @@ size_t ArrayMessage<bool>::writeToStream( uint8_t *stream ) const
     std::memcpy( stream, stream_, count );
     return length;
   }
-  for ( size_t i = 0; i < length_; ++i )
-  {
-    *stream = static_cast<uint8_t>(values_[i] ? 1 : 0);
-    ++stream;
-  }
+  // The stored values are already normalized to 0 and 1
+  if ( count > 0 ) std::memcpy( stream, values_.data(), count );
   return length;
 }
 
@@ -199,20 +266,59 @@ size_t ArrayMessage<bool>::writeToStream( uint8_t *stream ) const
 //! ============== String Specialization ==============
 //! ===================================================
 
+namespace
+{
+/*!
+ * Computes the offsets of the strings in a stream-backed string array in a single pass.
+ * @param stream_length The number of bytes available at stream. Only checked if check_bounds is true.
+ */
+void computeStringOffsets( const uint8_t *stream, size_t length, size_t stream_length, bool check_bounds,
+                           std::vector<uint32_t> &offsets )
+{
+  offsets.clear();
+  offsets.reserve( length + 1 );
+  size_t offset = 0;
+  for ( size_t i = 0; i < length; ++i )
+  {
+    offsets.push_back( static_cast<uint32_t>(offset));
+    if ( check_bounds && offset + sizeof( uint32_t ) > stream_length )
+      throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
+    offset += *reinterpret_cast<const uint32_t *>(stream + offset) + sizeof( uint32_t );
+    if ( check_bounds && offset > stream_length )
+      throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
+  }
+  offsets.push_back( static_cast<uint32_t>(offset));
+}
+
+std::string stringAt( const uint8_t *stream, const std::vector<uint32_t> &offsets, size_t index )
+{
+  uint32_t offset = offsets[index] + sizeof( uint32_t );
+  return std::string( reinterpret_cast<const char *>(stream + offset), offsets[index + 1] - offset );
+}
+
+/*!
+ * Skips the strings in front of the given index if no offsets were computed for the array.
+ * @return The offset of the string at the given index, i.e., the total size of all strings if index equals the length.
+ */
+size_t skipStrings( const uint8_t *stream, size_t index )
+{
+  size_t offset = 0;
+  for ( size_t i = 0; i < index; ++i )
+  {
+    offset += *reinterpret_cast<const uint32_t *>(stream + offset) + sizeof( uint32_t );
+  }
+  return offset;
+}
+}
+
 template<>
 std::string ArrayMessage<std::string>::operator[]( size_t index )
 {
   if ( index >= length_ ) throw std::runtime_error( "Index out of message array bounds!" );
   if ( from_stream_ )
   {
-    size_t offset = 0;
-    for ( size_t i = 0; i < index; ++i )
-    {
-      offset += *reinterpret_cast<const uint32_t *>(stream_ + offset) + sizeof( uint32_t );
-    }
-    uint32_t len = *reinterpret_cast<const uint32_t *>(stream_ + offset);
-    offset += sizeof( uint32_t );
-    return std::string( reinterpret_cast<const char *>(stream_ + offset), len );
+    if ( stream_offsets_.empty()) computeStringOffsets( stream_, length_, 0, false, stream_offsets_ );
+    return stringAt( stream_, stream_offsets_, index );
   }
   return values_[index];
 }
@@ -223,40 +329,37 @@ std::string ArrayMessage<std::string>::operator[]( size_t index ) const
   if ( index >= length_ ) throw std::runtime_error( "Index out of message array bounds!" );
   if ( from_stream_ )
   {
-    size_t offset = 0;
-    for ( size_t i = 0; i < index; ++i )
-    {
-      offset += *reinterpret_cast<const uint32_t *>(stream_ + offset) + sizeof( uint32_t );
-    }
-    uint32_t len = *reinterpret_cast<const uint32_t *>(stream_ + offset);
-    offset += sizeof( uint32_t );
-    return std::string( reinterpret_cast<const char *>(stream_ + offset), len );
+    if ( !stream_offsets_.empty()) return stringAt( stream_, stream_offsets_, index );
+    // Const access must not build the offsets since concurrent readers would race
+    const uint8_t *data = stream_ + skipStrings( stream_, index );
+    uint32_t len = *reinterpret_cast<const uint32_t *>(data);
+    return std::string( reinterpret_cast<const char *>(data + sizeof( uint32_t )), len );
   }
   return values_[index];
 }
 
 template<>
 ArrayMessage<std::string> *ArrayMessage<std::string>::fromStream( ssize_t length, const uint8_t *stream,
-                                                                  size_t stream_length, size_t &bytes_read )
+                                                                  size_t stream_length, size_t &bytes_read,
+                                                                  MessageArena *arena )
 {
-  (void) stream_length; // For unused warning
   bool fixed_length = length >= 0;
   stream += bytes_read;
   if ( !fixed_length )
   {
+    if ( bytes_read + sizeof( uint32_t ) > stream_length )
+      throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
     length = *reinterpret_cast<const uint32_t *>(stream);
     stream += sizeof( uint32_t );
     bytes_read += sizeof( uint32_t );
   }
-  size_t offset = 0;
-  for ( ssize_t i = 0; i < length; ++i )
-  {
-    offset += *reinterpret_cast<const uint32_t *>(stream + offset) + sizeof( uint32_t );
-    if ( bytes_read + offset > stream_length )
-      throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-  }
-  bytes_read += offset;
-  return new ArrayMessage<std::string>( length, fixed_length, stream );
+  // The offsets are computed anyway to validate the stream, hence, they are stored for indexed access
+  std::vector<uint32_t> offsets;
+  computeStringOffsets( stream, length, stream_length - bytes_read, true, offsets );
+  bytes_read += offsets.back();
+  auto result = internal::createMessage<ArrayMessage<std::string>>( arena, length, fixed_length, stream );
+  result->stream_offsets_ = std::move( offsets );
+  return result;
 }
 
 template<>
@@ -265,12 +368,7 @@ size_t ArrayMessage<std::string>::_sizeInBytes() const
   size_t size = fixed_length_ ? 0 : 4;
   if ( from_stream_ )
   {
-    size_t offset = 0;
-    for ( size_t i = 0; i < length_; ++i )
-    {
-      offset += *reinterpret_cast<const uint32_t *>(stream_ + offset) + sizeof( uint32_t );
-    }
-    return size + offset;
+    return size + ( stream_offsets_.empty() ? skipStrings( stream_, length_ ) : stream_offsets_.back());
   }
   for ( const auto &value : values_ )
   {
@@ -285,6 +383,7 @@ void ArrayMessage<std::string>::detachFromStream()
   if ( !from_stream_ ) return;
   auto data = stream_;
   values_.clear();
+  values_.reserve( length_ );
   for ( size_t i = 0; i < length_; ++i )
   {
     uint32_t len = *reinterpret_cast<const uint32_t *>(data);
@@ -293,6 +392,8 @@ void ArrayMessage<std::string>::detachFromStream()
     data += len;
   }
   from_stream_ = false;
+  stream_offsets_.clear();
+  stream_offsets_.shrink_to_fit();
 }
 
 template<>
@@ -355,7 +456,8 @@ ros::Time ArrayMessage<ros::Time>::operator[]( size_t index ) const
 
 template<>
 ArrayMessage<ros::Time> *ArrayMessage<ros::Time>::fromStream( ssize_t length, const uint8_t *stream,
-                                                              size_t stream_length, size_t &bytes_read )
+                                                              size_t stream_length, size_t &bytes_read,
+                                                              MessageArena *arena )
 {
   (void) stream_length; // For unused warning
   bool fixed_length = length >= 0;
@@ -369,7 +471,7 @@ ArrayMessage<ros::Time> *ArrayMessage<ros::Time>::fromStream( ssize_t length, co
   bytes_read += 2 * sizeof( uint32_t ) * length;
   if ( bytes_read > stream_length )
     throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-  return new ArrayMessage<ros::Time>( length, fixed_length, stream );
+  return internal::createMessage<ArrayMessage<ros::Time>>( arena, length, fixed_length, stream );
 }
 
 template<>
@@ -454,21 +556,22 @@ ros::Duration ArrayMessage<ros::Duration>::operator[]( size_t index ) const
 
 template<>
 ArrayMessage<ros::Duration> *ArrayMessage<ros::Duration>::fromStream( ssize_t length, const uint8_t *stream,
-                                                                      size_t stream_length, size_t &bytes_read )
+                                                                      size_t stream_length, size_t &bytes_read,
+                                                                      MessageArena *arena )
 {
   (void) stream_length; // For unused warning
   bool fixed_length = length >= 0;
   stream += bytes_read;
   if ( !fixed_length )
   {
-    length = *reinterpret_cast<const uint32_t *>(stream + bytes_read);
+    length = *reinterpret_cast<const uint32_t *>(stream);
     stream += sizeof( uint32_t );
     bytes_read += sizeof( uint32_t );
   }
   bytes_read += 2 * sizeof( int32_t ) * length;
   if ( bytes_read > stream_length )
     throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-  return new ArrayMessage<ros::Duration>( length, fixed_length, stream );
+  return internal::createMessage<ArrayMessage<ros::Duration>>( arena, length, fixed_length, stream );
 }
 
 template<>
@@ -527,7 +630,7 @@ size_t ArrayMessage<ros::Duration>::writeToStream( uint8_t *stream ) const
 
 CompoundArrayMessage *CompoundArrayMessage::fromStream( ssize_t length, MessageTemplate::ConstPtr msg_template,
                                                         const uint8_t *stream, size_t stream_length,
-                                                        size_t &bytes_read )
+                                                        size_t &bytes_read, MessageArena *arena, bool lazy )
 {
   bool fixed_length = length >= 0;
   if ( !fixed_length )
@@ -535,10 +638,21 @@ CompoundArrayMessage *CompoundArrayMessage::fromStream( ssize_t length, MessageT
     length = *reinterpret_cast<const uint32_t *>(stream + bytes_read);
     bytes_read += sizeof( uint32_t );
   }
-  auto *result = new CompoundArrayMessage( std::move( msg_template ), length, fixed_length, stream );
-  for ( ssize_t i = 0; i < length; ++i )
+  auto *result = arena == nullptr
+                 ? new CompoundArrayMessage( std::move( msg_template ), length, fixed_length, stream )
+                 : arena->create<CompoundArrayMessage>( std::move( msg_template ), length, fixed_length, stream );
+  try
   {
-    result->values_.push_back( CompoundMessage::fromStream( result->msg_template_, stream, stream_length, bytes_read ));
+    for ( ssize_t i = 0; i < length; ++i )
+    {
+      result->values_.push_back(
+        CompoundMessage::fromStream( result->msg_template_, stream, stream_length, bytes_read, arena, lazy ));
+    }
+  }
+  catch ( ... )
+  {
+    destroy( result );
+    throw;
   }
   return result;
 }
@@ -561,15 +675,63 @@ CompoundArrayMessage::CompoundArrayMessage( MessageTemplate::ConstPtr msg_templa
   }
 }
 
+CompoundArrayMessage::CompoundArrayMessage( CompoundArrayMessage &&other ) noexcept
+  : ArrayMessage<Message>( std::move( other )), msg_template_( other.msg_template_ )
+{
+}
+
+CompoundArrayMessage &CompoundArrayMessage::operator=( CompoundArrayMessage &&other )
+{
+  ArrayMessage<Message>::operator=( std::move( other ));
+  return *this;
+}
+
+bool CompoundArrayMessage::_patchStream( const uint8_t *source, uint8_t *target, size_t offset, size_t size ) const
+{
+  size_t end = offset + size;
+  if ( !fixed_length_ )
+  {
+    if ( size < sizeof( uint32_t ) || *reinterpret_cast<const uint32_t *>(target + offset) != length_ ) return false;
+    offset += sizeof( uint32_t );
+  }
+  DecodeProgram::ConstPtr program = getDecodeProgram( *msg_template_ );
+  for ( auto &value : values_ )
+  {
+    auto &element = value->asUnchecked<CompoundMessage>();
+    if ( element._isUnchangedAt( source, offset ))
+    {
+      offset += element._streamSize();
+      continue;
+    }
+    size_t element_end = offset;
+    skipMessage( *program, target, end, element_end );
+    if ( !element._patchStream( source, target, offset, element_end - offset )) return false;
+    offset = element_end;
+  }
+  return offset == end;
+}
+
 Message *CompoundArrayMessage::clone() const
 {
-  auto result = new CompoundArrayMessage( msg_template_, length(), isFixedSize(), stream_ );
+  auto result = new CompoundArrayMessage( msg_template_, length(), isFixedSize(), nullptr );
   result->values_.clear();
   std::transform( values_.begin(), values_.end(), std::back_inserter( result->values_ ),
                   []( Message *m ) { return m->clone(); } );
   return result;
 }
 
+Message *CompoundArrayMessage::cloneShared() const
+{
+  auto result = new CompoundArrayMessage( msg_template_, length(), isFixedSize(), stream_ );
+  result->values_ = values_;
+  for ( Message *value : values_ )
+  {
+    CompoundMessage::materialize( *value );
+    addOwner( value );
+  }
+  return result;
+}
+
 Message &CompoundArrayMessage::appendEmpty()
 {
   if ( fixed_length_ )
@@ -581,4 +743,23 @@ Message &CompoundArrayMessage::appendEmpty()
   ++length_;
   return *m;
 }
+CompoundMessage &CompoundArrayMessage::push_back( CompoundMessage &&message )
+{
+  if ( fixed_length_ )
+  {
+    throw BabelFishException( "Can not add items to a fixed size array!" );
+  }
+  if ( message.datatype() != elementDataType())
+    throw BabelFishException( "Tried to append '" + message.datatype() + "' message to array of '" +
+                              elementDataType() + "' messages!" );
+  auto m = new CompoundMessage( std::move( message ));
+  values_.push_back( m );
+  ++length_;
+  return *m;
+}
+
+CompoundMessage &CompoundArrayMessage::append( CompoundMessage &&message )
+{
+  return push_back( std::move( message ));
+}
 }
@@ -13,393 +13,622 @@ namespace ros_babel_fish
 
 
 CompoundMessage *CompoundMessage::fromStream( const MessageTemplate::ConstPtr &msg_template, const uint8_t *stream,
-                                              size_t stream_length, size_t &bytes_read )
+                                              size_t stream_length, size_t &bytes_read, MessageArena *arena,
+                                              bool lazy )
 {
-  using namespace message_type_traits;
-  auto *result = new CompoundMessage( msg_template, stream );
+  DecodeProgram::ConstPtr program = getDecodeProgram( *msg_template );
 
-  for ( auto &sub_template : msg_template->compound.types )
+  auto *result = arena == nullptr ? new CompoundMessage( msg_template, stream )
+                                  : arena->create<CompoundMessage>( msg_template, stream );
+  result->stream_begin_ = static_cast<uint32_t>(bytes_read);
+  try
   {
-    switch ( sub_template->type )
+    if ( lazy )
     {
-      case MessageTypes::Compound:
-        result->values_.push_back( CompoundMessage::fromStream( sub_template, stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Bool:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Bool>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::UInt8:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::UInt8>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::UInt16:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::UInt16>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::UInt32:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::UInt32>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::UInt64:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::UInt64>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Int8:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Int8>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Int16:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Int16>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Int32:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Int32>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Int64:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Int64>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Float32:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Float32>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Float64:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Float64>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::String:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::String>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Time:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Time>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Duration:
-        result->values_.push_back(
-          ValueMessage<value_type<MessageTypes::Duration>::value>::fromStream( stream, stream_length, bytes_read ));
-        break;
-      case MessageTypes::Array:
+      const std::vector<DecodeField> &fields = program->fields;
+      result->offsets_.reserve( fields.size() + 1 );
+      for ( auto &field : fields )
       {
-        ssize_t length = sub_template->array.length;
-        switch ( sub_template->array.element_type )
+        result->offsets_.push_back( static_cast<uint32_t>(bytes_read));
+        if ( field.is_fixed_size )
         {
-          case MessageTypes::Bool:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Bool>::value>::fromStream( length, stream, stream_length,
-                                                                               bytes_read ));
-            break;
-          case MessageTypes::UInt8:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::UInt8>::value>::fromStream( length, stream,
-                                                                                stream_length, bytes_read ));
-            break;
-          case MessageTypes::UInt16:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::UInt16>::value>::fromStream( length, stream,
-                                                                                 stream_length, bytes_read ));
-            break;
-          case MessageTypes::UInt32:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::UInt32>::value>::fromStream( length, stream,
-                                                                                 stream_length, bytes_read ));
-            break;
-          case MessageTypes::UInt64:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::UInt64>::value>::fromStream( length, stream,
-                                                                                 stream_length, bytes_read ));
-            break;
-          case MessageTypes::Int8:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Int8>::value>::fromStream( length, stream, stream_length,
-                                                                               bytes_read ));
-            break;
-          case MessageTypes::Int16:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Int16>::value>::fromStream( length, stream,
-                                                                                stream_length, bytes_read ));
-            break;
-          case MessageTypes::Int32:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Int32>::value>::fromStream( length, stream,
-                                                                                stream_length, bytes_read ));
-            break;
-          case MessageTypes::Int64:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Int64>::value>::fromStream( length, stream,
-                                                                                stream_length, bytes_read ));
-            break;
-          case MessageTypes::Float32:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Float32>::value>::fromStream( length, stream,
-                                                                                  stream_length, bytes_read ));
-            break;
-          case MessageTypes::Float64:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Float64>::value>::fromStream( length, stream,
-                                                                                  stream_length, bytes_read ));
-            break;
-          case MessageTypes::String:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::String>::value>::fromStream( length, stream,
-                                                                                 stream_length, bytes_read ));
-            break;
-          case MessageTypes::Time:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Time>::value>::fromStream( length, stream, stream_length,
-                                                                               bytes_read ));
-            break;
-          case MessageTypes::Duration:
-            result->values_.push_back(
-              ArrayMessage<value_type<MessageTypes::Duration>::value>::fromStream( length, stream,
-                                                                                   stream_length, bytes_read ));
-            break;
-          case MessageTypes::Compound:
-            result->values_.push_back(
-              CompoundArrayMessage::fromStream( length, sub_template->array.element_template, stream,
-                                                stream_length, bytes_read ));
-            break;
-          case MessageTypes::Array:
-          case MessageTypes::None:
-            // These don't exist here
-            break;
+          bytes_read += field.fixed_size;
+          if ( bytes_read > stream_length )
+            throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
+          continue;
         }
+        field.skip( field, stream, stream_length, bytes_read );
       }
-      case MessageTypes::None:
-        break;
+      result->offsets_.push_back( static_cast<uint32_t>(bytes_read));
+      result->values_.resize( fields.size(), nullptr );
+      result->program_ = std::move( program );
+      result->arena_ = arena;
+      result->stream_end_ = static_cast<uint32_t>(bytes_read);
+      return result;
     }
+    const uint8_t *block = nullptr;
+    size_t position = bytes_read;
+    runDecodeProgram( *program, 0, result, stream, stream_length, bytes_read, block, position, arena );
+    result->stream_end_ = static_cast<uint32_t>(bytes_read);
+  }
+  catch ( ... )
+  {
+    destroy( result );
+    throw;
   }
   return result;
 }
 
+size_t CompoundMessage::runDecodeProgram( const DecodeProgram &program, size_t index, CompoundMessage *target,
+                                          const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                          const uint8_t *&block, size_t &position, MessageArena *arena )
+{
+  const std::vector<DecodeOperation> &operations = program.operations;
+  while ( index < operations.size())
+  {
+    const DecodeOperation &operation = operations[index++];
+    switch ( operation.type )
+    {
+      case DecodeOperationTypes::FixedBlock:
+        block = stream + bytes_read;
+        bytes_read += operation.value;
+        if ( bytes_read > stream_length )
+          throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
+        break;
+      case DecodeOperationTypes::FixedField:
+        target->values_.push_back( operation.decode_fixed( *operation.msg_template, block + operation.value, arena ));
+        position = (block - stream) + operation.value + operation.size;
+        break;
+      case DecodeOperationTypes::VariableField:
+        target->values_.push_back(
+          operation.decode_variable( operation.msg_template, stream, stream_length, bytes_read, arena ));
+        position = bytes_read;
+        break;
+      case DecodeOperationTypes::BeginCompound:
+      {
+        auto *compound = arena == nullptr ? new CompoundMessage( operation.msg_template, stream )
+                                          : arena->create<CompoundMessage>( operation.msg_template, stream );
+        target->values_.push_back( compound );
+        // Fields are decoded in stream order, hence, the nested message starts where the previous field ended
+        compound->stream_begin_ = static_cast<uint32_t>(position);
+        index = runDecodeProgram( program, index, compound, stream, stream_length, bytes_read, block, position,
+                                  arena );
+        compound->stream_end_ = static_cast<uint32_t>(position);
+        break;
+      }
+      case DecodeOperationTypes::EndCompound:
+        return index;
+    }
+  }
+  return index;
+}
+
 CompoundMessage::CompoundMessage( const MessageTemplate::ConstPtr &msg_template, const uint8_t *stream )
-  : Message( MessageTypes::Compound, stream ), msg_template_( msg_template )
+  : Message( MessageTypes::Compound, stream ), msg_template_( msg_template ), modified_( false )
 {
   values_.reserve( msg_template->compound.types.size());
 }
 
-CompoundMessage::CompoundMessage( const MessageTemplate::ConstPtr &msg_template )
-  : Message( MessageTypes::Compound ), msg_template_( msg_template )
+namespace
+{
+//! Creates an empty message for the given template on the heap.
+Message *createEmptyMessage( const MessageTemplate::ConstPtr &sub_template )
 {
   using namespace message_type_traits;
-  values_.reserve( msg_template->compound.types.size());
-
-  for ( auto &sub_template : msg_template->compound.types )
+  switch ( sub_template->type )
   {
-    switch ( sub_template->type )
+    case MessageTypes::Compound:
+      return new CompoundMessage( sub_template );
+    case MessageTypes::Bool:
+      return new ValueMessage<value_type<MessageTypes::Bool>::value>();
+    case MessageTypes::UInt8:
+      return new ValueMessage<value_type<MessageTypes::UInt8>::value>();
+    case MessageTypes::UInt16:
+      return new ValueMessage<value_type<MessageTypes::UInt16>::value>();
+    case MessageTypes::UInt32:
+      return new ValueMessage<value_type<MessageTypes::UInt32>::value>();
+    case MessageTypes::UInt64:
+      return new ValueMessage<value_type<MessageTypes::UInt64>::value>();
+    case MessageTypes::Int8:
+      return new ValueMessage<value_type<MessageTypes::Int8>::value>();
+    case MessageTypes::Int16:
+      return new ValueMessage<value_type<MessageTypes::Int16>::value>();
+    case MessageTypes::Int32:
+      return new ValueMessage<value_type<MessageTypes::Int32>::value>();
+    case MessageTypes::Int64:
+      return new ValueMessage<value_type<MessageTypes::Int64>::value>();
+    case MessageTypes::Float32:
+      return new ValueMessage<value_type<MessageTypes::Float32>::value>();
+    case MessageTypes::Float64:
+      return new ValueMessage<value_type<MessageTypes::Float64>::value>();
+    case MessageTypes::String:
+      return new ValueMessage<value_type<MessageTypes::String>::value>();
+    case MessageTypes::Time:
+      return new ValueMessage<value_type<MessageTypes::Time>::value>();
+    case MessageTypes::Duration:
+      return new ValueMessage<value_type<MessageTypes::Duration>::value>();
+    case MessageTypes::Array:
     {
-      case MessageTypes::Compound:
-        values_.push_back( new CompoundMessage( sub_template ));
-        break;
-      case MessageTypes::Bool:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Bool>::value>());
-        break;
-      case MessageTypes::UInt8:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::UInt8>::value>());
-        break;
-      case MessageTypes::UInt16:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::UInt16>::value>());
-        break;
-      case MessageTypes::UInt32:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::UInt32>::value>());
-        break;
-      case MessageTypes::UInt64:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::UInt64>::value>());
-        break;
-      case MessageTypes::Int8:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Int8>::value>());
-        break;
-      case MessageTypes::Int16:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Int16>::value>());
-        break;
-      case MessageTypes::Int32:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Int32>::value>());
-        break;
-      case MessageTypes::Int64:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Int64>::value>());
-        break;
-      case MessageTypes::Float32:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Float32>::value>());
-        break;
-      case MessageTypes::Float64:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Float64>::value>());
-        break;
-      case MessageTypes::String:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::String>::value>());
-        break;
-      case MessageTypes::Time:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Time>::value>());
-        break;
-      case MessageTypes::Duration:
-        values_.push_back( new ValueMessage<value_type<MessageTypes::Duration>::value>());
-        break;
-      case MessageTypes::Array:
+      bool fixed_length = sub_template->array.length >= 0;
+      size_t length = fixed_length ? sub_template->array.length : 0;
+      switch ( sub_template->array.element_type )
       {
-        bool fixed_length = sub_template->array.length >= 0;
-        size_t length = fixed_length ? sub_template->array.length : 0;
-        switch ( sub_template->array.element_type )
-        {
-          case MessageTypes::Bool:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Bool>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::UInt8:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::UInt8>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::UInt16:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::UInt16>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::UInt32:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::UInt32>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::UInt64:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::UInt64>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Int8:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Int8>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Int16:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Int16>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Int32:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Int32>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Int64:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Int64>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Float32:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Float32>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Float64:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Float64>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::String:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::String>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Time:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Time>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Duration:
-            values_.push_back( new ArrayMessage<value_type<MessageTypes::Duration>::value>( length, fixed_length ));
-            break;
-          case MessageTypes::Compound:
-            values_.push_back(
-              new CompoundArrayMessage( sub_template->array.element_template, length, fixed_length ));
-            break;
-          case MessageTypes::Array:
-          case MessageTypes::None:
-            // These don't exist here
-            break;
-        }
-        break;
+        case MessageTypes::Bool:
+          return new ArrayMessage<value_type<MessageTypes::Bool>::value>( length, fixed_length );
+        case MessageTypes::UInt8:
+          return new ArrayMessage<value_type<MessageTypes::UInt8>::value>( length, fixed_length );
+        case MessageTypes::UInt16:
+          return new ArrayMessage<value_type<MessageTypes::UInt16>::value>( length, fixed_length );
+        case MessageTypes::UInt32:
+          return new ArrayMessage<value_type<MessageTypes::UInt32>::value>( length, fixed_length );
+        case MessageTypes::UInt64:
+          return new ArrayMessage<value_type<MessageTypes::UInt64>::value>( length, fixed_length );
+        case MessageTypes::Int8:
+          return new ArrayMessage<value_type<MessageTypes::Int8>::value>( length, fixed_length );
+        case MessageTypes::Int16:
+          return new ArrayMessage<value_type<MessageTypes::Int16>::value>( length, fixed_length );
+        case MessageTypes::Int32:
+          return new ArrayMessage<value_type<MessageTypes::Int32>::value>( length, fixed_length );
+        case MessageTypes::Int64:
+          return new ArrayMessage<value_type<MessageTypes::Int64>::value>( length, fixed_length );
+        case MessageTypes::Float32:
+          return new ArrayMessage<value_type<MessageTypes::Float32>::value>( length, fixed_length );
+        case MessageTypes::Float64:
+          return new ArrayMessage<value_type<MessageTypes::Float64>::value>( length, fixed_length );
+        case MessageTypes::String:
+          return new ArrayMessage<value_type<MessageTypes::String>::value>( length, fixed_length );
+        case MessageTypes::Time:
+          return new ArrayMessage<value_type<MessageTypes::Time>::value>( length, fixed_length );
+        case MessageTypes::Duration:
+          return new ArrayMessage<value_type<MessageTypes::Duration>::value>( length, fixed_length );
+        case MessageTypes::Compound:
+          return new CompoundArrayMessage( sub_template->array.element_template, length, fixed_length );
+        case MessageTypes::Array:
+        case MessageTypes::None:
+          // These don't exist here
+          break;
       }
-      case MessageTypes::None:
-        values_.push_back( nullptr );
-        break;
+      break;
     }
+    case MessageTypes::None:
+      return nullptr;
   }
+
+  return nullptr;
+}
+
+//! Checks whether the given message can be serialized as a field with the given template.
+bool matchesTemplate( const Message &message, const MessageTemplate &msg_template )
+{
+  if ( message.type() != msg_template.type ) return false;
+  if ( msg_template.type == MessageTypes::Compound )
+    return message.asUnchecked<CompoundMessage>().datatype() == msg_template.compound.datatype;
+  if ( msg_template.type != MessageTypes::Array ) return true;
+  const auto &array = message.asUnchecked<ArrayMessageBase>();
+  if ( array.elementType() != msg_template.array.element_type ) return false;
+  // The length of fixed size arrays is not serialized, hence, it has to match exactly
+  if ( array.isFixedSize() != (msg_template.array.length >= 0)) return false;
+  if ( array.isFixedSize() && array.length() != static_cast<size_t>(msg_template.array.length)) return false;
+  return array.elementType() != MessageTypes::Compound ||
+         array.asUnchecked<CompoundArrayMessage>().elementDataType() ==
+         msg_template.array.element_template->compound.datatype;
+}
+}
+
+CompoundMessage::CompoundMessage( const MessageTemplate::ConstPtr &msg_template )
+  : Message( MessageTypes::Compound ), msg_template_( msg_template )
+{
+  values_.reserve( msg_template->compound.types.size());
+
+  for ( auto &sub_template : msg_template->compound.types )
+  {
+    values_.push_back( createEmptyMessage( sub_template ));
+  }
+}
+
+CompoundMessage::CompoundMessage( CompoundMessage &&other ) noexcept
+  : Message( std::move( other )), msg_template_( other.msg_template_ ), values_( std::move( other.values_ ))
+    , offsets_( std::move( other.offsets_ )), program_( std::move( other.program_ )), arena_( other.arena_ )
+    , stream_begin_( other.stream_begin_ ), stream_end_( other.stream_end_ ), modified_( other.modified_ )
+{
+  other.resetMovedFrom();
 }
 
 CompoundMessage::~CompoundMessage()
 {
   for ( auto &value : values_ )
   {
-    delete value;
+    removeOwner( value );
   }
   values_.clear();
 }
 
-Message &CompoundMessage::operator[]( const std::string &key )
+Message *CompoundMessage::child( size_t index ) const
+{
+  Message *value = values_[index];
+  if ( value == nullptr && isLazy()) value = createChild( index );
+  return value;
+}
+
+Message *CompoundMessage::mutableChild( size_t index ) const
+{
+  child( index );
+  makeExclusive( values_[index] );
+  return values_[index];
+}
+
+Message *CompoundMessage::createChild( size_t index ) const
+{
+  Message *result = decodeChild( index, arena_, true );
+  values_[index] = result;
+  return result;
+}
+
+Message *CompoundMessage::decodeChild( size_t index, MessageArena *arena, bool lazy ) const
+{
+  const DecodeField &field = program_->fields[index];
+  size_t bytes_read = offsets_[index];
+  size_t end = offsets_[index + 1];
+  if ( field.msg_template->type == MessageTypes::Compound )
+  {
+    return CompoundMessage::fromStream( field.msg_template, stream_, end, bytes_read, arena, lazy );
+  }
+  if ( field.msg_template->type == MessageTypes::Array &&
+       field.msg_template->array.element_type == MessageTypes::Compound )
+  {
+    return CompoundArrayMessage::fromStream( field.msg_template->array.length,
+                                             field.msg_template->array.element_template, stream_, end, bytes_read,
+                                             arena, lazy );
+  }
+  if ( field.decode_fixed != nullptr )
+  {
+    return field.decode_fixed( *field.msg_template, stream_ + bytes_read, arena );
+  }
+  return field.decode_variable( field.msg_template, stream_, end, bytes_read, arena );
+}
+
+Message *CompoundMessage::cloneChild( size_t index ) const
+{
+  if ( values_[index] != nullptr || !isLazy()) return values_[index]->clone();
+  // Children that were not accessed yet are decoded directly into the clone instead of creating them in this message
+  Message *result = decodeChild( index, nullptr, false );
+  result->detachFromStream();
+  return result;
+}
+
+const std::vector<Message *> &CompoundMessage::values() const
+{
+  modified_ = true;
+  for ( size_t i = 0; i < values_.size(); ++i ) mutableChild( i );
+  return values_;
+}
+
+const Message *CompoundMessage::childAt( size_t index ) const
+{
+  if ( index >= values_.size()) throw std::runtime_error( "Index out of compound message bounds!" );
+  return child( index );
+}
+
+size_t CompoundMessage::indexOf( const MessageTemplate &msg_template, const std::string &key )
 {
-  for ( size_t i = 0; i < msg_template_->compound.names.size(); ++i )
+  const auto &name_indices = msg_template.compound.name_indices;
+  if ( !name_indices.empty())
   {
-    if ( msg_template_->compound.names[i] == key ) return *values_[i];
+    auto it = name_indices.find( key );
+    return it == name_indices.end() ? static_cast<size_t>(-1) : it->second;
   }
-  throw std::runtime_error( "Invalid key!" );
+  // Templates that were not created by a DescriptionProvider have no index
+  const std::vector<std::string> &names = msg_template.compound.names;
+  auto it = std::find( names.begin(), names.end(), key );
+  return it == names.end() ? static_cast<size_t>(-1) : static_cast<size_t>(it - names.begin());
+}
+
+Message &CompoundMessage::operator[]( const std::string &key )
+{
+  size_t index = indexOf( *msg_template_, key );
+  if ( index == static_cast<size_t>(-1)) throw std::runtime_error( "Invalid key!" );
+  modified_ = true;
+  return *mutableChild( index );
 }
 
 const Message &CompoundMessage::operator[]( const std::string &key ) const
 {
-  for ( size_t i = 0; i < msg_template_->compound.names.size(); ++i )
+  size_t index = indexOf( *msg_template_, key );
+  if ( index == static_cast<size_t>(-1)) throw std::runtime_error( "Invalid key!" );
+  return *child( index );
+}
+
+Message *CompoundMessage::child( const FieldHandle &handle, bool modify ) const
+{
+  const MessageTemplate::ConstPtr &root_template = handle.rootTemplate();
+  if ( root_template == nullptr )
+    throw BabelFishException( "Tried to access field of '" + msg_template_->compound.datatype +
+                              "' message with an invalid field handle!" );
+  // A handle created with a different template can only be used if it describes the same version of the type.
+  // Templates that were created manually have no MD5 sum, hence, the handle has to be created with the same template.
+  if ( root_template != msg_template_ &&
+       (root_template->compound.datatype != msg_template_->compound.datatype ||
+        root_template->compound.md5.empty() || root_template->compound.md5 != msg_template_->compound.md5))
+    throw BabelFishException( "Tried to access field of '" + msg_template_->compound.datatype + "' message (MD5: " +
+                              msg_template_->compound.md5 + ") with a field handle for '" +
+                              root_template->compound.datatype + "' (MD5: " + root_template->compound.md5 + ")!" );
+  const std::vector<size_t> &indices = handle.indices();
+  const CompoundMessage *message = this;
+  for ( size_t i = 0; i + 1 < indices.size(); ++i )
+  {
+    if ( modify ) message->modified_ = true;
+    Message *next = modify ? message->mutableChild( indices[i] ) : message->child( indices[i] );
+    // The template guarantees that all fields along the path are compound messages
+    message = &next->asUnchecked<CompoundMessage>();
+  }
+  if ( !modify ) return message->child( indices.back());
+  message->modified_ = true;
+  return message->mutableChild( indices.back());
+}
+
+Message &CompoundMessage::operator[]( const FieldHandle &handle ) { return *child( handle, true ); }
+
+const Message &CompoundMessage::operator[]( const FieldHandle &handle ) const { return *child( handle, false ); }
+
+Message *CompoundMessage::release( const std::string &key )
+{
+  size_t index = indexOf( *msg_template_, key );
+  if ( index == static_cast<size_t>(-1)) throw std::runtime_error( "Invalid key!" );
+  // The caller owns the result, hence, it must not be shared with copy-on-write clones
+  Message *result = mutableChild( index );
+  if ( Message::isArenaAllocated( result ))
   {
-    if ( msg_template_->compound.names[i] == key ) return *values_[i];
+    // The caller deletes the result, hence, children living in a MessageArena are copied to the heap
+    Message *copy = result->clone();
+    removeOwner( result );
+    result = copy;
   }
-  throw std::runtime_error( "Invalid key!" );
+  values_[index] = createEmptyMessage( msg_template_->compound.types[index] );
+  modified_ = true;
+  return result;
+}
+
+void CompoundMessage::replace( const std::string &key, Message *value )
+{
+  size_t index = indexOf( *msg_template_, key );
+  if ( index == static_cast<size_t>(-1)) throw std::runtime_error( "Invalid key!" );
+  if ( value == nullptr || !matchesTemplate( *value, *msg_template_->compound.types[index] ))
+    throw BabelFishException( "Tried to replace field '" + key + "' of '" + datatype() +
+                              "' message with a message of a different type!" );
+  modified_ = true;
+  if ( values_[index] == value ) return;
+  removeOwner( values_[index] );
+  values_[index] = value;
 }
 
 bool CompoundMessage::containsKey( const std::string &key ) const
 {
-  return std::find( msg_template_->compound.names.begin(), msg_template_->compound.names.end(), key ) !=
-         msg_template_->compound.names.end();
+  return indexOf( *msg_template_, key ) != static_cast<size_t>(-1);
 }
 
 size_t CompoundMessage::_sizeInBytes() const
 {
+  if ( !_isModified()) return _streamSize();
   size_t result = 0;
-  for ( auto &value : values_ )
+  for ( size_t i = 0; i < values_.size(); ++i )
   {
-    result += value->_sizeInBytes();
+    if ( values_[i] == nullptr && isLazy())
+      result += offsets_[i + 1] - offsets_[i];
+    else
+      result += values_[i]->_sizeInBytes();
   }
   return result;
 }
 
 bool CompoundMessage::isDetachedFromStream() const
 {
+  // Unmodified messages are copied from the stream when they are serialized
+  if ( !_isModified()) return false;
   for ( auto &value : values_ )
   {
-    if ( !value->isDetachedFromStream()) return false;
+    if ( value == nullptr || !value->isDetachedFromStream()) return false;
   }
   return true;
 }
 
 void CompoundMessage::detachFromStream()
 {
-  for ( auto &value : values_ )
+  for ( size_t i = 0; i < values_.size(); ++i )
   {
-    value->detachFromStream();
+    mutableChild( i )->detachFromStream();
   }
+  // The stream may be destroyed from now on, hence, it must not be used to patch or copy unchanged parts
+  stream_ = nullptr;
 }
 
 size_t CompoundMessage::writeToStream( uint8_t *stream ) const
 {
-  size_t offset = 0;
-  for ( auto &value : values_ )
+  OutputStream output( stream );
+  writeToStream( output );
+  return output.size();
+}
+
+void CompoundMessage::writeToStream( OutputStream &stream ) const
+{
+  if ( !_isModified())
+  {
+    // The entire subtree is unchanged and can be copied without visiting the children
+    size_t size = _streamSize();
+    if ( size > 0 ) std::memcpy( stream.advance( size ), stream_ + stream_begin_, size );
+    return;
+  }
+  for ( size_t i = 0; i < values_.size(); ++i )
   {
-    offset += value->writeToStream( stream + offset );
+    if ( values_[i] == nullptr && isLazy())
+    {
+      // Children that were never accessed are still unchanged
+      size_t size = offsets_[i + 1] - offsets_[i];
+      std::memcpy( stream.advance( size ), stream_ + offsets_[i], size );
+      continue;
+    }
+    values_[i]->writeToStream( stream );
   }
-  return offset;
+}
+
+bool CompoundMessage::_patchStream( const uint8_t *source, uint8_t *target, size_t offset, size_t size ) const
+{
+  // Unchanged subtrees are already contained in the copy and are skipped without visiting their children
+  if ( _isUnchangedAt( source, offset )) return _streamSize() == size;
+  DecodeProgram::ConstPtr program = isLazy() ? program_ : getDecodeProgram( *msg_template_ );
+  const std::vector<DecodeField> &fields = program->fields;
+  if ( fields.size() != values_.size()) return false;
+  size_t end = offset + size;
+  for ( size_t i = 0; i < values_.size(); ++i )
+  {
+    Message *value = values_[i];
+    if ( value != nullptr && value->type() == MessageTypes::Compound &&
+         value->asUnchecked<CompoundMessage>()._isUnchangedAt( source, offset ))
+    {
+      offset += value->asUnchecked<CompoundMessage>()._streamSize();
+      continue;
+    }
+    // The copy still contains the original bytes from offset on, hence, the size of the field that is replaced is read
+    // from it
+    const DecodeField &field = fields[i];
+    size_t field_end = offset;
+    if ( field.is_fixed_size )
+    {
+      field_end += field.fixed_size;
+      if ( field_end > end ) return false;
+    }
+    else
+    {
+      field.skip( field, target, end, field_end );
+    }
+    if ( value == nullptr && isLazy())
+    {
+      // Children that were never accessed are unchanged but may have been read from a different position
+      size_t child_size = offsets_[i + 1] - offsets_[i];
+      if ( child_size != field_end - offset ) return false;
+      if ( stream_ != source || offsets_[i] != offset )
+        std::memcpy( target + offset, stream_ + offsets_[i], child_size );
+    }
+    else if ( !value->_patchStream( source, target, offset, field_end - offset ))
+    {
+      return false;
+    }
+    offset = field_end;
+  }
+  return offset == end;
+}
+
+void CompoundMessage::materialize( const Message &message )
+{
+  if ( message.type() == MessageTypes::Compound )
+  {
+    const auto &compound = message.as<CompoundMessage>();
+    for ( size_t i = 0; i < compound.values_.size(); ++i ) materialize( *compound.child( i ));
+  }
+  else if ( ArrayMessage<Message>::isInstance( message ))
+  {
+    const auto &array = message.as<ArrayMessage<Message>>();
+    for ( size_t i = 0; i < array.length(); ++i ) materialize( array[i] );
+  }
+}
+
+void CompoundMessage::copyStreamState( const CompoundMessage &other )
+{
+  offsets_ = other.offsets_;
+  program_ = other.program_;
+  // Children created later are allocated on the heap since the copy may outlive the arena of other
+  arena_ = nullptr;
+  stream_begin_ = other.stream_begin_;
+  stream_end_ = other.stream_end_;
+  modified_ = other.modified_;
 }
 
 CompoundMessage &CompoundMessage::operator=( const CompoundMessage &other )
 {
-  stream_ = other.stream_;
+  if ( this == &other ) return *this;
   msg_template_ = other.msg_template_;
   for ( auto &value : values_ )
   {
-    delete value;
+    removeOwner( value );
   }
   values_.clear();
   values_.reserve( other.values_.size());
-  std::transform( other.values_.begin(), other.values_.end(), std::back_inserter( values_ ),
-                  []( Message *m ) { return m->clone(); } );
+  for ( size_t i = 0; i < other.values_.size(); ++i ) values_.push_back( other.cloneChild( i ));
+  // The copy is independent of the stream of other, hence, it is serialized field by field
+  clearStreamState();
   return *this;
 }
 
+CompoundMessage &CompoundMessage::operator=( CompoundMessage &&other )
+{
+  if ( this == &other ) return *this;
+  for ( auto &value : values_ )
+  {
+    removeOwner( value );
+  }
+  stream_ = other.stream_;
+  msg_template_ = other.msg_template_;
+  values_ = std::move( other.values_ );
+  offsets_ = std::move( other.offsets_ );
+  program_ = std::move( other.program_ );
+  arena_ = other.arena_;
+  stream_begin_ = other.stream_begin_;
+  stream_end_ = other.stream_end_;
+  modified_ = other.modified_;
+  other.resetMovedFrom();
+  return *this;
+}
+
+void CompoundMessage::resetMovedFrom()
+{
+  values_.clear();
+  clearStreamState();
+}
+
+void CompoundMessage::clearStreamState()
+{
+  offsets_.clear();
+  program_ = nullptr;
+  arena_ = nullptr;
+  stream_ = nullptr;
+  stream_begin_ = stream_end_ = 0;
+  modified_ = true;
+}
+
 void CompoundMessage::assign( const Message &other )
 {
-  auto o = dynamic_cast<const CompoundMessage *>(&other);
-  if ( o == nullptr ) throw BabelFishException( "Tried to assign incompatible Message type to CompoundMessage!" );
-  *this = *o;
+  if ( !isInstance( other ))
+    throw BabelFishException( "Tried to assign incompatible Message type to CompoundMessage!" );
+  *this = other.asUnchecked<CompoundMessage>();
+}
+
+void CompoundMessage::assign( Message &&other )
+{
+  if ( !isInstance( other ))
+    throw BabelFishException( "Tried to assign incompatible Message type to CompoundMessage!" );
+  *this = std::move( other.asUnchecked<CompoundMessage>());
 }
 
 Message *CompoundMessage::clone() const
 {
-  // Use overload that does not initialize values
+  // Use overload that does not initialize values. The clone does not reference the stream of this message.
   auto result = new CompoundMessage( msg_template_, nullptr );
   result->values_.reserve( values_.size());
-  std::transform( values_.begin(), values_.end(), std::back_inserter( result->values_ ),
-                  []( Message *m ) { return m->clone(); } );
+  for ( size_t i = 0; i < values_.size(); ++i ) result->values_.push_back( cloneChild( i ));
+  result->modified_ = true;
+  return result;
+}
+
+Message *CompoundMessage::cloneShared() const
+{
+  auto result = new CompoundMessage( msg_template_, stream_ );
+  result->values_ = values_;
+  for ( Message *value : values_ )
+  {
+    if ( value == nullptr ) continue;
+    materialize( *value );
+    addOwner( value );
+  }
+  result->copyStreamState( *this );
   return result;
 }
 }
@@ -0,0 +1,39 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/messages/field_handle.h"
+#include "ros_babel_fish/exceptions/invalid_message_path_exception.h"
+#include "ros_babel_fish/messages/compound_message.h"
+
+namespace ros_babel_fish
+{
+
+FieldHandle::FieldHandle() = default;
+
+FieldHandle::FieldHandle( MessageTemplate::ConstPtr msg_template, const std::string &path )
+{
+  if ( msg_template == nullptr || msg_template->type != MessageTypes::Compound )
+    throw InvalidMessagePathException( "Field handles can only be created for compound messages!" );
+  if ( path.empty() || path == "." ) throw InvalidMessagePathException( "Path was empty!" );
+  MessageTemplate::ConstPtr current = msg_template;
+  std::string::size_type start = path[0] == '.' ? 1 : 0;
+  while ( true )
+  {
+    if ( current->type != MessageTypes::Compound )
+      throw InvalidMessagePathException( "Path '" + path + "' is invalid because '" + path.substr( 0, start - 1 ) +
+                                         "' is not a compound message!" );
+    std::string::size_type end = path.find( '.', start );
+    std::string name = path.substr( start, end == std::string::npos ? std::string::npos : end - start );
+    size_t index = CompoundMessage::indexOf( *current, name );
+    if ( index == static_cast<size_t>(-1))
+      throw InvalidMessagePathException( "Path '" + path + "' is invalid because '" + current->compound.datatype +
+                                         "' has no field '" + name + "'!" );
+    indices_.push_back( index );
+    current = current->compound.types[index];
+    if ( end == std::string::npos ) break;
+    start = end + 1;
+  }
+  root_template_ = std::move( msg_template );
+  msg_template_ = std::move( current );
+}
+} // ros_babel_fish
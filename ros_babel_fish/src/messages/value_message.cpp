@@ -22,14 +22,15 @@ template<>
 size_t ValueMessage<bool>::_sizeInBytes() const { return 1; }
 
 template<>
-ValueMessage<bool> *ValueMessage<bool>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read )
+ValueMessage<bool> *ValueMessage<bool>::fromStream( const uint8_t *stream, size_t stream_length, size_t &bytes_read,
+                                                    MessageArena *arena )
 {
   (void) stream_length; // For unused warning
   uint8_t val = *reinterpret_cast<const uint8_t *>(stream + bytes_read);
   ++bytes_read;
   if ( bytes_read > stream_length )
     throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-  return new ValueMessage<bool>( val != 0 );
+  return internal::createMessage<ValueMessage<bool>>( arena, val != 0 );
 }
 
 template<>
@@ -64,7 +65,7 @@ size_t ValueMessage<ros::Time>::_sizeInBytes() const { return 8; }
 
 template<>
 ValueMessage<ros::Time> *ValueMessage<ros::Time>::fromStream( const uint8_t *stream, size_t stream_length,
-                                                              size_t &bytes_read )
+                                                              size_t &bytes_read, MessageArena *arena )
 {
   (void) stream_length; // For unused warning
   uint32_t secs = *reinterpret_cast<const uint32_t *>(stream + bytes_read);
@@ -72,7 +73,7 @@ ValueMessage<ros::Time> *ValueMessage<ros::Time>::fromStream( const uint8_t *str
   bytes_read += 8;
   if ( bytes_read > stream_length )
     throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-  return new ValueMessage<ros::Time>( ros::Time( secs, nsecs ));
+  return internal::createMessage<ValueMessage<ros::Time>>( arena, ros::Time( secs, nsecs ));
 }
 
 template<>
@@ -108,7 +109,7 @@ size_t ValueMessage<ros::Duration>::_sizeInBytes() const { return 8; }
 
 template<>
 ValueMessage<ros::Duration> *ValueMessage<ros::Duration>::fromStream( const uint8_t *stream, size_t stream_length,
-                                                                      size_t &bytes_read )
+                                                                      size_t &bytes_read, MessageArena *arena )
 {
   (void) stream_length; // For unused warning
   int32_t secs = *reinterpret_cast<const int32_t *>(stream + bytes_read);
@@ -116,7 +117,7 @@ ValueMessage<ros::Duration> *ValueMessage<ros::Duration>::fromStream( const uint
   bytes_read += 8;
   if ( bytes_read > stream_length )
     throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-  return new ValueMessage<ros::Duration>( ros::Duration( secs, nsecs ));
+  return internal::createMessage<ValueMessage<ros::Duration>>( arena, ros::Duration( secs, nsecs ));
 }
 
 template<>
@@ -155,7 +156,7 @@ size_t ValueMessage<std::string>::_sizeInBytes() const
 
 template<>
 ValueMessage<std::string> *ValueMessage<std::string>::fromStream( const uint8_t *stream, size_t stream_length,
-                                                                  size_t &bytes_read )
+                                                                  size_t &bytes_read, MessageArena *arena )
 {
   (void) stream_length; // For unused warning
   const uint8_t *begin = stream + bytes_read;
@@ -163,7 +164,7 @@ ValueMessage<std::string> *ValueMessage<std::string>::fromStream( const uint8_t
   bytes_read += len + sizeof( uint32_t );
   if ( bytes_read > stream_length )
     throw BabelFishException( "Unexpected end of stream while reading message from stream!" );
-  return new ValueMessage<std::string>( begin );
+  return internal::createMessage<ValueMessage<std::string>>( arena, begin );
 }
 
 template<>
@@ -0,0 +1,41 @@
+// Copyright (c) 2019 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ros_babel_fish/output_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace ros_babel_fish
+{
+
+OutputStream::OutputStream( uint8_t *buffer )
+  : data_( buffer ), size_( 0 ), capacity_( std::numeric_limits<size_t>::max())
+{
+}
+
+OutputStream::OutputStream( BufferPool::Ptr pool, size_t initial_capacity )
+  : pool_( std::move( pool )), data_( nullptr ), size_( 0 ), capacity_( 0 )
+{
+  if ( initial_capacity > 0 ) grow( initial_capacity );
+}
+
+void OutputStream::grow( size_t size )
+{
+  size_t capacity = std::max( 2 * capacity_, size_ + size );
+  boost::shared_array<uint8_t> buffer;
+  if ( pool_ == nullptr )
+  {
+    buffer.reset( new uint8_t[capacity] );
+  }
+  else
+  {
+    buffer = pool_->acquire( capacity, capacity );
+  }
+  if ( size_ > 0 ) std::memcpy( buffer.get(), data_, size_ );
+  buffer_ = std::move( buffer );
+  data_ = buffer_.get();
+  capacity_ = capacity;
+}
+}
@@ -4,8 +4,10 @@
 
 #include "message_comparison.h"
 
+#include <ros_babel_fish/exceptions/invalid_message_path_exception.h>
 #include <ros_babel_fish/generation/message_creation.h>
 #include <ros_babel_fish/generation/message_template.h>
+#include <ros_babel_fish/generation/providers/message_only_description_provider.h>
 #include <ros_babel_fish/messages/internal/value_compatibility.h>
 #include <ros_babel_fish/babel_fish.h>
 
@@ -13,6 +15,8 @@
 #include <gtest/gtest.h>
 #include <ros/ros.h>
 
+#include <thread>
+
 using namespace ros_babel_fish;
 
 template<typename T>
@@ -41,6 +45,34 @@ template<typename T1, typename T2>
   return ::testing::AssertionSuccess();
 }
 
+/*!
+ * Creates the template of a random_type/Items message with the fields int32 seq, Item first and Item[] items where
+ * random_type/Item consists of int32 id and string name.
+ */
+MessageTemplate::Ptr createItemsTemplate()
+{
+  MessageTemplate::Ptr id_tmpl = std::make_shared<MessageTemplate>();
+  id_tmpl->type = MessageTypes::Int32;
+  MessageTemplate::Ptr name_tmpl = std::make_shared<MessageTemplate>();
+  name_tmpl->type = MessageTypes::String;
+  MessageTemplate::Ptr item_tmpl = std::make_shared<MessageTemplate>();
+  item_tmpl->type = MessageTypes::Compound;
+  item_tmpl->compound.datatype = "random_type/Item";
+  item_tmpl->compound.names = { "id", "name" };
+  item_tmpl->compound.types = { id_tmpl, name_tmpl };
+  MessageTemplate::Ptr items_tmpl = std::make_shared<MessageTemplate>();
+  items_tmpl->type = MessageTypes::Array;
+  items_tmpl->array.element_type = MessageTypes::Compound;
+  items_tmpl->array.element_template = item_tmpl;
+  items_tmpl->array.length = -1;
+  MessageTemplate::Ptr tmpl = std::make_shared<MessageTemplate>();
+  tmpl->type = MessageTypes::Compound;
+  tmpl->compound.datatype = "random_type/Items";
+  tmpl->compound.names = { "seq", "first", "items" };
+  tmpl->compound.types = { id_tmpl, item_tmpl, items_tmpl };
+  return tmpl;
+}
+
 TEST( MessageTest, message )
 {
   // UINT8
@@ -517,6 +549,80 @@ TEST( MessageTest, compoundMessage )
   EXPECT_TRUE( clone->containsKey( "OtherKey" ));
   EXPECT_THROW((*clone)["Invalid"], std::runtime_error );
   delete clone;
+
+  // Manually created templates have no name index and fall back to a linear search
+  EXPECT_EQ( CompoundMessage::indexOf( *tmpl, "OtherKey" ), 1U );
+  FieldHandle handle( tmpl, "OtherKey" );
+  EXPECT_EQ( &cm[handle], &cm["OtherKey"] );
+  EXPECT_EQ( &ccm[handle], &cm["OtherKey"] );
+}
+
+TEST( MessageTest, fieldHandle )
+{
+  BabelFish fish;
+  MessageDescription::ConstPtr description = fish.descriptionProvider()->getMessageDescription(
+    "geometry_msgs/PoseStamped" );
+  ASSERT_NE( description, nullptr );
+  const MessageTemplate::ConstPtr &msg_template = description->message_template;
+  EXPECT_EQ( msg_template->compound.name_indices.size(), msg_template->compound.names.size());
+  EXPECT_EQ( CompoundMessage::indexOf( *msg_template, "pose" ), 1U );
+  EXPECT_EQ( CompoundMessage::indexOf( *msg_template, "invalid" ), static_cast<size_t>(-1));
+
+  Message::Ptr msg = fish.createMessage( "geometry_msgs/PoseStamped" );
+  auto &compound = msg->as<CompoundMessage>();
+  compound["pose"]["position"]["y"] = 4.2;
+  compound["header"]["frame_id"] = "map";
+
+  FieldHandle y_handle( msg_template, "pose.position.y" );
+  ASSERT_TRUE( y_handle.isValid());
+  EXPECT_EQ( y_handle.messageTemplate()->type, MessageTypes::Float64 );
+  EXPECT_EQ( compound[y_handle].value<double>(), 4.2 );
+  EXPECT_EQ( &compound[y_handle], &compound["pose"]["position"]["y"] );
+  FieldHandle frame_handle( msg_template, ".header.frame_id" );
+  EXPECT_EQ( compound[frame_handle].value<std::string>(), "map" );
+  FieldHandle pose_handle( msg_template, "pose" );
+  EXPECT_EQ( pose_handle.messageTemplate()->compound.datatype, "geometry_msgs/Pose" );
+
+  EXPECT_THROW( FieldHandle( msg_template, "" ), InvalidMessagePathException );
+  EXPECT_THROW( FieldHandle( msg_template, "pose.invalid" ), InvalidMessagePathException );
+  EXPECT_THROW( FieldHandle( msg_template, "pose.position.x.y" ), InvalidMessagePathException );
+  EXPECT_THROW( compound[FieldHandle()], BabelFishException );
+  Message::Ptr header = fish.createMessage( "std_msgs/Header" );
+  EXPECT_THROW( header->as<CompoundMessage>()[y_handle], BabelFishException );
+}
+
+TEST( MessageTest, fieldHandleVersions )
+{
+  const std::string separator = "================================================================================\n";
+  MessageOnlyDescriptionProvider provider;
+  MessageDescription::ConstPtr v1 = provider.registerMessageByDefinition(
+    "test_pkg/Outer", "Inner inner\nint32 a\n" + separator + "MSG: test_pkg/Inner\nfloat64 x\n" );
+  MessageDescription::ConstPtr v2 = provider.registerMessageByDefinition(
+    "test_pkg/Outer", "int32 a\nInner inner\n" + separator + "MSG: test_pkg/Inner\nstring s\nfloat64 x\n" );
+  ASSERT_NE( v1, nullptr );
+  ASSERT_NE( v2, nullptr );
+  ASSERT_NE( v1->md5, v2->md5 );
+  EXPECT_EQ( v1->message_template->compound.md5, v1->md5 );
+
+  Message::Ptr msg_v1 = createEmptyMessageFromTemplate( v1->message_template );
+  Message::Ptr msg_v2 = createEmptyMessageFromTemplate( v2->message_template );
+  FieldHandle x_handle( v1->message_template, "inner.x" );
+  msg_v1->as<CompoundMessage>()[x_handle] = 4.2;
+  EXPECT_EQ( msg_v1->as<CompoundMessage>()["inner"]["x"].value<double>(), 4.2 );
+  // A handle for one version of a type must not be used with another version with a different layout
+  EXPECT_THROW( msg_v2->as<CompoundMessage>()[x_handle], BabelFishException );
+  const Message &const_msg_v2 = *msg_v2;
+  EXPECT_THROW( const_msg_v2.as<CompoundMessage>()[x_handle], BabelFishException );
+
+  // Handles can be used with other templates of the same version, e.g., from a different provider
+  MessageOnlyDescriptionProvider other_provider;
+  MessageDescription::ConstPtr other_v1 = other_provider.registerMessageByDefinition(
+    "test_pkg/Outer", "Inner inner\nint32 a\n" + separator + "MSG: test_pkg/Inner\nfloat64 x\n" );
+  ASSERT_NE( other_v1, nullptr );
+  ASSERT_NE( other_v1->message_template, v1->message_template );
+  Message::Ptr other_msg = createEmptyMessageFromTemplate( other_v1->message_template );
+  other_msg->as<CompoundMessage>()[x_handle] = 1.5;
+  EXPECT_EQ( other_msg->as<CompoundMessage>()["inner"]["x"].value<double>(), 1.5 );
 }
 
 TEST( MessageTest, arrayMessage )
@@ -617,6 +723,22 @@ TEST( MessageTest, arrayMessage )
 
     EXPECT_EQ( clone->at( 0 ), true );
     delete clone;
+
+    // Serialized bools other than 0 and 1 are normalized when detaching
+    std::vector<uint8_t> mask( 4 + 1001 );
+    *reinterpret_cast<uint32_t *>(mask.data()) = 1001;
+    for ( size_t i = 0; i < 1001; ++i ) mask[4 + i] = static_cast<uint8_t>(i % 3 == 0 ? 0 : i % 256);
+    size_t bytes_read = 0;
+    std::unique_ptr<ArrayMessage<bool>> mask_msg( ArrayMessage<bool>::fromStream( -1, mask.data(), mask.size(),
+                                                                                 bytes_read ));
+    mask_msg->detachFromStream();
+    std::vector<uint8_t> normalized( mask.size());
+    ASSERT_EQ( mask_msg->writeToStream( normalized.data()), mask.size());
+    for ( size_t i = 0; i < 1001; ++i )
+    {
+      ASSERT_EQ( normalized[4 + i], mask[4 + i] != 0 ? 1 : 0 ) << "at index " << i;
+      ASSERT_EQ( mask_msg->at( i ), mask[4 + i] != 0 ) << "at index " << i;
+    }
   }
 
   // STRING
@@ -634,7 +756,12 @@ TEST( MessageTest, arrayMessage )
     ASSERT_EQ( am.writeToStream( stream ), 64U );
 
     ArrayMessage<std::string> am_from_stream( 5, false, stream + 4 );
+    // Const access works without building the offset index
+    const ArrayMessage<std::string> &const_am_from_stream = am_from_stream;
+    EXPECT_EQ( const_am_from_stream[2], "String 2" );
+    EXPECT_EQ( const_am_from_stream._sizeInBytes(), 64U );
     EXPECT_EQ( am_from_stream[4], "String 4" );
+    EXPECT_EQ( const_am_from_stream[0], "String 0" );
 
     uint8_t second_stream[64];
     ASSERT_EQ( am_from_stream.writeToStream( second_stream ), 64U );
@@ -692,6 +819,658 @@ TEST( MessageTest, arrayMessage )
   }
 }
 
+TEST( MessageTest, arrayBulkAccess )
+{
+  std::vector<float> points( 1000 );
+  for ( size_t i = 0; i < points.size(); ++i ) points[i] = 0.5f * i;
+
+  ArrayMessage<float> am;
+  am.assign( points.data(), points.size());
+  ASSERT_EQ( am.length(), 1000U );
+  EXPECT_EQ( std::memcmp( am.data(), points.data(), points.size() * sizeof( float )), 0 );
+  am.append( points.data(), 10 );
+  ASSERT_EQ( am.length(), 1010U );
+  EXPECT_EQ( am[1009], 4.5f );
+  am.resize( 1200 );
+  ASSERT_EQ( am.length(), 1200U );
+  EXPECT_EQ( am[1010], 0.f );
+  EXPECT_EQ( am[1199], 0.f );
+  am.resize( 5 );
+  ASSERT_EQ( am.length(), 5U );
+  EXPECT_EQ( am[4], 2.f );
+
+  // Stream-backed arrays are read in place and detached once on modification
+  std::vector<uint8_t> stream( am._sizeInBytes());
+  ASSERT_EQ( am.writeToStream( stream.data()), stream.size());
+  size_t bytes_read = 0;
+  std::unique_ptr<ArrayMessage<float>> from_stream( ArrayMessage<float>::fromStream( -1, stream.data(), stream.size(),
+                                                                                    bytes_read ));
+  ASSERT_EQ( from_stream->length(), 5U );
+  EXPECT_EQ( reinterpret_cast<const uint8_t *>(from_stream->data()), stream.data() + 4 );
+  from_stream->append( points.data() + 5, 3 );
+  ASSERT_EQ( from_stream->length(), 8U );
+  EXPECT_TRUE( from_stream->isDetachedFromStream());
+  for ( size_t i = 0; i < 8; ++i ) EXPECT_EQ( from_stream->data()[i], points[i] ) << "at index " << i;
+  bytes_read = 0;
+  from_stream.reset( ArrayMessage<float>::fromStream( -1, stream.data(), stream.size(), bytes_read ));
+  from_stream->assign( points.data() + 100, 2 );
+  ASSERT_EQ( from_stream->length(), 2U );
+  EXPECT_EQ( from_stream->data()[1], 50.5f );
+  EXPECT_EQ( reinterpret_cast<const float *>(stream.data() + 4)[1], 0.5f );
+
+  // Fixed length arrays can not change their length
+  ArrayMessage<double> fixed( 3, true );
+  const double values[] = { 1.0, 2.0, 3.0, 4.0 };
+  fixed.assign( values, 3 );
+  EXPECT_EQ( fixed[2], 3.0 );
+  EXPECT_THROW( fixed.assign( values, 4 ), BabelFishException );
+  EXPECT_THROW( fixed.append( values, 1 ), BabelFishException );
+  EXPECT_THROW( fixed.resize( 4 ), BabelFishException );
+  EXPECT_NO_THROW( fixed.resize( 3 ));
+  EXPECT_EQ( fixed.length(), 3U );
+
+  ArrayMessage<int16_t> empty;
+  empty.assign( static_cast<const int16_t *>(nullptr), 0 );
+  EXPECT_EQ( empty.length(), 0U );
+  uint8_t empty_stream[4] = { 1, 1, 1, 1 };
+  EXPECT_EQ( empty.writeToStream( empty_stream ), 4U );
+  EXPECT_EQ( *reinterpret_cast<uint32_t *>(empty_stream), 0U );
+}
+
+TEST( MessageTest, arrayConversion )
+{
+  // Odd lengths to cover both the vectorized part and the remainder
+  const size_t count = 1003;
+  ArrayMessage<float> floats;
+  ArrayMessage<int16_t> shorts;
+  ArrayMessage<uint8_t> bytes;
+  ArrayMessage<int32_t> ints;
+  for ( size_t i = 0; i < count; ++i )
+  {
+    floats.push_back( 0.25f * i - 100.f );
+    shorts.push_back( static_cast<int16_t>(i * 67 - 32768));
+    bytes.push_back( static_cast<uint8_t>(i % 256));
+    ints.push_back( static_cast<int32_t>(i * 123457) - 60000000 );
+  }
+
+  std::vector<double> doubles( count );
+  floats.convertTo( doubles.data());
+  std::vector<float> float_values( count );
+  shorts.convertTo( float_values.data());
+  std::vector<float> normalized( count );
+  bytes.convertTo( normalized.data(), 1.f / 255 );
+  std::vector<double> int_doubles( count );
+  ints.convertTo( int_doubles.data());
+  for ( size_t i = 0; i < count; ++i )
+  {
+    ASSERT_EQ( doubles[i], static_cast<double>(floats[i])) << "at index " << i;
+    ASSERT_EQ( float_values[i], static_cast<float>(shorts[i])) << "at index " << i;
+    ASSERT_EQ( normalized[i], static_cast<float>(bytes[i]) * (1.f / 255)) << "at index " << i;
+    ASSERT_EQ( int_doubles[i], static_cast<double>(ints[i])) << "at index " << i;
+  }
+
+  // Conversions that may not fit are range checked
+  std::vector<int32_t> truncated( count );
+  EXPECT_NO_THROW( floats.convertTo( truncated.data()));
+  EXPECT_EQ( truncated[1002], 150 );
+  floats.assign( 700, 3e9f );
+  EXPECT_THROW( floats.convertTo( truncated.data()), BabelFishException );
+  std::vector<uint8_t> unsigned_bytes( count );
+  EXPECT_THROW( shorts.convertTo( unsigned_bytes.data()), BabelFishException );
+  ArrayMessage<int64_t> small;
+  for ( int64_t i = 0; i < 300; ++i ) small.push_back( i % 100 );
+  std::vector<int8_t> small_values( 300 );
+  EXPECT_NO_THROW( small.convertTo( small_values.data()));
+  EXPECT_EQ( small_values[299], 99 );
+
+  // Stream-backed arrays are converted in place
+  std::vector<uint8_t> stream( shorts._sizeInBytes());
+  shorts.writeToStream( stream.data());
+  size_t bytes_read = 0;
+  std::unique_ptr<ArrayMessage<int16_t>> from_stream( ArrayMessage<int16_t>::fromStream( -1, stream.data(),
+                                                                                        stream.size(), bytes_read ));
+  std::vector<float> stream_values( count );
+  from_stream->convertTo( stream_values.data());
+  EXPECT_EQ( stream_values, float_values );
+}
+
+TEST( MessageTest, casts )
+{
+  BabelFish fish;
+  Message::Ptr msg = fish.createMessage( "rosgraph_msgs/Log" );
+  Message &header = ( *msg )["header"];
+  EXPECT_NO_THROW( header.as<CompoundMessage>());
+  EXPECT_EQ( &header.asUnchecked<CompoundMessage>(), &header.as<CompoundMessage>());
+  EXPECT_THROW( header.as<ArrayMessageBase>(), BabelFishException );
+  EXPECT_THROW( header.as<ValueMessage<uint32_t>>(), BabelFishException );
+  EXPECT_NO_THROW( header["seq"].as<ValueMessage<uint32_t>>());
+  EXPECT_THROW( header["seq"].as<ValueMessage<int32_t>>(), BabelFishException );
+  EXPECT_THROW( header["seq"].as<CompoundMessage>(), BabelFishException );
+
+  const Message &topics = ( *msg )["topics"];
+  EXPECT_NO_THROW( topics.as<ArrayMessageBase>());
+  EXPECT_NO_THROW( topics.as<ArrayMessage<std::string>>());
+  EXPECT_THROW( topics.as<ArrayMessage<uint8_t>>(), BabelFishException );
+  EXPECT_THROW( topics.as<CompoundArrayMessage>(), BabelFishException );
+
+  CompoundArrayMessage array( fish.descriptionProvider()->getMessageDescription( "std_msgs/Header" )->message_template );
+  Message &array_msg = array;
+  EXPECT_NO_THROW( array_msg.as<CompoundArrayMessage>());
+  EXPECT_NO_THROW( array_msg.as<ArrayMessage<Message>>());
+  EXPECT_THROW( array_msg.as<ArrayMessage<std::string>>(), BabelFishException );
+}
+
+TEST( MessageTest, babelFishMessageBuffer )
+{
+  boost::shared_array<uint8_t> transport_buffer( new uint8_t[12] );
+  for ( uint8_t i = 0; i < 12; ++i ) transport_buffer[i] = i;
+  BabelFishMessage msg;
+  msg.share( transport_buffer, transport_buffer.get() + 4, 8 );
+  const BabelFishMessage &const_msg = msg;
+  EXPECT_EQ( const_msg.buffer(), transport_buffer.get() + 4 );
+  EXPECT_EQ( msg.size(), 8U );
+  EXPECT_TRUE( msg.isBufferShared());
+
+  // Copies share the buffer until one of them requests write access
+  BabelFishMessage copy = msg;
+  const BabelFishMessage &const_copy = copy;
+  EXPECT_EQ( const_copy.buffer(), const_msg.buffer());
+  copy.buffer()[0] = 42;
+  EXPECT_NE( const_copy.buffer(), const_msg.buffer());
+  EXPECT_EQ( const_copy.buffer()[0], 42 );
+  EXPECT_EQ( const_copy.buffer()[1], 5 );
+  EXPECT_EQ( transport_buffer[4], 4 );
+  EXPECT_FALSE( copy.isBufferShared());
+
+  // The shared buffer is kept alive by the message and stays shared until write access is requested
+  transport_buffer.reset();
+  EXPECT_TRUE( msg.isBufferShared());
+  EXPECT_EQ( const_msg.buffer()[7], 11 );
+  msg.buffer()[7] = 12;
+  EXPECT_FALSE( msg.isBufferShared());
+
+  // Copying marks the buffer of the source as shared, too
+  BabelFishMessage second_copy = msg;
+  EXPECT_TRUE( msg.isBufferShared());
+  EXPECT_TRUE( second_copy.isBufferShared());
+  msg.buffer()[7] = 13;
+  EXPECT_EQ( second_copy.buffer()[7], 12 );
+
+  ros::SerializedMessage serialized( boost::shared_array<uint8_t>( new uint8_t[10] ), 10 );
+  serialized.message_start = serialized.buf.get() + 4;
+  msg.share( serialized );
+  EXPECT_EQ( msg.size(), 6U );
+  EXPECT_EQ( const_msg.buffer(), serialized.buf.get() + 4 );
+}
+
+TEST( MessageTest, subscriberBuffer )
+{
+  BufferPool::Ptr previous_pool = BufferPool::defaultPool();
+  auto pool = std::make_shared<BucketBufferPool>();
+  BufferPool::setDefaultPool( pool );
+  ros::NodeHandle nh;
+  BabelFishMessage::ConstPtr received;
+  boost::function<void( const BabelFishMessage::ConstPtr & )> callback = [&received](
+    const BabelFishMessage::ConstPtr &msg ) { received = msg; };
+  ros::Subscriber subscriber = nh.subscribe<BabelFishMessage>( "/test_message/subscriber_buffer", 1, callback );
+  ros::Publisher publisher = nh.advertise<rosgraph_msgs::Log>( "/test_message/subscriber_buffer", 1, true );
+  rosgraph_msgs::Log log;
+  log.level = rosgraph_msgs::Log::INFO;
+  log.name = "subscriber_buffer";
+  log.msg = "Received by a subscriber";
+  publisher.publish( log );
+  ros::WallTime timeout = ros::WallTime::now() + ros::WallDuration( 5 );
+  while ( received == nullptr && ros::WallTime::now() < timeout )
+  {
+    ros::spinOnce();
+    ros::WallDuration( 0.01 ).sleep();
+  }
+  ASSERT_NE( received, nullptr );
+  EXPECT_EQ( received->dataType(), "rosgraph_msgs/Log" );
+  EXPECT_EQ( received->md5Sum(), std::string( ros::message_traits::md5sum<rosgraph_msgs::Log>()));
+
+  std::vector<uint8_t> expected( ros::serialization::serializationLength( log ));
+  ros::serialization::OStream stream( expected.data(), expected.size());
+  ros::serialization::serialize( stream, log );
+  ASSERT_EQ( received->size(), expected.size());
+  EXPECT_EQ( std::memcmp( received->buffer(), expected.data(), expected.size()), 0 );
+  // roscpp only lends the transport buffer to the subscription while deserializing, hence, the message owns a copy
+  EXPECT_FALSE( received->isBufferShared());
+  // The copy is allocated from the default pool and returned to it once the message is released
+  EXPECT_EQ( pool->retainedBytes(), 0U );
+  subscriber.shutdown();
+  received.reset();
+  EXPECT_GT( pool->retainedBytes(), 0U );
+  BufferPool::setDefaultPool( previous_pool );
+}
+
+TEST( MessageTest, babelFishMessageType )
+{
+  boost::shared_ptr<std::map<std::string, std::string>> header = boost::make_shared<std::map<std::string, std::string>>();
+  (*header)["md5sum"] = "abc";
+  (*header)["type"] = "rosapi/GetParamRequest";
+  (*header)["message_definition"] = "string name\nstring default";
+  (*header)["latching"] = "1";
+  BabelFishMessageType::ConstPtr type = BabelFishMessageType::fromConnectionHeader( header );
+  EXPECT_EQ( type->md5, "abc" );
+  EXPECT_EQ( type->datatype, "rosapi/GetParamRequest" );
+  EXPECT_EQ( type->service_datatype, "rosapi/GetParam" );
+  EXPECT_TRUE( type->latched );
+  // Messages received on the same connection share their type
+  EXPECT_EQ( BabelFishMessageType::fromConnectionHeader( header ), type );
+  // Types of other connections do not affect it
+  std::vector<boost::shared_ptr<std::map<std::string, std::string>>> other_headers;
+  for ( int i = 0; i < 20; ++i )
+  {
+    other_headers.push_back( boost::make_shared<std::map<std::string, std::string>>());
+    (*other_headers.back())["type"] = "std_msgs/Int" + std::to_string( i );
+    EXPECT_EQ( BabelFishMessageType::fromConnectionHeader( other_headers.back())->datatype,
+               "std_msgs/Int" + std::to_string( i ));
+    EXPECT_EQ( BabelFishMessageType::fromConnectionHeader( other_headers.back()),
+               BabelFishMessageType::fromConnectionHeader( other_headers.back()));
+  }
+  EXPECT_EQ( BabelFishMessageType::fromConnectionHeader( header )->datatype, "rosapi/GetParamRequest" );
+
+  BabelFishMessage msg;
+  EXPECT_EQ( msg.md5Sum(), "*" );
+  EXPECT_THROW( msg.__getServiceDatatype(), BabelFishMessageException );
+  msg.morph( type );
+  EXPECT_EQ( msg.messageType(), type );
+  EXPECT_EQ( msg.dataType(), "rosapi/GetParamRequest" );
+  EXPECT_EQ( msg.__getServiceDatatype(), "rosapi/GetParam" );
+  EXPECT_TRUE( msg.isLatched());
+  BabelFishMessage copy = msg;
+  EXPECT_EQ( copy.messageType(), type );
+
+  auto description = std::make_shared<MessageDescription>();
+  description->datatype = "std_msgs/Empty";
+  description->md5 = "d41d8cd98f00b204e9800998ecf8427e";
+  msg.morph( description );
+  EXPECT_EQ( msg.md5Sum(), description->md5 );
+  EXPECT_EQ( msg.__getServerMD5Sum(), "*" );
+  EXPECT_FALSE( msg.isLatched());
+  copy.morph( description );
+  EXPECT_EQ( copy.messageType(), msg.messageType());
+
+  // Each version of a datatype has its own type
+  auto other_version = std::make_shared<MessageDescription>( *description );
+  other_version->md5 = "abc";
+  copy.morph( other_version );
+  EXPECT_EQ( copy.md5Sum(), "abc" );
+  EXPECT_NE( copy.messageType(), msg.messageType());
+  BabelFishMessageType::ConstPtr other_type = copy.messageType();
+  msg.morph( description );
+  copy.morph( other_version );
+  EXPECT_EQ( copy.messageType(), other_type );
+  EXPECT_EQ( BabelFishMessageType::fromDescription( description ), msg.messageType());
+  EXPECT_NE( BabelFishMessageType::fromDescription( description, "server" ), msg.messageType());
+
+  // Types are shared between threads and outlive the per-thread cache
+  BabelFishMessageType::ConstPtr thread_type;
+  std::thread( [&description, &thread_type]() { thread_type = BabelFishMessageType::fromDescription( description ); } )
+    .join();
+  EXPECT_EQ( thread_type, msg.messageType());
+  std::vector<MessageDescription::ConstPtr> other_versions;
+  for ( int i = 0; i < 20; ++i )
+  {
+    auto version = std::make_shared<MessageDescription>( *description );
+    version->md5 = std::to_string( i );
+    other_versions.push_back( version );
+    EXPECT_EQ( BabelFishMessageType::fromDescription( version )->md5, version->md5 );
+  }
+  EXPECT_EQ( BabelFishMessageType::fromDescription( description ), msg.messageType());
+}
+
+TEST( MessageTest, bufferPool )
+{
+  auto pool = std::make_shared<BucketBufferPool>( 100, 1024, 1536, 2 );
+  size_t capacity;
+  boost::shared_array<uint8_t> buffer = pool->acquire( 200, capacity );
+  EXPECT_EQ( capacity, 256U );
+  const uint8_t *raw_buffer = buffer.get();
+  buffer.reset();
+  EXPECT_EQ( pool->retainedBytes(), 256U );
+  // Released buffers are recycled
+  buffer = pool->acquire( 129, capacity );
+  EXPECT_EQ( buffer.get(), raw_buffer );
+  EXPECT_EQ( pool->retainedBytes(), 0U );
+  // Buffers larger than the largest bucket are not recycled
+  boost::shared_array<uint8_t> large_buffer = pool->acquire( 2000, capacity );
+  EXPECT_EQ( capacity, 2000U );
+  large_buffer.reset();
+  EXPECT_EQ( pool->retainedBytes(), 0U );
+  // Retention is bounded
+  std::vector<boost::shared_array<uint8_t>> buffers;
+  for ( int i = 0; i < 3; ++i ) buffers.push_back( pool->acquire( 1024, capacity ));
+  buffers.clear();
+  EXPECT_EQ( pool->retainedBytes(), 1024U );
+
+  BabelFishMessage msg;
+  msg.allocate( 200, pool );
+  EXPECT_EQ( msg.size(), 200U );
+  msg = BabelFishMessage();
+  EXPECT_EQ( pool->retainedBytes(), 1024U + 256U );
+  // Buffers may outlive the pool
+  msg.allocate( 200, pool );
+  pool.reset();
+  msg.buffer()[199] = 1;
+}
+
+TEST( MessageTest, outputStream )
+{
+  MessageTemplate::Ptr tmpl = std::make_shared<MessageTemplate>();
+  tmpl->type = MessageTypes::Compound;
+  tmpl->compound.datatype = "random_type/Msg";
+  tmpl->compound.names = { "text", "values" };
+  MessageTemplate::Ptr text_tmpl = std::make_shared<MessageTemplate>();
+  text_tmpl->type = MessageTypes::String;
+  MessageTemplate::Ptr values_tmpl = std::make_shared<MessageTemplate>();
+  values_tmpl->type = MessageTypes::Array;
+  values_tmpl->array.element_type = MessageTypes::Float64;
+  values_tmpl->array.length = -1;
+  tmpl->compound.types = { text_tmpl, values_tmpl };
+
+  CompoundMessage cm( tmpl );
+  cm["text"] = "some text";
+  auto &values = cm["values"].as<ArrayMessage<double>>();
+  for ( int i = 0; i < 1000; ++i ) values.push_back( i * 0.5 );
+  std::vector<uint8_t> expected( cm._sizeInBytes());
+  ASSERT_EQ( cm.writeToStream( expected.data()), expected.size());
+
+  // The stream grows as needed, starting with a capacity that is too small
+  OutputStream stream( std::make_shared<BucketBufferPool>(), 16 );
+  cm.writeToStream( stream );
+  ASSERT_EQ( stream.size(), expected.size());
+  EXPECT_TRUE( compareArrays( stream.data(), expected.data(), expected.size()));
+  EXPECT_EQ( stream.data(), stream.buffer().get());
+}
+
+TEST( MessageTest, unchangedSubtrees )
+{
+  MessageTemplate::ConstPtr tmpl = createItemsTemplate();
+
+  CompoundMessage cm( tmpl );
+  EXPECT_TRUE( cm._isModified());
+  cm["seq"] = 3;
+  cm["first"]["name"] = "first";
+  auto &items = cm["items"].as<CompoundArrayMessage>();
+  for ( int i = 0; i < 10; ++i )
+  {
+    auto &item = items.appendEmpty();
+    item["id"] = i;
+    item["name"] = "item " + std::to_string( i );
+  }
+  std::vector<uint8_t> source( cm._sizeInBytes());
+  ASSERT_EQ( cm.writeToStream( source.data()), source.size());
+
+  for ( bool lazy : { false, true } )
+  {
+    size_t bytes_read = 0;
+    std::unique_ptr<CompoundMessage> msg( CompoundMessage::fromStream( tmpl, source.data(), source.size(), bytes_read,
+                                                                       nullptr, lazy ));
+    ASSERT_EQ( bytes_read, source.size());
+    EXPECT_FALSE( msg->_isModified());
+    EXPECT_EQ( msg->_streamOffset(), 0U );
+    EXPECT_EQ( msg->_streamSize(), source.size());
+    const CompoundMessage &const_msg = *msg;
+    EXPECT_EQ( const_msg["first"]["name"].value<std::string>(), "first" );
+    EXPECT_FALSE( msg->_isModified());
+    OutputStream unchanged( BufferPool::Ptr(), 0 );
+    msg->writeToStream( unchanged );
+    ASSERT_EQ( unchanged.size(), source.size());
+    EXPECT_TRUE( compareArrays( unchanged.data(), source.data(), source.size()));
+
+    // Only the accessed element is written field by field, the others are copied from the source
+    auto &msg_items = ( *msg )["items"].as<CompoundArrayMessage>();
+    EXPECT_TRUE( msg->_isModified());
+    EXPECT_FALSE( msg_items[3].as<CompoundMessage>()._isModified());
+    msg_items[4]["id"] = 42;
+    msg_items[7]["name"] = "changed";
+    EXPECT_FALSE( ( *msg )["first"].as<CompoundMessage>()._isModified());
+    EXPECT_TRUE( msg_items[4].as<CompoundMessage>()._isModified());
+    std::unique_ptr<Message> detached( msg->clone());
+    detached->detachFromStream();
+    EXPECT_TRUE( detached->as<CompoundMessage>()._isModified());
+    std::vector<uint8_t> expected( detached->_sizeInBytes());
+    ASSERT_EQ( detached->writeToStream( expected.data()), expected.size());
+    EXPECT_EQ( msg->_sizeInBytes(), expected.size());
+    OutputStream changed( BufferPool::Ptr(), 0 );
+    msg->writeToStream( changed );
+    ASSERT_EQ( changed.size(), expected.size());
+    EXPECT_TRUE( compareArrays( changed.data(), expected.data(), expected.size()));
+  }
+
+  // Clones decode the remaining fields and stay valid after the source stream is gone
+  for ( bool lazy : { false, true } )
+  {
+    std::vector<uint8_t> stream = source;
+    size_t bytes_read = 0;
+    std::unique_ptr<CompoundMessage> msg( CompoundMessage::fromStream( tmpl, stream.data(), stream.size(), bytes_read,
+                                                                       nullptr, lazy ));
+    ( *msg )["items"].as<CompoundArrayMessage>()[2]["id"] = 2;
+    std::unique_ptr<Message> clone( msg->clone());
+    msg.reset();
+    std::fill( stream.begin(), stream.end(), 0xAB );
+    stream.clear();
+    stream.shrink_to_fit();
+    EXPECT_EQ( clone->_stream(), nullptr );
+    EXPECT_EQ( ( *clone )["items"].as<CompoundArrayMessage>()[9]["name"].value<std::string>(), "item 9" );
+    std::vector<uint8_t> serialized( clone->_sizeInBytes());
+    ASSERT_EQ( clone->writeToStream( serialized.data()), source.size());
+    EXPECT_TRUE( compareArrays( serialized.data(), source.data(), source.size()));
+  }
+}
+
+TEST( MessageTest, unknownFieldType )
+{
+  MessageTemplate::Ptr id_tmpl = std::make_shared<MessageTemplate>();
+  id_tmpl->type = MessageTypes::Int32;
+  MessageTemplate::Ptr unknown_tmpl = std::make_shared<MessageTemplate>();
+  unknown_tmpl->type = MessageTypes::None;
+  MessageTemplate::Ptr tmpl = std::make_shared<MessageTemplate>();
+  tmpl->type = MessageTypes::Compound;
+  tmpl->compound.datatype = "random_type/Unknown";
+  tmpl->compound.names = { "unknown", "id" };
+  tmpl->compound.types = { unknown_tmpl, id_tmpl };
+
+  // Skipping the field would assign the decoded id to the field name "unknown"
+  uint8_t source[] = { 42, 0, 0, 0 };
+  for ( bool lazy : { false, true } )
+  {
+    size_t bytes_read = 0;
+    EXPECT_THROW( CompoundMessage::fromStream( tmpl, source, sizeof( source ), bytes_read, nullptr, lazy ),
+                  BabelFishException );
+  }
+}
+
+TEST( MessageTest, moveSemantics )
+{
+  MessageTemplate::ConstPtr tmpl = createItemsTemplate();
+  MessageTemplate::ConstPtr item_tmpl = tmpl->compound.types[1];
+
+  CompoundMessage cm( tmpl );
+  cm["seq"] = 3;
+  cm["first"]["id"] = 1;
+  cm["first"]["name"] = "first";
+  std::vector<uint8_t> source( cm._sizeInBytes());
+  ASSERT_EQ( cm.writeToStream( source.data()), source.size());
+
+  for ( bool lazy : { false, true } )
+  {
+    size_t bytes_read = 0;
+    std::unique_ptr<CompoundMessage> msg( CompoundMessage::fromStream( tmpl, source.data(), source.size(), bytes_read,
+                                                                       nullptr, lazy ));
+    // Move a field from one message to another
+    std::unique_ptr<Message> first( msg->release( "first" ));
+    EXPECT_EQ( ( *first )["name"].value<std::string>(), "first" );
+    EXPECT_EQ( ( *msg )["first"]["name"].value<std::string>(), "" );
+    EXPECT_EQ( msg->_sizeInBytes(), source.size() - 5 );
+    CompoundMessage target( tmpl );
+    Message *first_ptr = first.get();
+    target.replace( "first", first.release());
+    EXPECT_EQ( &target["first"], first_ptr );
+    EXPECT_EQ( target["first"]["name"].value<std::string>(), "first" );
+    std::unique_ptr<Message> wrong_type( new ValueMessage<int32_t>( 5 ));
+    EXPECT_THROW( target.replace( "first", wrong_type.get()), BabelFishException );
+    std::unique_ptr<Message> wrong_compound( new CompoundMessage( item_tmpl ));
+    EXPECT_THROW( target.replace( "seq", wrong_compound.get()), BabelFishException );
+    EXPECT_THROW( msg->release( "invalid" ), std::runtime_error );
+
+    // Moving the message itself keeps its children
+    CompoundMessage moved( std::move( target ));
+    EXPECT_EQ( &moved["first"], first_ptr );
+    EXPECT_EQ( moved["first"]["id"].value<int32_t>(), 1 );
+    CompoundMessage assigned( tmpl );
+    Message &assigned_base = assigned;
+    assigned_base = std::move( moved );
+    EXPECT_EQ( &assigned["first"], first_ptr );
+    assigned["seq"] = 3;
+    std::vector<uint8_t> serialized( assigned._sizeInBytes());
+    ASSERT_EQ( assigned.writeToStream( serialized.data()), source.size());
+    EXPECT_TRUE( compareArrays( serialized.data(), source.data(), source.size()));
+  }
+
+  // Append to compound arrays by moving
+  CompoundArrayMessage items( item_tmpl );
+  CompoundMessage item( item_tmpl );
+  item["id"] = 7;
+  item["name"] = "seven";
+  Message *name_ptr = &item["name"];
+  CompoundMessage &appended = items.push_back( std::move( item ));
+  EXPECT_EQ( items.length(), 1U );
+  EXPECT_EQ( &appended["name"], name_ptr );
+  EXPECT_EQ( items[0]["id"].value<int32_t>(), 7 );
+  CompoundMessage other_item( tmpl );
+  EXPECT_THROW( items.append( std::move( other_item )), BabelFishException );
+  CompoundArrayMessage fixed_items( item_tmpl, 2, true );
+  CompoundMessage fixed_item( item_tmpl );
+  EXPECT_THROW( fixed_items.push_back( std::move( fixed_item )), BabelFishException );
+
+  CompoundArrayMessage moved_items( std::move( items ));
+  EXPECT_EQ( moved_items.length(), 1U );
+  EXPECT_EQ( items.length(), 0U );
+  EXPECT_EQ( &moved_items[0]["name"], name_ptr );
+  CompoundArrayMessage assigned_items( item_tmpl );
+  assigned_items = std::move( moved_items );
+  EXPECT_EQ( &assigned_items[0]["name"], name_ptr );
+  CompoundArrayMessage different_items( tmpl );
+  EXPECT_THROW( different_items = std::move( assigned_items ), BabelFishException );
+
+  ArrayMessage<int32_t> ints;
+  for ( int i = 0; i < 10; ++i ) ints.push_back( i );
+  ArrayMessage<int32_t> moved_ints( std::move( ints ));
+  EXPECT_EQ( ints.length(), 0U );
+  ASSERT_EQ( moved_ints.length(), 10U );
+  EXPECT_EQ( moved_ints[9], 9 );
+}
+
+TEST( MessageTest, copyOnWriteClone )
+{
+  MessageTemplate::ConstPtr tmpl = createItemsTemplate();
+
+  CompoundMessage cm( tmpl );
+  cm["seq"] = 3;
+  cm["first"]["id"] = 1;
+  cm["first"]["name"] = "first";
+  auto &items = cm["items"].as<CompoundArrayMessage>();
+  for ( int i = 0; i < 3; ++i )
+  {
+    CompoundMessage &item = items.appendEmpty().as<CompoundMessage>();
+    item["id"] = i;
+    item["name"] = "item " + std::to_string( i );
+  }
+  std::vector<uint8_t> source( cm._sizeInBytes());
+  ASSERT_EQ( cm.writeToStream( source.data()), source.size());
+
+  for ( bool lazy : { false, true } )
+  {
+    size_t bytes_read = 0;
+    std::unique_ptr<CompoundMessage> msg( CompoundMessage::fromStream( tmpl, source.data(), source.size(), bytes_read,
+                                                                       nullptr, lazy ));
+    const CompoundMessage &const_msg = *msg;
+    // Decode the fields before cloning to make sure the children are shared
+    const Message *first_ptr = &const_msg["first"];
+    const Message *items_ptr = &const_msg["items"];
+    std::unique_ptr<CompoundMessage> clone( dynamic_cast<CompoundMessage *>(msg->cloneShared()));
+    ASSERT_NE( clone, nullptr );
+    const CompoundMessage &const_clone = *clone;
+    EXPECT_EQ( &const_clone["first"], first_ptr );
+    EXPECT_EQ( &const_clone["items"], items_ptr );
+    EXPECT_TRUE( const_clone["first"]._isShared());
+    EXPECT_FALSE( const_clone._isShared());
+    // Read-only access to the children does not copy them
+    EXPECT_EQ( const_clone.childAt( 1 ), first_ptr );
+    EXPECT_EQ( const_clone.childAt( 2 ), items_ptr );
+    EXPECT_THROW( const_clone.childAt( 3 ), std::runtime_error );
+    EXPECT_TRUE( const_clone["first"]._isShared());
+    EXPECT_FALSE( const_clone._isModified());
+
+    // Modifying the clone copies the modified path and leaves the original untouched
+    ( *clone )["first"]["id"] = 42;
+    EXPECT_NE( &const_clone["first"], first_ptr );
+    EXPECT_EQ( &const_msg["first"], first_ptr );
+    EXPECT_FALSE( const_msg["first"]._isShared());
+    EXPECT_EQ( const_msg["first"]["id"].value<int32_t>(), 1 );
+    EXPECT_EQ( const_clone["first"]["id"].value<int32_t>(), 42 );
+    EXPECT_EQ( const_clone["first"]["name"].value<std::string>(), "first" );
+    EXPECT_EQ( &const_clone["items"], items_ptr );
+
+    // Modifying the original does not affect the clone either
+    const Message *item_ptr = &const_msg["items"].as<CompoundArrayMessage>()[1];
+    ( *msg )["items"].as<CompoundArrayMessage>()[0]["name"] = "changed";
+    EXPECT_EQ( const_clone["items"].as<CompoundArrayMessage>()[0]["name"].value<std::string>(), "item 0" );
+    EXPECT_EQ( const_msg["items"].as<CompoundArrayMessage>()[0]["name"].value<std::string>(), "changed" );
+    // Unmodified elements of copied arrays are still shared
+    EXPECT_EQ( &const_clone["items"].as<CompoundArrayMessage>()[1], item_ptr );
+    EXPECT_EQ( &const_msg["items"].as<CompoundArrayMessage>()[1], item_ptr );
+
+    // Releasing a shared child hands out an exclusive copy
+    std::unique_ptr<Message> released( clone->release( "items" ));
+    EXPECT_FALSE( released->_isShared());
+    EXPECT_EQ( released->as<CompoundArrayMessage>()[2]["id"].value<int32_t>(), 2 );
+    EXPECT_EQ( const_msg["items"].as<CompoundArrayMessage>()[2]["id"].value<int32_t>(), 2 );
+
+    // Destroying the original first keeps the shared children of the clone alive
+    std::unique_ptr<CompoundMessage> second_clone( dynamic_cast<CompoundMessage *>(msg->cloneShared()));
+    msg.reset();
+    EXPECT_EQ( ( *second_clone )["seq"].value<int32_t>(), 3 );
+    EXPECT_EQ( ( *second_clone )["items"].as<CompoundArrayMessage>()[0]["name"].value<std::string>(), "changed" );
+    std::vector<uint8_t> serialized( second_clone->_sizeInBytes());
+    ASSERT_EQ( second_clone->writeToStream( serialized.data()), serialized.size());
+    EXPECT_EQ( serialized.size(), source.size() + 1 );
+  }
+
+  // Shared children of lazy messages are decoded before sharing, hence, clones can be read concurrently
+  size_t bytes_read = 0;
+  std::unique_ptr<CompoundMessage> lazy_msg( CompoundMessage::fromStream( tmpl, source.data(), source.size(),
+                                                                          bytes_read, nullptr, true ));
+  const CompoundMessage &const_lazy_msg = *lazy_msg;
+  const_lazy_msg["first"];
+  const_lazy_msg["items"];
+  std::vector<std::unique_ptr<Message>> clones;
+  for ( int i = 0; i < 4; ++i ) clones.emplace_back( lazy_msg->cloneShared());
+  std::vector<std::thread> readers;
+  for ( auto &clone : clones )
+  {
+    const Message *shared_clone = clone.get();
+    readers.emplace_back( [shared_clone]()
+                          {
+                            const auto &clone_items = ( *shared_clone )["items"].as<CompoundArrayMessage>();
+                            for ( size_t i = 0; i < clone_items.length(); ++i )
+                              EXPECT_EQ( clone_items[i]["name"].value<std::string>(), "item " + std::to_string( i ));
+                            EXPECT_EQ( ( *shared_clone )["first"]["name"].value<std::string>(), "first" );
+                          } );
+  }
+  for ( auto &reader : readers ) reader.join();
+
+  // Leaf messages are copied
+  ArrayMessage<int32_t> ints;
+  for ( int i = 0; i < 10; ++i ) ints.push_back( i );
+  std::unique_ptr<Message> ints_clone( ints.cloneShared());
+  ints.assign( 9, 0 );
+  EXPECT_EQ( ints_clone->as<ArrayMessage<int32_t>>()[9], 9 );
+}
+
 TEST( MessageTest, isCompatible )
 {
   using namespace ros_babel_fish::internal;
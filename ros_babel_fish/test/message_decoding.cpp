@@ -233,8 +233,111 @@ TEST_F( MessageDecodingTest, arrayTests )
   ASSERT_TRUE( MESSAGE_TYPE_EQUAL( test_array, msg ));
   translated = fish.translateMessage( msg );
   EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_array, translated->translated_message ));
+  // Random access into stream-backed string arrays
+  auto &strings = ( *translated->translated_message )["strings"].as<ArrayMessage<std::string>>();
+  ASSERT_EQ( strings.length(), test_array.strings.size());
+  for ( size_t i = strings.length(); i > 0; --i )
+  {
+    EXPECT_EQ( strings[i - 1], test_array.strings[i - 1] );
+  }
+  translated->translated_message->detachFromStream();
+  EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_array, translated->translated_message ));
+}
+
+TEST_F( MessageDecodingTest, decodeProgramTests )
+{
+  BabelFishMessage::ConstPtr msg = ros::topic::waitForMessage<BabelFishMessage>( "/test_message_decoding/pose" );
+  MessageDescription::ConstPtr desc = fish.descriptionProvider()->getMessageDescription( *msg );
+  ASSERT_NE( desc->message_template->compound.decode_program, nullptr );
+  // All fields of a pose are fixed size and should be merged into a single block
+  size_t blocks = 0;
+  for ( auto &operation : desc->message_template->compound.decode_program->operations )
+  {
+    if ( operation.type != DecodeOperationTypes::FixedBlock ) continue;
+    ++blocks;
+    EXPECT_EQ( operation.value, 7 * sizeof( double ));
+  }
+  EXPECT_EQ( blocks, 1U );
+
+  // Templates without a precompiled program are compiled on the first use and the program is reused afterwards
+  msg = ros::topic::waitForMessage<BabelFishMessage>( "/test_message_decoding/test_array" );
+  desc = fish.descriptionProvider()->getMessageDescription( *msg );
+  MessageTemplate::Ptr manual_template = std::make_shared<MessageTemplate>( *desc->message_template );
+  manual_template->compound.decode_program = nullptr;
+  size_t bytes_read = 0;
+  Message::Ptr translated = createMessageFromTemplate( manual_template, msg->buffer(), msg->size(), bytes_read );
+  EXPECT_EQ( bytes_read, msg->size());
+  EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_array, translated ));
+  DecodeProgram::ConstPtr cached_program = manual_template->compound.decode_program;
+  ASSERT_NE( cached_program, nullptr );
+  bytes_read = 0;
+  translated = createMessageFromTemplate( manual_template, msg->buffer(), msg->size(), bytes_read );
+  EXPECT_EQ( manual_template->compound.decode_program, cached_program );
+  EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_array, translated ));
+}
+
+TEST_F( MessageDecodingTest, arenaTests )
+{
+  BabelFishMessage::ConstPtr msg = ros::topic::waitForMessage<BabelFishMessage>( "/test_message_decoding/test_message" );
+  ASSERT_TRUE( MESSAGE_TYPE_EQUAL( test_message, msg ));
+  TranslatedMessage::Ptr translated = fish.translateMessage( msg, TranslationFlags::Arena );
+  EXPECT_TRUE( Message::isArenaAllocated( translated->translated_message.get()));
+  EXPECT_TRUE( Message::isArenaAllocated( &( *translated->translated_message )["header"] ));
+  EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_message, translated->translated_message ));
+  BabelFishMessage::Ptr serialized = fish.translateMessage( translated->translated_message );
+  ASSERT_EQ( serialized->size(), msg->size());
+  EXPECT_EQ( std::memcmp( serialized->buffer(), msg->buffer(), msg->size()), 0 );
+
+  // Clones are allocated on the heap and have to outlive the arena
+  Message::Ptr clone( translated->translated_message->clone());
+  EXPECT_FALSE( Message::isArenaAllocated( clone.get()));
+  // Released fields are owned by the caller, hence, they are moved to the heap as well
+  std::unique_ptr<Message> header( translated->translated_message->as<CompoundMessage>().release( "header" ));
+  EXPECT_FALSE( Message::isArenaAllocated( header.get()));
+  translated.reset();
+  EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_message, clone ));
+  EXPECT_EQ(( *header )["frame_id"].value<std::string>(), test_message.header.frame_id );
+
+  msg = ros::topic::waitForMessage<BabelFishMessage>( "/test_message_decoding/test_array" );
+  ASSERT_TRUE( MESSAGE_TYPE_EQUAL( test_array, msg ));
+  translated = fish.translateMessage( msg, TranslationFlags::Arena );
+  EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_array, translated->translated_message ));
+  // Children replaced in an arena allocated tree are allocated on the heap
+  auto &subarrays = ( *translated->translated_message )["subarrays"].as<CompoundArrayMessage>();
+  subarrays.appendEmpty();
+  EXPECT_FALSE( Message::isArenaAllocated( &subarrays[subarrays.length() - 1] ));
   translated->translated_message->detachFromStream();
+  EXPECT_TRUE( translated->translated_message->isDetachedFromStream());
+}
+
+TEST_F( MessageDecodingTest, lazyTests )
+{
+  BabelFishMessage::ConstPtr msg = ros::topic::waitForMessage<BabelFishMessage>( "/test_message_decoding/test_message" );
+  ASSERT_TRUE( MESSAGE_TYPE_EQUAL( test_message, msg ));
+  TranslatedMessage::Ptr translated = fish.translateMessage( msg, TranslationFlags::Lazy );
+  // Fields that were not accessed are serialized from the original stream
+  BabelFishMessage::Ptr serialized = fish.translateMessage( translated->translated_message );
+  ASSERT_EQ( serialized->size(), msg->size());
+  EXPECT_EQ( std::memcmp( serialized->buffer(), msg->buffer(), msg->size()), 0 );
+  EXPECT_EQ(( *translated->translated_message )["str"].value<std::string>(), test_message.str );
+  EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_message, translated->translated_message ));
+
+  msg = ros::topic::waitForMessage<BabelFishMessage>( "/test_message_decoding/test_array" );
+  ASSERT_TRUE( MESSAGE_TYPE_EQUAL( test_array, msg ));
+  translated = fish.translateMessage( msg, TranslationFlags::Lazy | TranslationFlags::Arena );
+  auto &subarrays = ( *translated->translated_message )["subarrays"].as<CompoundArrayMessage>();
+  ASSERT_EQ( subarrays.length(), test_array.subarrays.size());
+  EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_array.subarrays[0], subarrays[0] ));
+  serialized = fish.translateMessage( translated->translated_message );
+  ASSERT_EQ( serialized->size(), msg->size());
+  EXPECT_EQ( std::memcmp( serialized->buffer(), msg->buffer(), msg->size()), 0 );
   EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_array, translated->translated_message ));
+
+  // Truncated streams are detected when the offsets are computed
+  MessageDescription::ConstPtr desc = fish.descriptionProvider()->getMessageDescription( *msg );
+  size_t bytes_read = 0;
+  EXPECT_THROW( CompoundMessage::fromStream( desc->message_template, msg->buffer(), msg->size() - 1, bytes_read,
+                                             nullptr, true ), BabelFishException );
 }
 
 int main( int argc, char **argv )
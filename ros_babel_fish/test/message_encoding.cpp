@@ -353,6 +353,40 @@ TEST_F( MessageEncodingTest, arrayTests )
   EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( test_array_msg, msg_test_array ));
 }
 
+TEST_F( MessageEncodingTest, patchedTranslation )
+{
+  BabelFishMessage::Ptr serialized = fish.translateMessage( test_msg );
+  for ( uint32_t flags : { TranslationFlags::None, TranslationFlags::Lazy } )
+  {
+    Message::Ptr translated = fish.translateMessage( *serialized, flags );
+    BabelFishMessage::Ptr unchanged = fish.translateMessage( translated );
+    ASSERT_EQ( unchanged->size(), serialized->size());
+    EXPECT_EQ( std::memcmp( unchanged->buffer(), serialized->buffer(), serialized->size()), 0 );
+
+    // Only fixed size fields are changed, hence, the message is patched
+    (*translated)["ui32"] = 42U;
+    (*translated)["header"]["stamp"] = ros::Time( 7 );
+    (*translated)["point_arr"].as<CompoundArrayMessage>()[2]["x"] = 5.0;
+    BabelFishMessage::Ptr patched = fish.translateMessage( translated );
+    std::vector<uint8_t> expected( translated->_sizeInBytes());
+    translated->writeToStream( expected.data());
+    ASSERT_EQ( patched->size(), expected.size());
+    EXPECT_EQ( std::memcmp( patched->buffer(), expected.data(), expected.size()), 0 );
+    ros_babel_fish_test_msgs::TestMessage ros_msg;
+    ros::serialization::IStream stream( const_cast<uint8_t *>(patched->buffer()), patched->size());
+    ros::serialization::deserialize( stream, ros_msg );
+    EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( translated, ros_msg ));
+
+    // Changing the size of a field requires the message to be serialized again
+    (*translated)["str"] = "a longer test string";
+    BabelFishMessage::Ptr resized = fish.translateMessage( translated );
+    ros::serialization::IStream resized_stream( const_cast<uint8_t *>(resized->buffer()), resized->size());
+    ros::serialization::deserialize( resized_stream, ros_msg );
+    EXPECT_EQ( ros_msg.str, "a longer test string" );
+    EXPECT_TRUE( MESSAGE_CONTENT_EQUAL( translated, ros_msg ));
+  }
+}
+
 int main( int argc, char **argv )
 {
   testing::InitGoogleTest( &argc, argv );
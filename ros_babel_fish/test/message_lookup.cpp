@@ -2,8 +2,10 @@
 // Created by Stefan Fabian on 15.09.19.
 //
 
+#include <ros_babel_fish/generation/internal/message_spec_parser.h>
 #include <ros_babel_fish/generation/providers/integrated_description_provider.h>
 #include <ros_babel_fish/generation/providers/message_only_description_provider.h>
+#include <ros_babel_fish/generation/providers/precompiled_description_provider.h>
 
 #include <geometry_msgs/AccelStamped.h>
 #include <geometry_msgs/AccelWithCovarianceStamped.h>
@@ -38,8 +40,31 @@
 #include <gtest/gtest.h>
 #include <ros/ros.h>
 
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+
 using namespace ros_babel_fish;
 
+namespace
+{
+//! Provider that can not look up any message and exposes the registration of services from their specifications.
+class ServiceRegistrationProvider : public DescriptionProvider
+{
+public:
+  using DescriptionProvider::MessageSpec;
+  using DescriptionProvider::parseSpec;
+  using DescriptionProvider::registerService;
+
+protected:
+  MessageDescription::ConstPtr getMessageDescriptionImpl( const std::string & ) override { return nullptr; }
+
+  ServiceDescription::ConstPtr getServiceDescriptionImpl( const std::string & ) override { return nullptr; }
+};
+}
+
 template<typename MsgType, typename ProviderType>
 ::testing::AssertionResult compareDescription()
 {
@@ -182,6 +207,415 @@ TEST( MessageLookupTest, constants )
   ASSERT_EQ( constant_map["FLAG4"]->value<bool>(), ros_babel_fish_test_msgs::TestMessage::FLAG4 );
 }
 
+TEST( MessageLookupTest, concurrentLookup )
+{
+  namespace mt = ros::message_traits;
+  const std::vector<std::string> types = {
+    mt::datatype<visualization_msgs::MarkerArray>(), mt::datatype<visualization_msgs::InteractiveMarker>(),
+    mt::datatype<geometry_msgs::PoseWithCovarianceStamped>(), mt::datatype<std_msgs::Header>(),
+    mt::datatype<ros_babel_fish_test_msgs::TestMessage>()
+  };
+  IntegratedDescriptionProvider provider;
+  const size_t thread_count = 8;
+  std::vector<std::vector<MessageDescription::ConstPtr>> results( thread_count );
+  std::vector<std::thread> threads;
+  for ( size_t i = 0; i < thread_count; ++i )
+  {
+    threads.emplace_back( [&provider, &types, &results, i]()
+                          {
+                            for ( int k = 0; k < 100; ++k )
+                            {
+                              // Every thread starts with a different type to race on cache misses and hits
+                              const std::string &type = types[(i + k) % types.size()];
+                              MessageDescription::ConstPtr description = provider.getMessageDescription( type );
+                              if ( k < static_cast<int>(types.size())) results[i].push_back( description );
+                            }
+                            provider.getServiceDescription( "rosapi/GetParam" );
+                          } );
+  }
+  for ( auto &thread : threads ) thread.join();
+  for ( size_t i = 0; i < thread_count; ++i )
+  {
+    ASSERT_EQ( results[i].size(), types.size());
+    for ( size_t k = 0; k < types.size(); ++k )
+    {
+      const std::string &type = types[(i + k) % types.size()];
+      ASSERT_NE( results[i][k], nullptr ) << type;
+      // Each type was resolved exactly once, hence, all threads obtained the same description
+      EXPECT_EQ( results[i][k], provider.getMessageDescription( type )) << type;
+    }
+  }
+  ServiceDescription::ConstPtr service = provider.getServiceDescription( "rosapi/GetParam" );
+  ASSERT_NE( service, nullptr );
+  EXPECT_EQ( service->request, provider.getMessageDescription( "rosapi/GetParamRequest" ));
+}
+
+TEST( MessageLookupTest, serviceWithMissingDependency )
+{
+  ServiceRegistrationProvider provider;
+  ServiceDescription::ConstPtr valid = provider.registerService( "test_pkg/Valid", "int32 a\n---\nstring b\n",
+                                                                 "int32 a", "string b\n" );
+  ASSERT_NE( valid, nullptr );
+  ASSERT_NE( valid->request, nullptr );
+  ASSERT_NE( valid->response, nullptr );
+
+  // Services with a request or response that can not be resolved are not registered
+  EXPECT_EQ( provider.registerService( "test_pkg/MissingRequest", "test_pkg/Missing a\n---\nstring b\n",
+                                       "test_pkg/Missing a", "string b\n" ), nullptr );
+  EXPECT_EQ( provider.registerService( "test_pkg/MissingResponse", "int32 a\n---\nMissing b\n",
+                                       "int32 a", "Missing b\n" ), nullptr );
+  EXPECT_EQ( provider.getServiceDescription( "test_pkg/MissingRequest" ), nullptr );
+  EXPECT_EQ( provider.getServiceDescription( "test_pkg/MissingResponse" ), nullptr );
+
+  // The same applies to services registered from specs, e.g., loaded from a cache
+  ServiceRegistrationProvider::MessageSpec request = provider.parseSpec( "test_pkg/CachedRequest", "test_pkg", "int32 a" );
+  ServiceRegistrationProvider::MessageSpec response = provider.parseSpec( "test_pkg/CachedResponse", "test_pkg",
+                                                                          "Missing b\n" );
+  EXPECT_EQ( provider.registerService( "test_pkg/Cached", "00000000000000000000000000000000",
+                                       "int32 a\n---\nMissing b\n", request, "int32 a", response, "Missing b\n" ),
+             nullptr );
+  EXPECT_EQ( provider.getServiceDescription( "test_pkg/Cached" ), nullptr );
+}
+
+TEST( MessageLookupTest, messageVersions )
+{
+  const std::string separator = "================================================================================\n";
+  const std::string definition_v1 = "Inner inner\nint32 a\n" + separator + "MSG: test_pkg/Inner\nfloat64 x\n";
+  const std::string definition_v2 = "Inner inner\nint32 a\n" + separator + "MSG: test_pkg/Inner\nfloat64 x\nfloat64 y\n";
+  MessageDescription::ConstPtr expected_v1, expected_v2;
+  {
+    MessageOnlyDescriptionProvider provider;
+    expected_v1 = provider.registerMessageByDefinition( "test_pkg/Outer", definition_v1 );
+  }
+  {
+    MessageOnlyDescriptionProvider provider;
+    expected_v2 = provider.registerMessageByDefinition( "test_pkg/Outer", definition_v2 );
+  }
+  ASSERT_NE( expected_v1, nullptr );
+  ASSERT_NE( expected_v2, nullptr );
+  ASSERT_NE( expected_v1->md5, expected_v2->md5 );
+
+  MessageOnlyDescriptionProvider provider;
+  MessageDescription::ConstPtr v1 = provider.getMessageDescription( "test_pkg/Outer", expected_v1->md5, definition_v1 );
+  MessageDescription::ConstPtr v2 = provider.getMessageDescription( "test_pkg/Outer", expected_v2->md5, definition_v2 );
+  ASSERT_NE( v1, nullptr );
+  ASSERT_NE( v2, nullptr );
+  EXPECT_EQ( v1->md5, expected_v1->md5 );
+  EXPECT_EQ( v2->md5, expected_v2->md5 );
+  EXPECT_EQ( v1->message_definition, expected_v1->message_definition );
+  EXPECT_EQ( v2->message_definition, expected_v2->message_definition );
+  // Each version uses the versions of its dependencies from its definition
+  EXPECT_EQ( v1->message_template->compound.types[0]->compound.names.size(), 1U );
+  EXPECT_EQ( v2->message_template->compound.types[0]->compound.names.size(), 2U );
+  // Versions are cached by their MD5 sum, look ups without MD5 sum return the version registered first
+  EXPECT_EQ( provider.getMessageDescription( "test_pkg/Outer", expected_v2->md5, definition_v2 ), v2 );
+  EXPECT_EQ( provider.getMessageDescription( "test_pkg/Outer", expected_v1->md5, "" ), v1 );
+  EXPECT_EQ( provider.getMessageDescription( "test_pkg/Outer" ), v1 );
+  EXPECT_EQ( provider.getMessageDescription( "test_pkg/Inner" )->message_template,
+             v1->message_template->compound.types[0] );
+}
+
+TEST( MessageLookupTest, batchRegistration )
+{
+  namespace mt = ros::message_traits;
+  std::vector<DescriptionProvider::MessageDefinition> definitions = {
+    { mt::datatype<geometry_msgs::PoseStamped>(), mt::md5sum<geometry_msgs::PoseStamped>(),
+      mt::definition<geometry_msgs::PoseStamped>() },
+    { mt::datatype<visualization_msgs::MarkerArray>(), mt::md5sum<visualization_msgs::MarkerArray>(),
+      mt::definition<visualization_msgs::MarkerArray>() },
+    { mt::datatype<geometry_msgs::TwistWithCovarianceStamped>(), mt::md5sum<geometry_msgs::TwistWithCovarianceStamped>(),
+      mt::definition<geometry_msgs::TwistWithCovarianceStamped>() },
+    { mt::datatype<geometry_msgs::PoseStamped>(), mt::md5sum<geometry_msgs::PoseStamped>(),
+      mt::definition<geometry_msgs::PoseStamped>() },
+    { "test_pkg/Broken", "", "test_pkg/Unknown field\n" },
+    { mt::datatype<std_msgs::Empty>(), mt::md5sum<std_msgs::Empty>(), mt::definition<std_msgs::Empty>() }
+  };
+  MessageOnlyDescriptionProvider provider;
+  std::vector<MessageDescription::ConstPtr> descriptions = provider.registerMessagesByDefinition( definitions );
+  ASSERT_EQ( descriptions.size(), definitions.size());
+  // Definitions that can not be resolved do not prevent the other definitions from being registered
+  EXPECT_EQ( descriptions[4], nullptr );
+  EXPECT_EQ( descriptions[0], descriptions[3] );
+  for ( size_t i = 0; i < definitions.size(); ++i )
+  {
+    if ( i == 4 ) continue;
+    ASSERT_NE( descriptions[i], nullptr ) << definitions[i].datatype;
+    EXPECT_EQ( descriptions[i]->md5, definitions[i].md5 ) << definitions[i].datatype;
+    EXPECT_EQ( descriptions[i], provider.getMessageDescription( definitions[i].datatype, definitions[i].md5, "" ));
+    MessageOnlyDescriptionProvider single_provider;
+    MessageDescription::ConstPtr expected = single_provider.registerMessageByDefinition( definitions[i].datatype,
+                                                                                         definitions[i].definition );
+    ASSERT_NE( expected, nullptr );
+    EXPECT_EQ( descriptions[i]->md5, expected->md5 );
+    EXPECT_EQ( descriptions[i]->message_definition, expected->message_definition );
+  }
+  // Embedded messages are registered, too
+  MessageDescription::ConstPtr header = provider.getMessageDescription( mt::datatype<std_msgs::Header>());
+  ASSERT_NE( header, nullptr );
+  EXPECT_EQ( header->md5, std::string( mt::md5sum<std_msgs::Header>()));
+}
+
+TEST( MessageLookupTest, prefetchPackages )
+{
+  namespace mt = ros::message_traits;
+  IntegratedDescriptionProvider provider( "", true );
+  // Look ups have to succeed while the package paths are prefetched in the background
+  MessageDescription::ConstPtr description = provider.getMessageDescription( mt::datatype<visualization_msgs::Marker>());
+  ASSERT_NE( description, nullptr );
+  EXPECT_EQ( description->md5, std::string( mt::md5sum<visualization_msgs::Marker>()));
+  ServiceDescription::ConstPtr service = provider.getServiceDescription( "rosapi/GetParam" );
+  ASSERT_NE( service, nullptr );
+  EXPECT_EQ( service->request, provider.getMessageDescription( "rosapi/GetParamRequest" ));
+  EXPECT_EQ( provider.getMessageDescription( "nonexistent_package_abc/Message" ), nullptr );
+  EXPECT_EQ( provider.getMessageDescription( "nonexistent_package_abc/Message" ), nullptr );
+}
+
+TEST( MessageLookupTest, resolveAllPackages )
+{
+  namespace mt = ros::message_traits;
+  IntegratedDescriptionProvider provider;
+  ASSERT_TRUE( provider.resolveAllPackages( 4 ));
+  // Resolving again only looks up packages that were not resolved yet
+  ASSERT_TRUE( provider.resolveAllPackages());
+  MessageDescription::ConstPtr description = provider.getMessageDescription( mt::datatype<geometry_msgs::PoseStamped>());
+  ASSERT_NE( description, nullptr );
+  EXPECT_EQ( description->md5, std::string( mt::md5sum<geometry_msgs::PoseStamped>()));
+  ASSERT_NE( provider.getServiceDescription( "rosapi/GetParam" ), nullptr );
+}
+
+TEST( MessageLookupTest, descriptionCache )
+{
+  namespace mt = ros::message_traits;
+  char cache_path[] = "/tmp/rbf_description_cacheXXXXXX";
+  int fd = mkstemp( cache_path );
+  ASSERT_NE( fd, -1 );
+  close( fd );
+  std::string marker_type = mt::datatype<visualization_msgs::MarkerArray>();
+  std::string test_type = mt::datatype<ros_babel_fish_test_msgs::TestMessage>();
+  {
+    // The empty file is not a valid cache and ignored
+    IntegratedDescriptionProvider provider( cache_path );
+    ASSERT_NE( provider.getMessageDescription( marker_type ), nullptr );
+    ASSERT_NE( provider.getServiceDescription( "rosapi/GetParam" ), nullptr );
+    EXPECT_TRUE( provider.saveCache());
+  }
+  {
+    DescriptionCache cache( cache_path );
+    DescriptionCache::MessageEntry entry;
+    ASSERT_TRUE( cache.findMessage( marker_type, entry ));
+    EXPECT_EQ( entry.md5, mt::md5sum<visualization_msgs::MarkerArray>());
+    EXPECT_EQ( entry.definition, mt::definition<visualization_msgs::MarkerArray>());
+    EXPECT_EQ( entry.dependencies.size(), entry.dependency_md5s.size());
+    ASSERT_TRUE( cache.findMessage( mt::datatype<visualization_msgs::Marker>(), entry ));
+    ASSERT_TRUE( cache.findMessage( "rosapi/GetParamRequest", entry ));
+    DescriptionCache::ServiceEntry service_entry;
+    ASSERT_TRUE( cache.findService( "rosapi/GetParam", service_entry ));
+    EXPECT_FALSE( cache.findMessage( test_type, entry ));
+  }
+  {
+    // Descriptions created from the cache are identical to the ones created from the message files
+    IntegratedDescriptionProvider provider( cache_path );
+    IntegratedDescriptionProvider uncached_provider;
+    std::vector<std::string> types = { marker_type, mt::datatype<visualization_msgs::Marker>(), test_type };
+    for ( const std::string &type : types )
+    {
+      MessageDescription::ConstPtr description = provider.getMessageDescription( type );
+      MessageDescription::ConstPtr expected = uncached_provider.getMessageDescription( type );
+      ASSERT_NE( description, nullptr ) << type;
+      EXPECT_EQ( description->md5, expected->md5 ) << type;
+      EXPECT_EQ( description->message_definition, expected->message_definition ) << type;
+      EXPECT_EQ( description->specification, expected->specification ) << type;
+      EXPECT_EQ( description->message_template->compound.names, expected->message_template->compound.names );
+      EXPECT_EQ( description->message_template->constants.size(), expected->message_template->constants.size());
+    }
+    ServiceDescription::ConstPtr service = provider.getServiceDescription( "rosapi/GetParam" );
+    ASSERT_NE( service, nullptr );
+    EXPECT_EQ( service->md5, uncached_provider.getServiceDescription( "rosapi/GetParam" )->md5 );
+    EXPECT_EQ( service->request->md5, uncached_provider.getMessageDescription( "rosapi/GetParamRequest" )->md5 );
+  }
+  {
+    // Types resolved by the second provider were added
+    DescriptionCache cache( cache_path );
+    DescriptionCache::MessageEntry entry;
+    EXPECT_TRUE( cache.findMessage( marker_type, entry ));
+    ASSERT_TRUE( cache.findMessage( test_type, entry ));
+    EXPECT_EQ( entry.md5, mt::md5sum<ros_babel_fish_test_msgs::TestMessage>());
+  }
+  // Entries are rejected if their source file or one of their dependencies changed. The MD5 sum of the modified
+  // entries is replaced to detect whether the provider used them.
+  std::vector<std::function<void( DescriptionCache::MessageEntry & )>> modifications = {
+    []( DescriptionCache::MessageEntry &entry ) { entry.source_stamp.modification_time += 1; },
+    []( DescriptionCache::MessageEntry &entry ) { entry.source_stamp.size += 1; },
+    []( DescriptionCache::MessageEntry &entry ) { entry.dependency_md5s[0] = "changed"; }
+  };
+  for ( size_t i = 0; i < modifications.size(); ++i )
+  {
+    {
+      DescriptionCache cache( cache_path );
+      DescriptionCache::MessageEntry entry;
+      ASSERT_TRUE( cache.findMessage( marker_type, entry ));
+      ASSERT_FALSE( entry.dependency_md5s.empty());
+      modifications[i]( entry );
+      entry.md5 = "stale";
+      cache.storeMessage( std::move( entry ));
+      ASSERT_TRUE( cache.save());
+    }
+    {
+      IntegratedDescriptionProvider provider( cache_path );
+      MessageDescription::ConstPtr description = provider.getMessageDescription( marker_type );
+      ASSERT_NE( description, nullptr ) << "Modification " << i;
+      EXPECT_EQ( description->md5, mt::md5sum<visualization_msgs::MarkerArray>()) << "Modification " << i;
+      EXPECT_TRUE( provider.saveCache());
+    }
+    {
+      // The rejected entry was replaced by a valid one
+      DescriptionCache cache( cache_path );
+      DescriptionCache::MessageEntry entry;
+      ASSERT_TRUE( cache.findMessage( marker_type, entry ));
+      EXPECT_EQ( entry.md5, mt::md5sum<visualization_msgs::MarkerArray>()) << "Modification " << i;
+    }
+  }
+  {
+    // Corrupted caches are ignored
+    std::fstream file( cache_path, std::ios::in | std::ios::out | std::ios::binary );
+    file.seekp( 200 );
+    file.write( "corrupted", 9 );
+  }
+  {
+    IntegratedDescriptionProvider provider( cache_path );
+    MessageDescription::ConstPtr description = provider.getMessageDescription( marker_type );
+    ASSERT_NE( description, nullptr );
+    EXPECT_EQ( description->md5, mt::md5sum<visualization_msgs::MarkerArray>());
+  }
+  std::remove( cache_path );
+}
+
+TEST( MessageLookupTest, precompiledDescriptionProvider )
+{
+  namespace mt = ros::message_traits;
+  char database_path[] = "/tmp/rbf_description_databaseXXXXXX";
+  int fd = mkstemp( database_path );
+  ASSERT_NE( fd, -1 );
+  close( fd );
+  // The empty file is not a valid database
+  EXPECT_THROW( PrecompiledDescriptionProvider provider( database_path ), BabelFishException );
+  std::vector<std::string> types = {
+    mt::datatype<visualization_msgs::MarkerArray>(), mt::datatype<geometry_msgs::PoseWithCovarianceStamped>(),
+    mt::datatype<ros_babel_fish_test_msgs::TestMessage>()
+  };
+  IntegratedDescriptionProvider expected_provider( database_path );
+  for ( const std::string &type : types ) ASSERT_NE( expected_provider.getMessageDescription( type ), nullptr ) << type;
+  ASSERT_NE( expected_provider.getServiceDescription( "rosapi/GetParam" ), nullptr );
+  ASSERT_TRUE( expected_provider.saveCache());
+
+  PrecompiledDescriptionProvider provider( database_path );
+  types.push_back( mt::datatype<visualization_msgs::Marker>());
+  types.push_back( mt::datatype<std_msgs::Header>());
+  for ( const std::string &type : types )
+  {
+    MessageDescription::ConstPtr description = provider.getMessageDescription( type );
+    MessageDescription::ConstPtr expected = expected_provider.getMessageDescription( type );
+    ASSERT_NE( description, nullptr ) << type;
+    EXPECT_EQ( description->md5, expected->md5 ) << type;
+    EXPECT_EQ( description->message_definition, expected->message_definition ) << type;
+    EXPECT_EQ( description->specification, expected->specification ) << type;
+    EXPECT_EQ( description->message_template->compound.names, expected->message_template->compound.names );
+    EXPECT_EQ( description->message_template->constants.size(), expected->message_template->constants.size());
+  }
+  ServiceDescription::ConstPtr service = provider.getServiceDescription( "rosapi/GetParam" );
+  ASSERT_NE( service, nullptr );
+  EXPECT_EQ( service->md5, expected_provider.getServiceDescription( "rosapi/GetParam" )->md5 );
+  EXPECT_EQ( service->request->md5, expected_provider.getMessageDescription( "rosapi/GetParamRequest" )->md5 );
+  // Types that were not resolved when the database was created are not available
+  EXPECT_EQ( provider.getMessageDescription( mt::datatype<std_msgs::String>()), nullptr );
+  EXPECT_EQ( provider.getServiceDescription( "rosapi/DeleteParam" ), nullptr );
+
+  // Messages received with their definition are looked up by their MD5 sum without parsing the definition
+  PrecompiledDescriptionProvider received_provider( database_path );
+  MessageDescription::ConstPtr received = received_provider.getMessageDescription(
+    mt::datatype<visualization_msgs::MarkerArray>(), mt::md5sum<visualization_msgs::MarkerArray>(), "invalid" );
+  ASSERT_NE( received, nullptr );
+  EXPECT_EQ( received->md5, std::string( mt::md5sum<visualization_msgs::MarkerArray>()));
+  EXPECT_EQ( received->message_definition,
+             expected_provider.getMessageDescription( mt::datatype<visualization_msgs::MarkerArray>())->message_definition );
+  // Only versions that are not contained in the database are resolved from their definition
+  received = received_provider.getMessageDescription( mt::datatype<std_msgs::String>(),
+                                                      mt::md5sum<std_msgs::String>(),
+                                                      mt::definition<std_msgs::String>());
+  ASSERT_NE( received, nullptr );
+  EXPECT_EQ( received->md5, std::string( mt::md5sum<std_msgs::String>()));
+  std::remove( database_path );
+}
+
+::testing::AssertionResult parseConstant( const std::string &line, const std::string &type, const std::string &name,
+                                          const std::string &value )
+{
+  std::string parsed_type, parsed_name, parsed_value;
+  if ( !internal::parseConstantLine( line.data(), line.data() + line.length(), parsed_type, parsed_name, parsed_value ))
+    return ::testing::AssertionFailure() << "'" << line << "' was not parsed as constant.";
+  if ( parsed_type != "string" ) parsed_value = internal::stripComment( parsed_value );
+  if ( parsed_type != type || parsed_name != name || parsed_value != value )
+    return ::testing::AssertionFailure() << "'" << line << "' was parsed as '" << parsed_type << "', '" << parsed_name
+                                         << "', '" << parsed_value << "'.";
+  return ::testing::AssertionSuccess();
+}
+
+::testing::AssertionResult parseField( const std::string &line, const std::string &type, const std::string &base_type,
+                                       const std::string &name )
+{
+  std::string parsed_type, parsed_base_type, parsed_name, parsed_value;
+  if ( internal::parseConstantLine( line.data(), line.data() + line.length(), parsed_type, parsed_name, parsed_value ))
+    return ::testing::AssertionFailure() << "'" << line << "' was parsed as constant.";
+  if ( !internal::parseFieldLine( line.data(), line.data() + line.length(), parsed_type, parsed_base_type,
+                                  parsed_name ))
+    return ::testing::AssertionFailure() << "'" << line << "' was not parsed as field.";
+  if ( parsed_type != type || parsed_base_type != base_type || parsed_name != name )
+    return ::testing::AssertionFailure() << "'" << line << "' was parsed as '" << parsed_type << "', '"
+                                         << parsed_base_type << "', '" << parsed_name << "'.";
+  return ::testing::AssertionSuccess();
+}
+
+::testing::AssertionResult parseNeither( const std::string &line )
+{
+  std::string type, base_type, name, value;
+  if ( internal::parseConstantLine( line.data(), line.data() + line.length(), type, name, value ))
+    return ::testing::AssertionFailure() << "'" << line << "' was parsed as constant.";
+  if ( internal::parseFieldLine( line.data(), line.data() + line.length(), type, base_type, name ))
+    return ::testing::AssertionFailure() << "'" << line << "' was parsed as field.";
+  return ::testing::AssertionSuccess();
+}
+
+TEST( MessageLookupTest, specParser )
+{
+  EXPECT_TRUE( parseConstant( "uint8 DEBUG=1 # debug level", "uint8", "DEBUG", "1" ));
+  EXPECT_TRUE( parseConstant( "  int32  X_2 =  -3  \r", "int32", "X_2", "-3" ));
+  EXPECT_TRUE( parseConstant( "string EXAMPLE=\"#comments\" are ignored, and leading and trailing whitespace removed ",
+                              "string", "EXAMPLE", "\"#comments\" are ignored, and leading and trailing whitespace removed" ));
+  EXPECT_TRUE( parseConstant( "float64 A = 1.5#comment", "float64", "A", "1.5" ));
+  EXPECT_TRUE( parseField( "Header header", "Header", "Header", "header" ));
+  EXPECT_TRUE( parseField( "\tgeometry_msgs/Pose[] poses # comment", "geometry_msgs/Pose[]", "geometry_msgs/Pose",
+                           "poses" ));
+  EXPECT_TRUE( parseField( "float64[36] covariance", "float64[36]", "float64", "covariance" ));
+  EXPECT_TRUE( parseField( "int32 [3] spaced", "int32 [3]", "int32", "spaced" ));
+  EXPECT_TRUE( parseField( "uint8 x=", "uint8", "uint8", "x" ));
+  // The type has to have at least two characters, otherwise the last character is used as name
+  EXPECT_TRUE( parseField( "Header", "Heade", "Heade", "r" ));
+  EXPECT_TRUE( parseField( "pkg/Type[]", "pkg/Typ", "pkg/Typ", "e" ));
+  EXPECT_TRUE( parseNeither( "# A comment = with equals sign" ));
+  EXPECT_TRUE( parseNeither( "   " ));
+  EXPECT_TRUE( parseNeither( "" ));
+  EXPECT_TRUE( parseNeither( "a b" ));
+  // Constant names have to start with a letter
+  EXPECT_TRUE( parseField( "int32 1X = 5", "int32", "int32", "1X" ));
+
+  std::string type;
+  std::string line = "  sensor_msgs/Image[] images";
+  ASSERT_TRUE( internal::parseFieldType( line.data(), line.data() + line.length(), type ));
+  EXPECT_EQ( type, "sensor_msgs/Image" );
+  line = "# comment";
+  EXPECT_FALSE( internal::parseFieldType( line.data(), line.data() + line.length(), type ));
+}
+
 int main( int argc, char **argv )
 {
   testing::InitGoogleTest( &argc, argv );
@@ -0,0 +1,117 @@
+// Copyright (c) 2021 Stefan Fabian. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <ros_babel_fish/generation/providers/integrated_description_provider.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <experimental/filesystem>
+#include <iostream>
+
+namespace fs = std::experimental::filesystem;
+using namespace ros_babel_fish;
+
+/*
+ * Generates the database used by the PrecompiledDescriptionProvider which contains the descriptions of all messages
+ * and services in all packages that can be found by rospack.
+ * Usage: generate_description_database OUTPUT_PATH
+ */
+
+namespace
+{
+class DatabaseGenerator : public IntegratedDescriptionProvider
+{
+public:
+  explicit DatabaseGenerator( const std::string &path ) : IntegratedDescriptionProvider( path ) { }
+
+  //! @return The number of messages and services that could not be resolved.
+  size_t generate( size_t &message_count, size_t &service_count )
+  {
+    resolveAllPackages();
+    std::map<std::string, std::vector<std::string>> msg_paths, srv_paths;
+    {
+      std::lock_guard<std::recursive_mutex> lock( resolve_mutex_ );
+      msg_paths = msg_paths_;
+      srv_paths = srv_paths_;
+    }
+    size_t failed = 0;
+    message_count = 0;
+    for ( auto &package : msg_paths )
+    {
+      for ( auto &type : findTypes( package.first, package.second, ".msg" ))
+      {
+        if ( getMessageDescription( type ) == nullptr )
+        {
+          std::cerr << "Failed to resolve message '" << type << "'!" << std::endl;
+          ++failed;
+          continue;
+        }
+        ++message_count;
+      }
+    }
+    service_count = 0;
+    for ( auto &package : srv_paths )
+    {
+      for ( auto &type : findTypes( package.first, package.second, ".srv" ))
+      {
+        if ( getServiceDescription( type ) == nullptr )
+        {
+          std::cerr << "Failed to resolve service '" << type << "'!" << std::endl;
+          ++failed;
+          continue;
+        }
+        ++service_count;
+      }
+    }
+    return failed;
+  }
+
+private:
+  static std::vector<std::string> findTypes( const std::string &package, const std::vector<std::string> &paths,
+                                             const std::string &extension )
+  {
+    std::vector<std::string> result;
+    for ( auto &path : paths )
+    {
+      for ( auto &entry : fs::directory_iterator( path ))
+      {
+        if ( entry.path().extension() != extension ) continue;
+        std::string type = package + "/" + entry.path().stem().string();
+        // A type may be found in the package path and in a workspace but is only added once
+        if ( std::find( result.begin(), result.end(), type ) == result.end()) result.push_back( type );
+      }
+    }
+    return result;
+  }
+};
+}
+
+int main( int argc, char **argv )
+{
+  if ( argc != 2 )
+  {
+    std::cerr << "Usage: " << argv[0] << " OUTPUT_PATH" << std::endl;
+    return 1;
+  }
+  std::string path = argv[1];
+  // Start from scratch to not keep types that no longer exist
+  std::remove( path.c_str());
+  DatabaseGenerator generator( path );
+  size_t message_count, service_count;
+  size_t failed = generator.generate( message_count, service_count );
+  if ( message_count == 0 )
+  {
+    std::cerr << "No messages found! Make sure your workspace is sourced." << std::endl;
+    return 1;
+  }
+  if ( !generator.saveCache())
+  {
+    std::cerr << "Failed to write description database to '" << path << "'!" << std::endl;
+    return 1;
+  }
+  std::cout << "Generated description database with " << message_count << " messages and " << service_count
+            << " services";
+  if ( failed != 0 ) std::cout << " (" << failed << " failed)";
+  std::cout << "." << std::endl;
+  return 0;
+}